@@ -0,0 +1,96 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * addressspaceimage.h
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPEN62541_COMPAT_INCLUDE_ADDRESSSPACEIMAGE_H_
+#define OPEN62541_COMPAT_INCLUDE_ADDRESSSPACEIMAGE_H_
+
+#include <open62541.h>
+#include <opcua_platformdefs.h>
+#include <uanode.h>
+
+#include <string>
+#include <vector>
+#include <boost/scoped_ptr.hpp>
+
+/* Binary image of a built address space, for warm restarts.
+ *
+ * Layout (native endianness, checked on load):
+ *   header | node records | method argument records | argument array dimensions | string pool
+ * Nodes are stored in an order where parents precede their children. All strings (string NodeIds,
+ * browse names, argument names and descriptions) live in the pool and are referenced by offset and length.
+ * The image is bound to a configuration hash given by the user: an image built for another configuration is rejected.
+ */
+
+//! One node of the image. When read from an image, all strings point into the mapped file (nothing is owned).
+struct AddressSpaceImageNode
+{
+    OpcUa_NodeClass  nodeClass;
+    UA_NodeId        nodeId;
+    UA_NodeId        parentId;
+    UA_NodeId        referenceTypeId;
+    UA_NodeId        typeDefinitionId; // for variables: the data type
+    UA_QualifiedName browseName;
+    OpcUa_Int32      valueRank;   // variables only
+    OpcUa_Byte       accessLevel; // variables only
+    std::vector<UA_Argument> inputArguments;  // methods only
+    std::vector<UA_Argument> outputArguments; // methods only
+};
+
+class AddressSpaceImageWriter
+{
+public:
+    static const OpcUa_UInt32 FormatVersion = 2;
+
+    explicit AddressSpaceImageWriter( OpcUa_UInt64 configHash );
+    ~AddressSpaceImageWriter();
+
+    //! Throws std::invalid_argument for NodeIds other than numeric or string ones
+    void add( const AddressSpaceImageNode& node );
+
+    //! Writes atomically: into a temporary file which then replaces the old image. Throws std::runtime_error.
+    void write( const std::string& path ) const;
+
+    size_t numNodes() const;
+
+private:
+    struct Impl;
+    boost::scoped_ptr<Impl> m_impl;
+};
+
+class AddressSpaceImageReader
+{
+public:
+    //! Maps the file and validates it entirely (format, version, configuration hash, checksum, bounds of all records),
+    //! so that nodes can be then read without any checks. Throws std::runtime_error saying what's wrong.
+    AddressSpaceImageReader( const std::string& path, OpcUa_UInt64 expectedConfigHash );
+    ~AddressSpaceImageReader();
+
+    size_t numNodes() const;
+
+    //! Fills out with i-th node; reusing one object for all the nodes avoids reallocation of argument vectors
+    void node( size_t i, AddressSpaceImageNode& out ) const;
+
+private:
+    struct Impl;
+    boost::scoped_ptr<Impl> m_impl;
+};
+
+//! Convenience for computing a configuration hash: 64-bit FNV-1a of the file contents. Throws std::runtime_error.
+OpcUa_UInt64 hashFileContents( const std::string& path );
+
+#endif /* OPEN62541_COMPAT_INCLUDE_ADDRESSSPACEIMAGE_H_ */
@@ -0,0 +1,100 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * compatnodestore.h
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPEN62541_COMPAT_INCLUDE_COMPATNODESTORE_H_
+#define OPEN62541_COMPAT_INCLUDE_COMPATNODESTORE_H_
+
+#include <cstddef>
+#include <unordered_map>
+#include <boost/thread/shared_mutex.hpp>
+
+#include <uanodeid.h>
+#include <open62541.h>
+
+class UaNode;
+
+//! open62541 nodestore plugin which keeps the server's nodes and the compat UaNode objects in one index.
+//! What is shared is the index, not the nodes: each node still exists twice, as the server's UA_Node (with its own
+//! NodeId, browse name, display name and references, which Browse and Read are served from) and as the compat UaNode.
+//! Each UA_Node is found through a single hash table entry which also holds the compat node, keyed by the NodeId
+//! stored in the UA_Node itself, so NodeManagerBase keeps no index (nor NodeId copies) of its own: what's saved per
+//! node is that hash table entry and its NodeId, and one hash table insertion when the node is added.
+//! Nodes are reference counted: one handed out by getNode() stays valid until releaseNode(), even if the node is
+//! removed or replaced meanwhile. Lookups are lock-shared, so compatNode() can be called from any thread.
+class CompatNodestore
+{
+public:
+    //! Replaces (and releases) the nodestore of the config by a new CompatNodestore. Call it before UA_Server_new();
+    //! the server owns the returned object from then on and deletes it in UA_Server_delete().
+    static CompatNodestore* install( UA_ServerConfig* config );
+
+    //! Binds the compat node to the server's node of the same NodeId. Returns false if the server has no such node.
+    //! A nodeContext other than 0 becomes the server node's context too, in place: what UA_Server_setNodeContext()
+    //! does, without another lookup nor a copy of the node.
+    bool attach( const UA_NodeId& nodeId, UaNode* compatNode, void* nodeContext = 0 );
+
+    //! The compat node bound to the NodeId, 0 if none
+    UaNode* compatNode( const UA_NodeId& nodeId ) const;
+
+    void reserve( std::size_t numNodes );
+    std::size_t numNodes() const;
+
+private:
+    CompatNodestore();
+    ~CompatNodestore();
+    CompatNodestore( const CompatNodestore& other );
+    void operator=( const CompatNodestore& other );
+
+    struct Entry
+    {
+        UA_Node* node;
+        UaNode*  compatNode;
+    };
+    struct KeyHash
+    {
+        std::size_t operator()( const UA_NodeId* nodeId ) const { return UaNodeId::hash( *nodeId ); }
+    };
+    struct KeyEqual
+    {
+        bool operator()( const UA_NodeId* a, const UA_NodeId* b ) const { return UA_NodeId_equal( a, b ); }
+    };
+    // keys point to the nodeId member of the UA_Node of the entry, so they live exactly as long as the entry
+    typedef std::unordered_map<const UA_NodeId*, Entry, KeyHash, KeyEqual> Index;
+
+    static void deleteNodestore( void* context );
+    static UA_Node* newNode( void* context, UA_NodeClass nodeClass );
+    static void deleteNode( void* context, UA_Node* node );
+    static const UA_Node* getNode( void* context, const UA_NodeId* nodeId );
+    static void releaseNode( void* context, const UA_Node* node );
+    static UA_StatusCode getNodeCopy( void* context, const UA_NodeId* nodeId, UA_Node** outNode );
+    static UA_StatusCode insertNode( void* context, UA_Node* node, UA_NodeId* addedNodeId );
+    static UA_StatusCode replaceNode( void* context, UA_Node* node );
+    static UA_StatusCode removeNode( void* context, const UA_NodeId* nodeId );
+    static void iterate( void* context, void* visitorContext, UA_NodestoreVisitor visitor );
+
+    //! Nodes are allocated with their reference count in front of them, see newNode()
+    static void freeNode( UA_Node* node );
+    static void acquire( const UA_Node* node );
+    static void release( const UA_Node* node );
+
+    Index m_index;
+    mutable boost::shared_mutex m_lock;
+    UA_UInt32 m_nextGeneratedId; // for nodes inserted with a null numeric NodeId
+};
+
+#endif /* OPEN62541_COMPAT_INCLUDE_COMPATNODESTORE_H_ */
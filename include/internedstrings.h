@@ -0,0 +1,63 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * internedstrings.h
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPEN62541_COMPAT_INCLUDE_INTERNEDSTRINGS_H_
+#define OPEN62541_COMPAT_INCLUDE_INTERNEDSTRINGS_H_
+
+#include <open62541.h>
+#include <cstddef>
+
+//! Process-wide table of immutable strings: browse names, display names, locales and descriptions repeat
+//! across all instances of a class, so each distinct one is stored once and shared.
+//! Each string is reference-counted: intern() and acquire() take a reference, release() drops it. Strings nobody
+//! references anymore are freed in bulk, once enough of them piled up (or on reclaim()), so that nodes created and
+//! deleted at runtime with ever-new names don't make the table grow without bound.
+//! Returned strings must never be modified nor freed. Thread-safe.
+class InternedStrings
+{
+public:
+    //! The shared string equal to s, with a reference taken for the caller
+    static const UA_String& intern( const UA_String& s );
+    static const UA_String& intern( const char* s );
+
+    //! Another reference to a string returned by intern(), for copies of it. Takes no lock.
+    static void acquire( const UA_String& interned );
+    //! Drops a reference taken by intern() or acquire()
+    static void release( const UA_String& interned );
+
+    //! Frees the strings which aren't referenced anymore; returns how many
+    static std::size_t reclaim();
+
+    struct Statistics
+    {
+        std::size_t distinctStrings;
+        std::size_t bytesStored;   // what the table holds
+        std::size_t requests;      // how many times intern() was called
+        std::size_t bytesRequested; // what would have been allocated without the table
+        std::size_t bytesSaved() const { return bytesRequested > bytesStored ? bytesRequested - bytesStored : 0; }
+    };
+    static Statistics statistics();
+
+    //! Prints the statistics with LogIt, at INF level
+    static void logStatistics();
+
+private:
+    InternedStrings();
+};
+
+#endif /* OPEN62541_COMPAT_INCLUDE_INTERNEDSTRINGS_H_ */
@@ -0,0 +1,114 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * methodexecutor.h
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPEN62541_COMPAT_INCLUDE_METHODEXECUTOR_H_
+#define OPEN62541_COMPAT_INCLUDE_METHODEXECUTOR_H_
+
+#include <methodhandleuanode.h>
+#include <methodmanager.h>
+#include <statuscode.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+//! How the server's method callback runs MethodManager::beginCall(), process-wide.
+//! By default on the server thread, and the method must call finishCall() before beginCall() returns.
+//! With a worker pool, beginCall() runs on one of the workers and finishCall() may be called later, from any thread.
+//! open62541 0.3 can't answer a call after its callback has returned, so the server thread still waits for
+//! finishCall(), but only up to a timeout: a method stuck on slow hardware costs the server that long, not forever,
+//! and the call is answered BadTimeout (a finishCall() coming later is then ignored).
+//! A successful beginCall() must be followed by exactly one finishCall().
+//! On the pool, calls on the same object are queued per object and begun in order, at most maxInFlightPerObject of
+//! them at once (a call is in flight until its finishCall()); calls on different objects run in parallel.
+//! Methods with a typed binding (see bindTypedMethod()) go the same way: on the pool they're queued with their
+//! object's other calls and answered BadTimeout alike.
+class MethodExecutor
+{
+public:
+    //! Methods called from now on run on numThreads workers (replacing the pool there was, after its methods finished).
+    //! A call finding maxInFlightPerObject calls of its object in flight and maxQueuedPerObject waiting is refused at once
+    //! with BadResourceUnavailable. A call which times out while waiting for its turn isn't run at all, and gives its
+    //! place in the queue up right away. A call in flight keeps its place until its finishCall(), though: an object
+    //! whose method never finishes is wedged, all of its further calls time out (or are refused once the queue is full).
+    //! BadTimeout if a method of the pool replaced didn't return from beginCall() within drainTimeout(): that pool's
+    //! threads are left to its methods (and leaked). The new pool is used anyway.
+    static UaStatus startWorkerPool(
+            unsigned int numThreads,
+            boost::posix_time::time_duration timeout,
+            unsigned int maxInFlightPerObject = 1,
+            size_t maxQueuedPerObject = 16 );
+    //! Back to the server thread, after the calls ready for a worker were begun.
+    //! Calls still waiting for their object's turn, and calls arriving meanwhile, are answered BadShutdown
+    //! (not counted in rejectedCalls()). BadTimeout as for startWorkerPool().
+    static UaStatus stopWorkerPool();
+    //! 0 when methods run on the server thread
+    static unsigned int numWorkers();
+    //! Calls refused with BadResourceUnavailable so far
+    static std::uint64_t rejectedCalls();
+
+    //! Blocks until no call through methodHandle is in flight anymore: begun (or waiting for its turn) and not finished
+    //! yet, even if the server thread answered it BadTimeout already. Before the handle or its nodes go away, once the
+    //! server can't start new calls through it. Must not be called from a method of that handle: it would wait for itself.
+    //! Gives up after drainTimeout() and returns false: the calls still use the handle and its nodes then.
+    static bool waitForCalls( const MethodHandle* methodHandle );
+    //! The same, giving up after timeout
+    static bool waitForCalls( const MethodHandle* methodHandle, boost::posix_time::time_duration timeout );
+
+    //! How long waitForCalls() and the pool's shutdown wait for methods; 10 s by default
+    static void setDrainTimeout( boost::posix_time::time_duration timeout );
+    static boost::posix_time::time_duration drainTimeout();
+
+    //! What the server's method callback does: inputs are taken over, outputs are the ones given to finishCall()
+    static UaStatus call(
+            MethodManager* receiver,
+            MethodHandle* methodHandle,
+            UaVariantArray& inputs,
+            UaVariantArray& outputs );
+
+    //! The same for a method with a typed binding. On the server thread the binding works on the server's variants
+    //! directly, without any copy. On the pool the inputs are copied once for the worker (the server's are gone once
+    //! the call timed out), and the worker's outputs are moved into output.
+    static UaStatus call(
+            MethodManager* receiver,
+            MethodHandle* methodHandle,
+            const std::shared_ptr<const TypedMethodBinding>& binding,
+            size_t inputSize,
+            const UA_Variant* input,
+            size_t outputSize,
+            UA_Variant* output );
+
+private:
+    class CallQueues;
+    class WorkerPool;
+    class Completion;
+    class CallsInFlight;
+
+    //! Null when methods run on the server thread. Leaked on purpose, like the pool at exit: a method might be stuck on a worker.
+    static std::shared_ptr<WorkerPool>& workerPool();
+    static boost::mutex& workerPoolLock();
+    //! Null when methods run on the server thread
+    static std::shared_ptr<WorkerPool> currentWorkerPool();
+    //! Submits the call and waits for it; completion is taken over. The outputs of a typed call are moved into typedOutput.
+    static UaStatus callOnPool( const WorkerPool& pool, Completion* completion, UaVariantArray& outputs, UA_Variant* typedOutput = 0 );
+    //! Shuts the pool down, which was taken out of use; BadTimeout (and the pool leaked) if its methods don't return in time
+    static UaStatus shutDown( const std::shared_ptr<WorkerPool>& pool );
+};
+
+#endif /* OPEN62541_COMPAT_INCLUDE_METHODEXECUTOR_H_ */
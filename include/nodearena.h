@@ -0,0 +1,121 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * nodearena.h
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPEN62541_COMPAT_INCLUDE_NODEARENA_H_
+#define OPEN62541_COMPAT_INCLUDE_NODEARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//! Bump allocator handing out objects from large blocks. Blocks are never freed one by one:
+//! clear() (or the destructor) runs the destructors of the objects which aren't trivially destructible, in reverse
+//! order of creation, and then releases the blocks in one go. Teardown is therefore linear in the number of such objects
+//! (nodes always are), it only saves their individual frees. An object can be destroyed earlier with recycle(); its memory
+//! then serves the next object of the same size and alignment (taking over its place in the order of destruction).
+//! Not thread-safe: objects are expected to be created and recycled from the thread which builds the address space.
+class NodeArena
+{
+public:
+    static const std::size_t DefaultBlockSize = 1024*1024;
+
+    explicit NodeArena( std::size_t blockSize = DefaultBlockSize );
+    ~NodeArena();
+
+    template<typename T, typename... Args>
+    T* create( Args&&... args )
+    {
+        void* memory = obtain( sizeof(T), alignof(T) );
+        T* object;
+        try
+        {
+            object = new (memory) T( std::forward<Args>(args)... );
+        }
+        catch (...)
+        {
+            recycle( memory );
+            throw;
+        }
+        track( memory, std::is_trivially_destructible<T>::value ? 0 : &NodeArena::destroy<T> );
+        return object;
+    }
+
+    //! Destroys an object made by create() and keeps its memory for reuse. Takes the address create() returned,
+    //! i.e. for an object known through a polymorphic base: dynamic_cast<void*>(base).
+    void recycle( void* object );
+
+    //! Whether the pointer points into memory of this arena. O(log(number of blocks)).
+    bool owns( const void* p ) const;
+
+    void clear();
+
+    std::size_t numObjectsToDestroy() const { return m_numObjectsToDestroy; }
+    std::size_t bytesReserved() const { return m_bytesReserved; }
+
+private:
+    NodeArena( const NodeArena& other );
+    void operator=( const NodeArena& other );
+
+    void* allocate( std::size_t size, std::size_t alignment );
+
+    //! Memory for an object, recycled if there's some of that size and alignment, preceded by a Header
+    void* obtain( std::size_t size, std::size_t alignment );
+    void track( void* object, void(*destructor)(void*) );
+
+    template<typename T>
+    static void destroy( void* p ) { static_cast<T*>(p)->~T(); }
+
+    typedef std::pair<void*, void(*)(void*)> Destructor; // the function is 0 once the object is recycled
+
+    //! Right in front of every object
+    struct Header
+    {
+        static const std::uint32_t NoDestructor = 0xFFFFFFFFu;
+        std::uint32_t destructor; // index in m_destructors, kept when the memory is recycled
+        std::uint32_t sizeClass;  // index in m_sizeClasses
+    };
+    static Header* headerOf( void* object ) { return static_cast<Header*>(object) - 1; }
+
+    struct SizeClass
+    {
+        std::size_t        size;
+        std::size_t        alignment;
+        std::vector<void*> recycled;
+    };
+
+    struct Block
+    {
+        char*       begin;
+        std::size_t size;
+        bool operator<( const Block& other ) const { return begin < other.begin; }
+    };
+
+    const std::size_t       m_blockSize;
+    std::vector<Block>      m_blocks; // sorted by address, for owns()
+    char*                   m_cursor;
+    char*                   m_end;
+    std::size_t             m_bytesReserved;
+    std::vector<Destructor> m_destructors;
+    std::size_t             m_numObjectsToDestroy;
+    std::vector<SizeClass>  m_sizeClasses; // few: one per type of node, roughly
+};
+
+#endif /* OPEN62541_COMPAT_INCLUDE_NODEARENA_H_ */
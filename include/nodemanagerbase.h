@@ -27,6 +27,20 @@
 #include <statuscode.h>
 #include <uanode.h>
 #include <other.h>
+#include <nodearena.h>
+#include <compatnodestore.h>
+#include <methodhandleuanode.h>
+#include <startupprofiler.h>
+
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <string>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/intrusive/list.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 
 
 
@@ -41,8 +55,10 @@ class NodeManagerConfig
 class NodeManagerBase: public NodeManagerConfig
 {
 public:
+	//! hashtablesize is the expected number of nodes; it presizes the node index so that it doesn't rehash while the address space is built
 	NodeManagerBase( const char* uri, bool sth, int hashtablesize );
 	virtual ~NodeManagerBase();
+	//! O(1) lookup in the node index. Safe to call from many threads, also while nodes are being added.
 	UaNode* getNode( const UaNodeId& nodeId ) const;
 
 	OpcUa_UInt16 getNameSpaceIndex 	() 	const { return 2; }
@@ -56,13 +72,168 @@ public:
 			UaNode* to,
 			const UaNodeId& refType); // { return addNodeAndReference( from->nodeId(), to, refType ); }
 
+	//! One entry of a bulk insertion, see addNodesAndReferences()
+	struct NodeAndReference
+	{
+		UaNode* parent;
+		UaNode* node;
+		UaNodeId referenceTypeId;
+		NodeAndReference( UaNode* aParent, UaNode* aNode, const UaNodeId& aReferenceTypeId ):
+			parent(aParent), node(aNode), referenceTypeId(aReferenceTypeId) {}
+	};
+
+	//! Adds many nodes in order (parents must precede their children), sharing the prepared attribute structs between them.
+	//! Stops at the first failure and returns its status; nodes added (and properties linked) before the failure stay in
+	//! the address space, nothing after it is touched, whatever the number of threads.
+	//! With preparationThreads > 1, NodeIds, browse names, variable attributes and method arguments are prepared by
+	//! that many worker threads while the calling thread inserts the prepared nodes into the server; 0 means one per core.
+	//! Nodes' getters (nodeId(), browseName() etc.) are then called from the workers, so they must be thread-safe.
+	UaStatus addNodesAndReferences(
+			const std::vector<NodeAndReference>& nodes,
+			unsigned int preparationThreads = 1 );
+
 	void linkServer( UA_Server* server );
 
+	//! Removes a node which has no children (otherwise see deleteSubtree()) from the server, from the node index
+	//! and from its parent's references, and deletes it. Arena-allocated nodes are destroyed and their memory is
+	//! reused for nodes created later (so with an arena, call it from the thread which creates nodes).
+	//! Other nodes' references to it (see UaNode::addReferencedTarget()) are removed too. Takes constant time per
+	//! reference to or from the node (amortized: removed references leave holes, squeezed out now and then).
+	//! Removing a method waits for its calls still in flight, also those answered BadTimeout already
+	//! (see MethodExecutor::waitForCalls()), so it mustn't be done from within that method. If they don't finish within
+	//! MethodExecutor::drainTimeout(), BadTimeout: the server doesn't have the method anymore, but NodeManagerBase keeps
+	//! it (and the nodes above it) for those calls, and its method handle is never reused. Deleting it again later
+	//! doesn't wait anymore.
+	UaStatus deleteNode( const UaNodeId& nodeId );
+
+	//! Like deleteNode(), for the node and everything added under it (children are deleted before their parents).
+	//! If the server refuses to remove one of the nodes, stops there and returns the server's status: the nodes the
+	//! server has removed already (whole subtrees below that one) are removed from NodeManagerBase as well,
+	//! the others stay untouched.
+	UaStatus deleteSubtree( const UaNodeId& nodeId );
+
+	//! Dumps the address space built so far (NodeIds, classes, browse names, references, data types, value ranks,
+	//! access levels, method arguments) into a binary image bound to configHash, e.g. from hashFileContents() of the config file.
+	//! Each node is saved once, with the reference it was added with: references added to it later aren't saved.
+	UaStatus saveAddressSpaceImage( const std::string& path, OpcUa_UInt64 configHash ) const;
+
+	//! Warm restart: if the image is valid and made for configHash, adds all its nodes to the server in one tight loop.
+	//! The image then replaces the construction of the nodes added afterwards (by addNodeAndReference() or
+	//! addNodesAndReferences()) which it has with the same class, parent and reference type: they aren't prepared nor
+	//! inserted in the server, just bound to their preloaded counterparts (one lookup in the server's nodestore with a
+	//! CompatNodestore, see useNodestore(); UA_Server_setNodeContext() otherwise). A node which differs from the image is
+	//! removed from the server and built as usual, and so are its descendants. Must be called after linkServer() and
+	//! before adding nodes. Returns bad status if the image can't be used, with the server as it was before (nodes
+	//! added from the image are removed again); the address space is then built as usual.
+	UaStatus loadAddressSpaceImage( const std::string& path, OpcUa_UInt64 configHash );
+
+	//! Nodes loaded from the image which no node added since then corresponds to
+	size_t numUnclaimedImageNodes() const { return m_numUnclaimedImageNodes; }
+
+	//! Removes from the server the image nodes which nothing claimed (they're browsable, but answer reads, writes and
+	//! calls with BadInternalError) and forgets the image. Call it once the address space is built. Returns their number.
+	size_t removeUnclaimedImageNodes();
+
+	//! Switches on arena allocation of nodes created by createNode(). Must be called before any node is created.
+	//! Arena-allocated nodes are destroyed in bulk with the NodeManagerBase, so they must not be deleted by the user.
+	//! What teardown saves is one heap free per node and the fragmentation: every node still has its destructor run,
+	//! UaNode's being virtual (the arena only skips trivially destructible objects). The destructor logs the time it takes.
+	void useNodeArena( std::size_t blockSize = NodeArena::DefaultBlockSize );
+
+	//! Makes the node index live in the server's nodestore (see CompatNodestore::install()) instead of in NodeManagerBase,
+	//! so that every node is indexed once, together with the server's UA_Node. Must be called before any node is added.
+	void useNodestore( CompatNodestore* nodestore );
+
+	//! Opt-in profiling of address space construction: time, calls and allocations per phase (parent lookup, preparation,
+	//! server insertion, registration) and node class, until finishStartupProfiling(). Costs a clock read per phase.
+	//! With jsonPath, finishStartupProfiling() writes the profile there too.
+	void enableStartupProfiling( const std::string& jsonPath = "" );
+	//! Logs the profile as a table (and writes the JSON file) and stops profiling. Call it when the address space is built.
+	void finishStartupProfiling();
+	const StartupProfiler* startupProfiler() const { return m_profiler.get(); }
+
+	//! Opt-in instrumentation of all variables added so far (see BaseDataVariableType::enableStatistics()): counts and
+	//! latency histograms of reads and writes by clients and of server-side updates, and the update rate. They're
+	//! published in the folder "VariableStatistics" of this namespace, one object per variable, named after its NodeId.
+	//! Costs two clock reads per operation on an instrumented variable. Call it again to instrument variables added since,
+	//! or to retry after a failure: a call which fails publishes none of the statistics it was to publish.
+	UaStatus enableVariableStatistics();
+
+	//! Allocates a node either in the node arena (see useNodeArena()) or on the heap (by default).
+	//! Either way the node is owned by NodeManagerBase once it's added to the address space.
+	template<typename T, typename... Args>
+	T* createNode( Args&&... args )
+	{
+		if (m_nodeArena)
+			return m_nodeArena->create<T>( std::forward<Args>(args)... );
+		else
+			return new T( std::forward<Args>(args)... );
+	}
+
 
 private:
+	struct AddNodeScratch;
+	struct PreparedNode;
+	class PreparationPipeline;
+	class ArgumentListCache;
+
+	//! Inserts the node in the server. Must be called from one thread at a time.
+	UaStatus commitNode(
+			const PreparedNode& prepared,
+			AddNodeScratch& scratch);
+
+	//! If the node was loaded from an address space image (and it's the same node), binds it to the preloaded one and
+	//! returns true; properties, which aren't in the image, are just linked to their method. Otherwise the node is to be
+	//! built as usual. Called before the node is prepared.
+	bool adoptPreloadedNode( UaNode* parent, UaNode* node, const UaNodeId& referenceTypeId );
+
+	//! Puts the node in the list of owned nodes and in the node index, and references it from its parent.
+	//! With a nodestore, a nodeContext other than 0 becomes the server node's context too.
+	void registerNode( UaNode* parent, UaNode* node, const UaNodeId& nodeId, const UaNodeId& referenceTypeId, void* nodeContext = 0 );
+
+	//! Node owned by NodeManagerBase (i.e. one which can be deleted), 0 if none
+	UaNode* ownedNode( const UaNodeId& nodeId ) const;
+
+	//! Method handles (the method node context in the server) come from a pool, so that deleted methods' handles get reused
+	MethodHandleUaNode* acquireMethodHandle( UaNode* object, UaNode* method );
+	void releaseMethodHandle( MethodHandleUaNode* handle );
+
+	//! Removes nodes[0] and its descendants nodes[1..] (parents before children) from the server and then from NodeManagerBase
+	UaStatus removeNodes( const std::vector<UaNode*>& nodes );
+
+	typedef std::unordered_map<UaNodeId, UaNode*, UaNodeIdHash> NodeIndex;
+	//! A node loaded from the address space image, see loadAddressSpaceImage()
+	struct PreloadedNode
+	{
+		const PreloadedNode* parent; // 0: the Objects folder
+		UaNode* adoptedBy; // 0 until a node added claims it
+		OpcUa_NodeClass nodeClass;
+		ReferenceTypeRegistry::Index referenceType;
+		bool removed; // from the server: the node added differed from it
+	};
+	typedef std::unordered_map<UaNodeId, PreloadedNode, UaNodeIdHash> PreloadedNodes; // values don't move on rehash
+
+	typedef boost::intrusive::list<
+		UaNode,
+		boost::intrusive::member_hook<UaNode, boost::intrusive::list_member_hook<>, &UaNode::m_ownerHook> > OwnedNodes;
+
 	UA_Server* m_server;
-	std::list<UaNode*> m_listNodes;
+	OwnedNodes m_listNodes; // intrusive: any node can be unlinked in O(1)
+	NodeIndex m_nodeIndex;
+	mutable boost::shared_mutex m_nodeIndexLock; // readers: getNode, writers: registerNode, removeNodes
+	CompatNodestore* m_nodestore; // optional, owned by the server; replaces m_nodeIndex, see useNodestore()
 	std::string m_nameSpaceUri;
+	NodeArena* m_nodeArena; // optional, see useNodeArena()
+	size_t m_expectedNumNodes; // hashtablesize of the constructor
+	PreloadedNodes m_preloadedNodes; // see loadAddressSpaceImage()
+	std::vector<PreloadedNodes::value_type*> m_preloadedOrder; // in the order of the image: parents before children
+	size_t m_numUnclaimedImageNodes;
+	boost::scoped_ptr<ArgumentListCache> m_argumentLists;
+	std::deque<MethodHandleUaNode> m_methodHandles; // the pool; deque: handles don't move when it grows
+	std::vector<MethodHandleUaNode*> m_freeMethodHandles;
+	boost::mutex m_methodHandlesLock;
+	boost::scoped_ptr<StartupProfiler> m_profiler; // only while profiling, see enableStartupProfiling()
+	std::string m_profileJsonPath;
 
 		class ServerRootNode: public UaNode
 		{
@@ -28,6 +28,12 @@
 #include <nodemanagerbase.h>
 #include <open62541_compat.h>
 #include <statuscode.h>
+#include <variablestatistics.h>
+#include <atomic>
+#include <memory>
+#include <typeinfo>
+#include <vector>
+#include <boost/thread/mutex.hpp>
 
 namespace OpcUa
 {
@@ -50,8 +56,24 @@ public:
             const UaDataValue& dataValue,
             OpcUa_Boolean checkAccessLevel
     );
+    //! The same for a value built only to be set. Not virtual: it goes through the setValue() above, which is the
+    //! one subclasses override. The value is shared rather than copied, so this costs a reference count increment.
+    UaStatus setValue(
+            Session *session,
+            UaDataValue&& dataValue,
+            OpcUa_Boolean checkAccessLevel
+    )
+    {
+        return setValue( session, static_cast<const UaDataValue&>( dataValue ), checkAccessLevel );
+    }
     virtual OpcUa_Byte accessLevel() const { return m_accessLevel; }
     virtual UaDataValue value(Session* session) ;
+    //! What the server's data source reads. For this class, and subclasses which call copyStoredValueOnRead(), the
+    //! current value deep-copied once, straight into the server's buffer; for any other subclass a copy of value(), so
+    //! that overrides of value() are what clients read.
+    virtual UA_StatusCode copyValueTo( UA_DataValue* target );
+    //! The same for reads of an IndexRange: only that slice of the value is copied
+    virtual UA_StatusCode copyValueTo( UA_DataValue* target, const UA_NumericRange& range );
     virtual UaQualifiedName browseName() const { return m_browseName; }
     virtual UaNodeId typeDefinitionId() const { return m_typeDefinitionId; }
     virtual void setDataType( const UaNodeId& typeref ) { m_typeDefinitionId = typeref; }
@@ -63,13 +85,109 @@ public:
 
     const UA_DataValue* valueImpl() const { return m_currentValue.impl(); }
 
+    //! Deadband of updates from the server side (setValue() without a session, as device logic does; writes of clients
+    //! are never filtered). An update of a numeric scalar is dropped, before the value is touched, when its status is the
+    //! same as the last one and it differs from the last value by no more than the deadband. 0 drops repeated values only.
+    void setAbsoluteDeadband( double deadband );
+    //! The same as a percentage of the engineering units range [euLow, euHigh], as for OPC UA's PercentDeadband
+    void setPercentDeadband( double percent, double euLow, double euHigh );
+    void clearDeadband();
+    //! Updates dropped by the deadband so far
+    OpcUa_UInt64 suppressedUpdates() const { return m_suppressedUpdates.load( std::memory_order_relaxed ); }
+
+    struct Update
+    {
+        BaseDataVariableType* variable;
+        const UaVariant* value;
+        OpcUa_StatusCode status;
+    };
+    //! Server-side updates of many variables at once, e.g. one cycle of a device: the same as setValue() without a
+    //! session for each, but with one timestamp for all of them and updates within a deadband dropped before any value
+    //! is built.
+    //! Returns the first bad status of a setValue(), the other updates are applied nonetheless.
+    static UaStatus setValues( const Update* updates, size_t numUpdates );
+    static UaStatus setValues( const std::vector<Update>& updates ) { return setValues( updates.data(), updates.size() ); }
+
+    //! Switches on counting and timing of this variable's reads, writes and server-side updates (see VariableStatistics);
+    //! returns the statistics, also if they were on already. They stay on for the variable's lifetime and outlive it
+    //! if shared. Mustn't be called from two threads at once; reads and writes may go on meanwhile.
+    std::shared_ptr<VariableStatistics> enableStatistics();
+    //! Null unless enableStatistics() was called: all that uninstrumented variables pay is this check
+    VariableStatistics* statistics() const { return m_statistics.load( std::memory_order_acquire ); }
+
+    //! Held by the server across each write of a client, so that a write of an IndexRange, which reads the value and sets
+    //! it with the slice replaced, can't undo another write in between. Server-side updates don't take it; device logic
+    //! whose updates mustn't be undone that way may hold it around its setValue(). One of a fixed set of mutexes shared
+    //! by all variables: never hold two, nor take it inside setValue().
+    boost::mutex& writeLock() const;
+
+protected:
+    //! For subclasses which store the value themselves: the value held here stays empty and costs no allocation
+    BaseDataVariableType(
+            const UaNodeId&    nodeId,
+            const UaString&    name,
+            OpcUa_UInt16       browseNameNameSpaceIndex,
+            OpcUa_Byte         accessLevel,
+            NodeManagerConfig* pNodeConfig,
+            UaMutexRefCounted* pSharedMutex = NULL);
+
+    //! For subclasses which store the value themselves: whether the update is dropped by the deadband; counts what it
+    //! drops, and remembers and publish()es what it lets through, in one step with the comparison: of concurrent
+    //! updates, each is compared with the last one let through before it, and that one is the value held by then.
+    //! value is NaN for anything but a number.
+    template<typename Publish>
+    bool suppressedByDeadband( Session* session, OpcUa_StatusCode status, double value, Publish publish )
+    {
+        if (m_deadband.load( std::memory_order_relaxed ) < 0)
+        {
+            publish();
+            return false;
+        }
+        lockDeadband();
+        const bool within = withinDeadbandLocked( session, status, value );
+        if (!within)
+        {
+            m_lastReportedValue = value;
+            m_lastReportedStatus = status;
+            publish();
+        }
+        unlockDeadband();
+        if (within)
+            m_suppressedUpdates.fetch_add( 1, std::memory_order_relaxed );
+        return within;
+    }
+
+    //! For subclasses which don't override value(): reads copy the value held here directly instead of going
+    //! through value(), which saves a copy
+    void copyStoredValueOnRead() { m_copyStoredValueOnRead = true; }
+
 private:
+    //! Whether copyValueTo() may bypass value()
+    bool readsStoredValue() const { return m_copyStoredValueOnRead || typeid( *this ) == typeid( BaseDataVariableType ); }
+
+    //! Whether an update would be dropped; doesn't count nor remember anything
+    bool withinDeadband( Session* session, OpcUa_StatusCode status, double value ) const;
+    //! The same, m_deadbandLock held
+    bool withinDeadbandLocked( Session* session, OpcUa_StatusCode status, double value ) const;
+    void lockDeadband() const { while (m_deadbandLock.test_and_set( std::memory_order_acquire )); }
+    void unlockDeadband() const { m_deadbandLock.clear( std::memory_order_release ); }
+
     UaQualifiedName m_browseName;
     UaDataValue m_currentValue;
     UaNodeId m_nodeId;
     UaNodeId m_typeDefinitionId;
     OpcUa_Int32 m_valueRank;
     OpcUa_Byte m_accessLevel;
+    bool m_copyStoredValueOnRead;
+
+    std::atomic<double> m_deadband; // absolute; negative when there's none
+    mutable std::atomic_flag m_deadbandLock; // guards the two below; only taken when there's a deadband
+    double m_lastReportedValue; // NaN when the last value wasn't a number
+    OpcUa_StatusCode m_lastReportedStatus;
+    std::atomic<OpcUa_UInt64> m_suppressedUpdates;
+
+    std::shared_ptr<VariableStatistics> m_statisticsOwner;
+    std::atomic<VariableStatistics*> m_statistics; // what the hot paths look at
 };
 
 
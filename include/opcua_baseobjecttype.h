@@ -37,7 +37,7 @@
 namespace OpcUa
 {
 
-    class BaseObjectType: public UaObject, MethodManager
+    class BaseObjectType: public UaObject, public MethodManager
     {
     public:
 	BaseObjectType(
@@ -46,12 +46,13 @@ enum OpcUa_AccessLevels
 };
 
 
+//! Locale and text are interned (see InternedStrings), so the object holds no memory of its own, only references
 class UaLocalizedText
 {
 public:
     UaLocalizedText( const char* locate, const char* text);
     ~UaLocalizedText ();
-    const UA_LocalizedText* impl () { return &m_impl; }
+    const UA_LocalizedText* impl () const { return &m_impl; }
 private:
     UaLocalizedText( const UaLocalizedText & other );
     void operator= ( const UaLocalizedText & other );
@@ -59,14 +60,19 @@ private:
 };
 
 
+//! The name is interned (see InternedStrings): copying a UaQualifiedName doesn't allocate, it takes another
+//! reference to the name, and all nodes with the same browse name share its buffer.
 class UaQualifiedName
 {
   public:
     UaQualifiedName(int ns, const UaString& name);
+    UaQualifiedName(const UaQualifiedName& other);
+    void operator=(const UaQualifiedName& other);
+    ~UaQualifiedName();
+    //! The name is valid as long as this object
     UA_QualifiedName impl() const { return m_impl; }
-    UaString unqualifiedName() const { return m_unqualifiedName; }
+    UaString unqualifiedName() const { return UaString( &m_impl.name ); }
   private:
-    UaString m_unqualifiedName;
     UA_QualifiedName m_impl;
 };
 
@@ -0,0 +1,219 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * scalardatavariabletype.h
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPEN62541_COMPAT_INCLUDE_SCALARDATAVARIABLETYPE_H_
+#define OPEN62541_COMPAT_INCLUDE_SCALARDATAVARIABLETYPE_H_
+
+#include <opcua_basedatavariabletype.h>
+#include <valueclock.h>
+#include <variablestatistics.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+namespace OpcUa
+{
+
+//! The open62541 type and the OpcUaType of the scalars ScalarDataVariableType can hold
+template<typename T> struct ScalarTypeTraits;
+
+#define OPEN62541_COMPAT_SCALAR_TYPE_TRAITS( CType, UaTypeIndex, UaType ) \
+    template<> struct ScalarTypeTraits<CType> \
+    { \
+        static const UA_DataType* dataType() { return &UA_TYPES[UaTypeIndex]; } \
+        static OpcUaType opcUaType() { return UaType; } \
+    };
+
+OPEN62541_COMPAT_SCALAR_TYPE_TRAITS( OpcUa_Boolean, UA_TYPES_BOOLEAN, OpcUaType_Boolean )
+OPEN62541_COMPAT_SCALAR_TYPE_TRAITS( OpcUa_SByte,   UA_TYPES_SBYTE,   OpcUaType_SByte )
+OPEN62541_COMPAT_SCALAR_TYPE_TRAITS( OpcUa_Byte,    UA_TYPES_BYTE,    OpcUaType_Byte )
+OPEN62541_COMPAT_SCALAR_TYPE_TRAITS( OpcUa_Int16,   UA_TYPES_INT16,   OpcUaType_Int16 )
+OPEN62541_COMPAT_SCALAR_TYPE_TRAITS( OpcUa_UInt16,  UA_TYPES_UINT16,  OpcUaType_UInt16 )
+OPEN62541_COMPAT_SCALAR_TYPE_TRAITS( OpcUa_Int32,   UA_TYPES_INT32,   OpcUaType_Int32 )
+OPEN62541_COMPAT_SCALAR_TYPE_TRAITS( OpcUa_UInt32,  UA_TYPES_UINT32,  OpcUaType_UInt32 )
+OPEN62541_COMPAT_SCALAR_TYPE_TRAITS( OpcUa_Int64,   UA_TYPES_INT64,   OpcUaType_Int64 )
+OPEN62541_COMPAT_SCALAR_TYPE_TRAITS( OpcUa_UInt64,  UA_TYPES_UINT64,  OpcUaType_UInt64 )
+OPEN62541_COMPAT_SCALAR_TYPE_TRAITS( OpcUa_Float,   UA_TYPES_FLOAT,   OpcUaType_Float )
+OPEN62541_COMPAT_SCALAR_TYPE_TRAITS( OpcUa_Double,  UA_TYPES_DOUBLE,  OpcUaType_Double )
+
+#undef OPEN62541_COMPAT_SCALAR_TYPE_TRAITS
+
+//! A variable holding a scalar of type T (one of the numeric OpcUaTypes or Boolean) inline: value, status and timestamps
+//! are a handful of atomic words, published seqlock-style, instead of a heap-allocated UaDataValue. Neither the
+//! construction nor setScalarValue() allocates (the value BaseDataVariableType holds stays empty); the UA_DataValue is
+//! only built when the server reads the variable, in copyValueTo().
+//! Everything else (deadband, statistics, the generic setValue() and value()) works as for BaseDataVariableType;
+//! setValue() of any other type is refused with BadTypeMismatch. valueImpl() isn't meaningful for this class.
+template<typename T>
+class ScalarDataVariableType: public BaseDataVariableType
+{
+public:
+    ScalarDataVariableType(
+            const UaNodeId&    nodeId,
+            const UaString&    name,
+            OpcUa_UInt16       browseNameNameSpaceIndex,
+            T                  initialValue,
+            OpcUa_Byte         accessLevel,
+            NodeManagerConfig* pNodeConfig,
+            UaMutexRefCounted* pSharedMutex = NULL):
+        BaseDataVariableType( nodeId, name, browseNameNameSpaceIndex, accessLevel, pNodeConfig, pSharedMutex ),
+        m_sequence(0)
+    {
+        m_lock.clear();
+        setDataType( UaNodeId( ScalarTypeTraits<T>::opcUaType(), 0 ) );
+        const UA_DateTime now = ValueClock::now().impl();
+        store( initialValue, OpcUa_Good, now, now );
+    }
+
+    //! Server-side update, e.g. from device logic, without any allocation. Both timestamps are taken from ValueClock.
+    UaStatus setScalarValue( T value, OpcUa_StatusCode status = OpcUa_Good )
+    {
+        const UA_DateTime now = ValueClock::now().impl();
+        return update( value, status, now, now );
+    }
+    //! The same with the time the value was acquired
+    UaStatus setScalarValue( T value, OpcUa_StatusCode status, const UaDateTime& sourceTime )
+    {
+        return update( value, status, sourceTime.impl(), ValueClock::now().impl() );
+    }
+
+    T scalarValue() const { return load().value; }
+
+    virtual UaStatus setValue(
+            Session *session,
+            const UaDataValue& dataValue,
+            OpcUa_Boolean checkAccessLevel )
+    {
+        if (checkAccessLevel && !(accessLevel() & UA_ACCESSLEVELMASK_WRITE))
+            return OpcUa_BadUserAccessDenied;
+        const UA_DataValue& incoming = *dataValue.impl();
+        if (!incoming.hasValue || incoming.value.type != ScalarTypeTraits<T>::dataType() || !UA_Variant_isScalar( &incoming.value ))
+            return OpcUa_BadTypeMismatch;
+        VariableStatistics::Scope timing( session ? 0 : statistics(), VariableStatistics::Update );
+        const T value = *static_cast<const T*>( incoming.value.data );
+        const UA_DateTime serverTime = incoming.hasServerTimestamp ? incoming.serverTimestamp : ValueClock::now().impl();
+        const UA_DateTime sourceTime = incoming.hasSourceTimestamp ? incoming.sourceTimestamp : serverTime;
+        suppressedByDeadband( session, incoming.status, static_cast<double>( value ),
+                [&]() { store( value, incoming.status, sourceTime, serverTime ); } );
+        return OpcUa_Good;
+    }
+
+    virtual UaDataValue value( Session* session )
+    {
+        UA_DataValue dataValue;
+        UA_DataValue_init( &dataValue );
+        copyValueTo( &dataValue );
+        return UaDataValue( std::move( dataValue ) );
+    }
+
+    virtual UA_StatusCode copyValueTo( UA_DataValue* target )
+    {
+        const Sample sample = load();
+        UA_DataValue_init( target );
+        UA_StatusCode status = UA_Variant_setScalarCopy( &target->value, &sample.value, ScalarTypeTraits<T>::dataType() );
+        if (status != UA_STATUSCODE_GOOD)
+            return status;
+        target->hasValue = true;
+        target->status = sample.status;
+        target->hasStatus = true;
+        target->sourceTimestamp = sample.sourceTime;
+        target->hasSourceTimestamp = true;
+        target->serverTimestamp = sample.serverTime;
+        target->hasServerTimestamp = true;
+        return UA_STATUSCODE_GOOD;
+    }
+
+    //! A scalar has no slices; whatever open62541 makes of a range of a scalar is returned
+    virtual UA_StatusCode copyValueTo( UA_DataValue* target, const UA_NumericRange& range )
+    {
+        UA_DataValue whole;
+        UA_StatusCode status = copyValueTo( &whole );
+        if (status != UA_STATUSCODE_GOOD)
+            return status;
+        *target = whole;
+        UA_Variant_init( &target->value );
+        status = UA_Variant_copyRange( &whole.value, &target->value, range );
+        UA_Variant_deleteMembers( &whole.value );
+        return status;
+    }
+
+private:
+    struct Sample
+    {
+        T value;
+        OpcUa_StatusCode status;
+        UA_DateTime sourceTime;
+        UA_DateTime serverTime;
+    };
+
+    UaStatus update( T value, OpcUa_StatusCode status, UA_DateTime sourceTime, UA_DateTime serverTime )
+    {
+        VariableStatistics::Scope timing( statistics(), VariableStatistics::Update );
+        suppressedByDeadband( 0, status, static_cast<double>( value ), [&]() { store( value, status, sourceTime, serverTime ); } );
+        return OpcUa_Good;
+    }
+
+    void store( T value, OpcUa_StatusCode status, UA_DateTime sourceTime, UA_DateTime serverTime )
+    {
+        std::uint64_t bits = 0;
+        std::memcpy( &bits, &value, sizeof value );
+        while (m_lock.test_and_set( std::memory_order_acquire ));  // acquire lock
+        const unsigned int sequence = m_sequence.load( std::memory_order_relaxed );
+        m_sequence.store( sequence + 1, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_release );
+        m_value.store( bits, std::memory_order_relaxed );
+        m_status.store( status, std::memory_order_relaxed );
+        m_sourceTime.store( sourceTime, std::memory_order_relaxed );
+        m_serverTime.store( serverTime, std::memory_order_relaxed );
+        m_sequence.store( sequence + 2, std::memory_order_release );
+        m_lock.clear( std::memory_order_release );
+    }
+
+    Sample load() const
+    {
+        std::uint64_t bits;
+        Sample sample;
+        for (;;)
+        {
+            const unsigned int before = m_sequence.load( std::memory_order_acquire );
+            if (before & 1)
+                continue; // a writer is storing right now, look again
+            bits = m_value.load( std::memory_order_relaxed );
+            sample.status = m_status.load( std::memory_order_relaxed );
+            sample.sourceTime = m_sourceTime.load( std::memory_order_relaxed );
+            sample.serverTime = m_serverTime.load( std::memory_order_relaxed );
+            std::atomic_thread_fence( std::memory_order_acquire );
+            if (m_sequence.load( std::memory_order_relaxed ) == before)
+                break;
+        }
+        std::memcpy( &sample.value, &bits, sizeof sample.value );
+        return sample;
+    }
+
+    std::atomic_flag m_lock; // serializes writers
+    std::atomic<unsigned int> m_sequence; // odd while a writer stores
+    std::atomic<std::uint64_t> m_value; // the bits of T
+    std::atomic<OpcUa_StatusCode> m_status;
+    std::atomic<UA_DateTime> m_sourceTime;
+    std::atomic<UA_DateTime> m_serverTime;
+};
+
+}
+
+#endif /* OPEN62541_COMPAT_INCLUDE_SCALARDATAVARIABLETYPE_H_ */
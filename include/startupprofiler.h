@@ -0,0 +1,115 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * startupprofiler.h
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPEN62541_COMPAT_INCLUDE_STARTUPPROFILER_H_
+#define OPEN62541_COMPAT_INCLUDE_STARTUPPROFILER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+//! Cumulative time, number of calls and heap allocations of the phases of address space construction, per node class.
+//! Allocations are only counted when built with PROFILE_STARTUP_ALLOCATIONS (which replaces the global operator new);
+//! they're those made by the compat layer and its users, open62541's own mallocs aren't seen.
+//! Thread-safe: phases may be timed concurrently (e.g. preparation on worker threads).
+class StartupProfiler
+{
+public:
+    enum Phase
+    {
+        ParentLookup,    // getNode() of the parent NodeId
+        Preparation,     // NodeIds, browse names, attributes and method arguments taken from the node
+        ServerInsertion, // UA_Server_add*Node or attaching to a node preloaded from an image
+        Registration,    // node index, list of owned nodes, parent's references
+        NumPhases
+    };
+
+    enum NodeKind
+    {
+        Object,
+        Variable,
+        Method,
+        Property,
+        Unknown, // phases which happen before the node class is known
+        NumNodeKinds
+    };
+
+    struct Counters
+    {
+        std::uint64_t calls;
+        std::uint64_t nanoseconds;
+        std::uint64_t allocations;
+    };
+
+    //! Times one phase of one node from construction to destruction (or finish()). Does nothing with a null profiler.
+    class Scope
+    {
+    public:
+        Scope( StartupProfiler* profiler, Phase phase, NodeKind kind = Unknown );
+        ~Scope();
+        //! For phases which find out what they're dealing with only midway
+        void setKind( NodeKind kind ) { m_kind = kind; }
+        //! Records the phase now rather than at destruction
+        void finish();
+    private:
+        Scope( const Scope& other );
+        void operator=( const Scope& other );
+
+        StartupProfiler* m_profiler;
+        Phase m_phase;
+        NodeKind m_kind;
+        std::chrono::steady_clock::time_point m_start;
+        std::uint64_t m_startAllocations;
+    };
+
+    StartupProfiler();
+
+    void record( Phase phase, NodeKind kind, std::uint64_t nanoseconds, std::uint64_t allocations );
+    Counters counters( Phase phase, NodeKind kind ) const;
+    void reset();
+
+    //! Whether this build counts allocations at all
+    static bool countsAllocations();
+    //! Allocations made by the calling thread so far (0 if not counted)
+    static std::uint64_t threadAllocations();
+
+    static const char* phaseName( Phase phase );
+    static const char* nodeKindName( NodeKind kind );
+
+    //! Human-readable table, one row per phase and node kind that was seen, plus totals per phase
+    std::string summaryTable() const;
+    //! The same as JSON: {"countsAllocations":..,"phases":[{"phase":..,"nodeKind":..,"calls":..,"nanoseconds":..,"allocations":..},..]}
+    std::string toJson() const;
+    //! Throws std::runtime_error if the file can't be written
+    void writeJson( const std::string& path ) const;
+
+private:
+    StartupProfiler( const StartupProfiler& other );
+    void operator=( const StartupProfiler& other );
+
+    struct AtomicCounters
+    {
+        std::atomic<std::uint64_t> calls;
+        std::atomic<std::uint64_t> nanoseconds;
+        std::atomic<std::uint64_t> allocations;
+    };
+    AtomicCounters m_counters[NumPhases][NumNodeKinds];
+};
+
+#endif /* OPEN62541_COMPAT_INCLUDE_STARTUPPROFILER_H_ */
@@ -43,16 +43,19 @@
 #define OpcUa_BadCommunicationError UA_STATUSCODE_BADCOMMUNICATIONERROR
 #define OpcUa_BadNotSupported UA_STATUSCODE_BADNOTSUPPORTED
 #define OpcUa_BadResourceUnavailable UA_STATUSCODE_BADRESOURCEUNAVAILABLE
+#define OpcUa_BadShutdown UA_STATUSCODE_BADSHUTDOWN
 #define OpcUa_BadInternalError UA_STATUSCODE_BADINTERNALERROR
 #define OpcUa_BadInvalidState UA_STATUSCODE_BADINVALIDSTATE
 #define OpcUa_UncertainInitialValue UA_STATUSCODE_UNCERTAININITIALVALUE
 #define OpcUa_BadUnexpectedError UA_STATUSCODE_BADUNEXPECTEDERROR
 #define OpcUa_BadParentNodeIdInvalid UA_STATUSCODE_BADPARENTNODEIDINVALID
+#define OpcUa_BadNodeIdUnknown UA_STATUSCODE_BADNODEIDUNKNOWN
 #define OpcUa_BadServerNotConnected UA_STATUSCODE_BADSERVERNOTCONNECTED
 #define OpcUa_BadServerNotConnected UA_STATUSCODE_BADSERVERNOTCONNECTED
 #define OpcUa_BadIndexRangeInvalid UA_STATUSCODE_BADINDEXRANGEINVALID
 #define OpcUa_BadIndexRangeNoData UA_STATUSCODE_BADINDEXRANGENODATA
 #define OpcUa_BadArgumentsMissing UA_STATUSCODE_BADARGUMENTSMISSING
+#define OpcUa_BadTypeMismatch UA_STATUSCODE_BADTYPEMISMATCH
 
 typedef OpcUa_UInt32 OpcUa_StatusCode;
 
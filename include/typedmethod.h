@@ -0,0 +1,209 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * typedmethod.h
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPEN62541_COMPAT_INCLUDE_TYPEDMETHOD_H_
+#define OPEN62541_COMPAT_INCLUDE_TYPEDMETHOD_H_
+
+#include <uabasenodes.h>
+#include <scalardatavariabletype.h>
+#include <statuscode.h>
+#include <uastring.h>
+#include <uavariant.h>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+
+//! How a parameter of a bound method is taken from an input variant, and put into an output variant.
+//! Numeric scalars and Boolean are read in place; UA_String (input only, as const UA_String&) borrows the server's
+//! string; UaString and UaVariant are copies. A parameter of any other type doesn't compile.
+template<typename T>
+struct MethodArgument
+{
+    static bool matches( const UA_Variant& v ) { return v.type == OpcUa::ScalarTypeTraits<T>::dataType() && UA_Variant_isScalar( &v ); }
+    static T decode( const UA_Variant& v ) { return *static_cast<const T*>( v.data ); }
+    static UA_StatusCode encode( const T& value, UA_Variant* out ) { return UA_Variant_setScalarCopy( out, &value, OpcUa::ScalarTypeTraits<T>::dataType() ); }
+};
+
+template<>
+struct MethodArgument<UA_String>
+{
+    static bool matches( const UA_Variant& v ) { return v.type == &UA_TYPES[UA_TYPES_STRING] && UA_Variant_isScalar( &v ); }
+    static UA_String decode( const UA_Variant& v ) { return *static_cast<const UA_String*>( v.data ); } // shallow
+};
+
+template<>
+struct MethodArgument<UaString>
+{
+    static bool matches( const UA_Variant& v ) { return MethodArgument<UA_String>::matches( v ); }
+    static UaString decode( const UA_Variant& v ) { return UaString( static_cast<const UA_String*>( v.data ) ); }
+    static UA_StatusCode encode( const UaString& value, UA_Variant* out ) { return UA_Variant_setScalarCopy( out, value.impl(), &UA_TYPES[UA_TYPES_STRING] ); }
+};
+
+template<>
+struct MethodArgument<UaVariant>
+{
+    static bool matches( const UA_Variant& v ) { return true; }
+    static UaVariant decode( const UA_Variant& v ) { return UaVariant( v ); }
+    static UA_StatusCode encode( const UaVariant& value, UA_Variant* out ) { return UA_Variant_copy( value.impl(), out ); }
+};
+
+namespace TypedMethodDetail
+{
+
+//! Non-const lvalue references are outputs, everything else inputs
+template<typename P>
+struct IsOutput: std::integral_constant<bool,
+    std::is_lvalue_reference<P>::value && !std::is_const<typename std::remove_reference<P>::type>::value> {};
+
+//! How many of the first N parameters are inputs and outputs
+template<size_t N, typename... Ps>
+struct CountBefore
+{
+    static const size_t inputs = 0;
+    static const size_t outputs = 0;
+};
+
+template<size_t N, typename P, typename... Ps>
+struct CountBefore<N, P, Ps...>
+{
+    static const size_t inputs = N == 0 ? 0 : (IsOutput<P>::value ? 0 : 1) + CountBefore<(N ? N-1 : 0), Ps...>::inputs;
+    static const size_t outputs = N == 0 ? 0 : (IsOutput<P>::value ? 1 : 0) + CountBefore<(N ? N-1 : 0), Ps...>::outputs;
+};
+
+template<size_t... I> struct Indices {};
+template<size_t N, size_t... I> struct MakeIndices: MakeIndices<N-1, N-1, I...> {};
+template<size_t... I> struct MakeIndices<0, I...> { typedef Indices<I...> type; };
+
+template<typename... Args>
+class Binding: public TypedMethodBinding
+{
+public:
+    typedef std::function<UaStatus(Args...)> Function;
+    static const size_t NumInputs = CountBefore<sizeof...(Args), Args...>::inputs;
+    static const size_t NumOutputs = CountBefore<sizeof...(Args), Args...>::outputs;
+
+    explicit Binding( const Function& function ): m_function(function) {}
+
+    virtual UA_StatusCode call( size_t inputSize, const UA_Variant* input, size_t outputSize, UA_Variant* output ) const
+    {
+        if (inputSize < NumInputs)
+            return UA_STATUSCODE_BADARGUMENTSMISSING;
+        if (inputSize > NumInputs)
+            return UA_STATUSCODE_BADTOOMANYARGUMENTS;
+        if (outputSize != NumOutputs)
+            return UA_STATUSCODE_BADINTERNALERROR; // the method node declares other output arguments
+        return call( input, output, typename MakeIndices<sizeof...(Args)>::type() );
+    }
+
+private:
+    typedef std::tuple<typename std::decay<Args>::type...> Values;
+
+    template<size_t... I>
+    UA_StatusCode call( const UA_Variant* input, UA_Variant* output, Indices<I...> ) const
+    {
+        const bool matching[] = { true, matches<I>( input )... };
+        for (size_t i = 0; i < sizeof matching / sizeof matching[0]; ++i)
+            if (!matching[i])
+                return UA_STATUSCODE_BADTYPEMISMATCH;
+        Values values { decode<I>( input )... };
+        UaStatus status = m_function( std::get<I>( values )... );
+        if (status.isNotGood())
+            return status.statusCode();
+        const UA_StatusCode encoded[] = { UA_STATUSCODE_GOOD, encode<I>( values, output )... };
+        for (size_t i = 0; i < sizeof encoded / sizeof encoded[0]; ++i)
+            if (encoded[i] != UA_STATUSCODE_GOOD)
+                return encoded[i];
+        return status.statusCode();
+    }
+
+    template<size_t I>
+    struct Parameter
+    {
+        typedef typename std::tuple_element<I, std::tuple<Args...> >::type Type;
+        typedef typename std::decay<Type>::type Value;
+        static const bool isOutput = IsOutput<Type>::value;
+        static const size_t inputIndex = CountBefore<I, Args...>::inputs;
+        static const size_t outputIndex = CountBefore<I, Args...>::outputs;
+    };
+
+    template<size_t I>
+    static bool matches( const UA_Variant* input )
+    {
+        return Parameter<I>::isOutput || MethodArgument<typename Parameter<I>::Value>::matches( input[Parameter<I>::inputIndex] );
+    }
+
+    //! Outputs start out value-initialized
+    template<size_t I>
+    static typename Parameter<I>::Value decode( const UA_Variant* input )
+    {
+        return decode<I>( input, std::integral_constant<bool, Parameter<I>::isOutput>() );
+    }
+    template<size_t I>
+    static typename Parameter<I>::Value decode( const UA_Variant* input, std::false_type )
+    {
+        return MethodArgument<typename Parameter<I>::Value>::decode( input[Parameter<I>::inputIndex] );
+    }
+    template<size_t I>
+    static typename Parameter<I>::Value decode( const UA_Variant* input, std::true_type )
+    {
+        return typename Parameter<I>::Value();
+    }
+
+    template<size_t I>
+    static UA_StatusCode encode( const Values& values, UA_Variant* output )
+    {
+        return encode<I>( values, output, std::integral_constant<bool, Parameter<I>::isOutput>() );
+    }
+    template<size_t I>
+    static UA_StatusCode encode( const Values& values, UA_Variant* output, std::false_type )
+    {
+        return UA_STATUSCODE_GOOD;
+    }
+    template<size_t I>
+    static UA_StatusCode encode( const Values& values, UA_Variant* output, std::true_type )
+    {
+        return MethodArgument<typename Parameter<I>::Value>::encode( std::get<I>( values ), output + Parameter<I>::outputIndex );
+    }
+
+    const Function m_function;
+};
+
+}
+
+//! Binds a typed implementation to a method node, e.g. std::function<UaStatus(OpcUa_Int32, const UaString&, OpcUa_Double&)>:
+//! parameters taken by value or const reference are the input arguments, non-const references the output arguments,
+//! each in order. Inputs are decoded straight from the server's variants (a call with arguments of other types is
+//! answered BadTypeMismatch), outputs encoded straight into them; no UaVariantArray is built.
+//! The object's beginCall() is bypassed, not the MethodExecutor: the function is called on the server thread, or with
+//! a worker pool on a worker, queued with the object's other calls and under the pool's timeout (the arguments are
+//! then copied to the worker and back).
+template<typename... Args>
+void bindTypedMethod( UaMethod* method, const std::function<UaStatus(Args...)>& function )
+{
+    method->setTypedBinding( std::unique_ptr<TypedMethodBinding>( new TypedMethodDetail::Binding<Args...>( function ) ) );
+}
+
+template<typename... Args>
+void bindTypedMethod( UaMethod* method, UaStatus (*function)(Args...) )
+{
+    bindTypedMethod( method, std::function<UaStatus(Args...)>( function ) );
+}
+
+#endif /* OPEN62541_COMPAT_INCLUDE_TYPEDMETHOD_H_ */
@@ -23,17 +23,33 @@
 #define OPEN62541_COMPAT_INCLUDE_UABASENODES_H_
 
 #include <uanode.h>
+#include <memory>
 
 class UaObject: public UaNode
 {
 
 };
 
+//! A method's implementation which takes the server's argument variants as they are, see bindTypedMethod()
+class TypedMethodBinding
+{
+public:
+	virtual ~TypedMethodBinding() {};
+	virtual UA_StatusCode call( size_t inputSize, const UA_Variant* input, size_t outputSize, UA_Variant* output ) const = 0;
+};
+
 class UaMethod: public UaNode
 {
 public:
 	UaMethod() {};
 
+	//! When set, calls of the method go to the binding instead of the object's beginCall(). Shared with the calls
+	//! running it on the worker pool, so it may be replaced meanwhile.
+	std::shared_ptr<const TypedMethodBinding> typedBinding() const { return m_typedBinding; }
+	void setTypedBinding( std::unique_ptr<TypedMethodBinding> binding ) { m_typedBinding = std::move( binding ); }
+
+private:
+	std::shared_ptr<const TypedMethodBinding> m_typedBinding;
 };
 
 
@@ -25,25 +25,66 @@
 #include <atomic>
 #endif // __linux__
 
+#include <cstdint>
+#include <valuesnapshot.h>
+
+//! The value itself is an immutable ValueSnapshot shared by all copies: copying, assigning and cloning
+//! only move a reference around, whatever the size of the value. Writers (operator=) swap the snapshot
+//! under a spin lock and hand the old one to the EpochReclaimer, readers copy from the snapshot inside an epoch
+//! read section and never block.
+//! Scalars of fixed-size types (numbers, Boolean, DateTime, StatusCode, ...) are also published seqlock-style,
+//! so copyTo() of those doesn't even touch the snapshot.
 class UaDataValue
 {
   public:
-    UaDataValue( const UaVariant& variant, OpcUa_StatusCode statusCode, const UaDateTime& serverTime, const UaDateTime& sourceTime );
+    //! Empty: no value, no status. All empty values share one snapshot, so this allocates nothing.
+    UaDataValue();
+    UaDataValue( const UaVariant& variant, OpcUa_StatusCode statusCode, const UaDateTime& sourceTime, const UaDateTime& serverTime );
     UaDataValue( const UaDataValue& other );
     void operator=(const UaDataValue& other );
+    //! Take over other's value and leave it empty. other must not be read concurrently (same as for its destruction).
+    UaDataValue( UaDataValue&& other );
+    void operator=( UaDataValue&& other );
+    //! Takes over the contents of value, which is left empty: a value built (or copied from the server) once needs no further copy
+    explicit UaDataValue( UA_DataValue&& value );
 
     ~UaDataValue ();
 
-    const UA_DataValue* impl() const { return m_impl; }
-    UaVariant* value() const{ return new UaVariant(m_impl->value); }
+    //! Only for the owner of the value: the pointer is invalid once the value gets assigned
+    const UA_DataValue* impl() const { return &m_snapshot.load( std::memory_order_acquire )->value(); }
+    UaVariant* value() const{ return new UaVariant(impl()->value); }
+
+    OpcUa_StatusCode statusCode() const { return impl()->status; }
 
-    OpcUa_StatusCode statusCode() const { return m_impl->status; }
+    UaDataValue clone(); // shares the snapshot, no copy of the value is made
 
-    UaDataValue clone(); // can't be const because of synchronization
+    //! Deep copy straight into target (which is overwritten, not freed): the only copy a reader of the value needs.
+    UA_StatusCode copyTo( UA_DataValue* target );
+    //! The same with only the given slice of the value (an IndexRange): the rest of the value isn't copied
+    UA_StatusCode copyTo( UA_DataValue* target, const UA_NumericRange& range );
 
   private:
-    UA_DataValue *m_impl;
-    std::atomic_flag m_lock;
+    //! The current snapshot with a reference taken for the caller
+    ValueSnapshot* acquireSnapshot() const;
+    //! The current snapshot with its reference handed over to the caller; an empty value takes its place
+    ValueSnapshot* takeSnapshot();
+    //! Writers: installs incoming (whose reference is taken over) and retires the snapshot it replaces
+    void replaceSnapshot( ValueSnapshot* incoming );
+    //! Shared by all empty (moved-from) values, with a reference taken for the caller
+    static ValueSnapshot* emptySnapshot();
+
+    //! Writers call it holding m_lock, after m_snapshot changed
+    void publish();
+    //! Seqlock read of the published value into target; false if the current value isn't of the published kind
+    bool readPublished( UA_DataValue* target, UA_StatusCode& status ) const;
+
+    // published words: type (0: not published), scalar bits, status and flags, source time, server time
+    enum { PublishedType, PublishedScalar, PublishedStatusAndFlags, PublishedSourceTime, PublishedServerTime, NumPublishedWords };
+
+    std::atomic<ValueSnapshot*> m_snapshot;
+    std::atomic_flag m_lock; // serializes writers
+    std::atomic<unsigned int> m_sequence; // odd while a writer publishes
+    std::atomic<std::uint64_t> m_published[NumPublishedWords];
 
 
 
@@ -12,6 +12,7 @@
 #include <statuscode.h>
 #include <uabasenodes.h>
 #include <simple_arrays.h>
+#include <vector>
 
 
 class UaPropertyMethodArgument: public UaNode
@@ -31,6 +32,7 @@ public:
 			OpcUa_Byte     accessLevel,
 			OpcUa_UInt32   numberOfArguments,
 			ArgumentType   argumentType);
+	virtual ~UaPropertyMethodArgument ();
 
 	virtual UaNodeId nodeId() const { return m_nodeId; }
 	virtual UaNodeId typeDefinitionId() const { return UaNodeId(UA_NS0ID_BASEDATAVARIABLETYPE,0); }
@@ -48,17 +50,21 @@ public:
 
 	// returns UA_Argument per given argument in this property
 	const UA_Argument& implArgument (unsigned int index) const;
+	// all arguments, contiguous (0 when there are none)
+	const UA_Argument* implArguments () const { return m_impl.empty() ? 0 : &m_impl[0]; }
 
-	unsigned int numArguments () const { return m_numberArguments; }
+	unsigned int numArguments () const { return m_impl.size(); }
 
 	ArgumentType argumentType () const { return m_argumentType; }
 
 private:
-	const UaNodeId        m_nodeId;
-	const unsigned int    m_numberArguments;
-	const UaQualifiedName m_browseName;
-	UA_Argument **        m_impl;
-	const ArgumentType    m_argumentType;
+	UaPropertyMethodArgument( const UaPropertyMethodArgument& other );
+	void operator=( const UaPropertyMethodArgument& other );
+
+	const UaNodeId           m_nodeId;
+	const UaQualifiedName    m_browseName;
+	std::vector<UA_Argument> m_impl; // one allocation for all arguments; names and descriptions are interned, not owned
+	const ArgumentType       m_argumentType;
 
 };
 
@@ -33,6 +33,8 @@ public:
 
 	static UaDateTime now();
 
+	const UA_DateTime& impl() const { return m_dateTime; }
+
 	void addSecs(int secs);
 	void addMilliSecs(int msecs);
 
@@ -24,7 +24,9 @@
 
 #include <uanodeid.h>
 #include <other.h>
-#include <list>
+#include <vector>
+#include <iterator>
+#include <boost/intrusive/list_hook.hpp>
 
 enum OpcUa_NodeClass
 {
@@ -35,6 +37,47 @@ enum OpcUa_NodeClass
 
 
 
+//! Reference types are few (HasComponent, Organizes, HasProperty, ...), so references store a small index
+//! into this registry instead of a deep copy of the reference type's NodeId. Thread-safe; it only ever grows,
+//! so lookups don't lock, only registering a new reference type does.
+class ReferenceTypeRegistry
+{
+public:
+    typedef OpcUa_UInt16 Index;
+
+    //! Index of given reference type; reference types not seen so far get registered
+    static Index indexOf( const UaNodeId& referenceTypeId );
+    //! Like indexOf() but without registering: false if the reference type was never seen
+    static bool find( const UaNodeId& referenceTypeId, Index& index );
+    //! The returned NodeId lives until the end of the process
+    static const UaNodeId& nodeId( Index index );
+};
+
+//! The type of ReferencedTarget::referenceTypeId: the registry index of the reference type, usable wherever
+//! the UaNodeId it stands for is (that member used to be a deep copy of the UaNodeId)
+class CompactReferenceTypeId
+{
+public:
+    explicit CompactReferenceTypeId( ReferenceTypeRegistry::Index index ): m_index(index) {}
+
+    ReferenceTypeRegistry::Index index() const { return m_index; }
+    const UaNodeId& nodeId() const { return ReferenceTypeRegistry::nodeId(m_index); }
+    operator const UaNodeId& () const { return nodeId(); }
+
+    bool operator==( const CompactReferenceTypeId& other ) const { return m_index == other.m_index; }
+    bool operator==( const UaNodeId& other ) const { return nodeId() == other; }
+
+    unsigned int namespaceIndex() const { return nodeId().namespaceIndex(); }
+    unsigned int identifierNumeric() const { return nodeId().identifierNumeric(); }
+    UaString toString() const { return nodeId().toString(); }
+    UaString toFullString() const { return nodeId().toFullString(); }
+    UA_NodeId impl() const { return nodeId().impl(); }
+    const UA_NodeId* pimpl() const { return nodeId().pimpl(); }
+    void copyTo( UA_NodeId* other ) const { nodeId().copyTo(other); }
+private:
+    ReferenceTypeRegistry::Index m_index;
+};
+
 class UaNode
 {
 public:
@@ -50,18 +93,167 @@ public:
     struct ReferencedTarget
     {
 	UaNode* target;
-	UaNodeId referenceTypeId;
-    ReferencedTarget( UaNode* aTarget, const UaNodeId& referencedtarget ): target(aTarget), referenceTypeId(referencedtarget) {}
+	CompactReferenceTypeId referenceTypeId;
+	ReferencedTarget( UaNode* aTarget, ReferenceTypeRegistry::Index aReferenceTypeIndex ): target(aTarget), referenceTypeId(aReferenceTypeIndex) {}
+    };
+    //! All references of a node, grouped by reference type (in order of addition within a group). Read-only, iterated
+    //! like the std::list<ReferencedTarget> it used to be: begin()/end(), rbegin()/rend(), size(), empty() and
+    //! BOOST_FOREACH keep working. Code that named std::list as the type of referencedTargets() must use this class
+    //! (or auto) instead, and the references are added and removed through UaNode only.
+    class ReferencedTargets
+    {
+	//! A removed reference leaves a hole (target 0) behind, so that the others keep their positions; the holes are
+	//! squeezed out when they're half of the group, and a group without references is dropped
+	struct Group
+	{
+	    ReferenceTypeRegistry::Index type;
+	    std::vector<ReferencedTarget> targets;
+	    size_t numRemoved;
+	    size_t size() const { return targets.size() - numRemoved; }
+	};
+    public:
+	class const_iterator: public std::iterator<std::bidirectional_iterator_tag, const ReferencedTarget>
+	{
+	public:
+	    const_iterator(): m_group(0), m_groupsEnd(0), m_index(0) {}
+	    const ReferencedTarget& operator*() const { return m_group->targets[m_index]; }
+	    const ReferencedTarget* operator->() const { return &m_group->targets[m_index]; }
+	    const_iterator& operator++()
+	    {
+		do
+		{
+		    if (++m_index == m_group->targets.size())
+		    {
+			m_index = 0;
+			if (++m_group == m_groupsEnd)
+			    break;
+		    }
+		}
+		while (!m_group->targets[m_index].target);
+		return *this;
+	    }
+	    const_iterator& operator--()
+	    {
+		do
+		{
+		    if (m_index == 0)
+			m_index = (--m_group)->targets.size();
+		    --m_index;
+		}
+		while (!m_group->targets[m_index].target);
+		return *this;
+	    }
+	    const_iterator operator++(int) { const_iterator previous (*this); ++*this; return previous; }
+	    const_iterator operator--(int) { const_iterator previous (*this); --*this; return previous; }
+	    bool operator==( const const_iterator& other ) const { return m_group == other.m_group && m_index == other.m_index; }
+	    bool operator!=( const const_iterator& other ) const { return !(*this == other); }
+	private:
+	    friend class ReferencedTargets;
+	    const_iterator( const Group* group, const Group* groupsEnd ): m_group(group), m_groupsEnd(groupsEnd), m_index(0) {}
+	    const Group* m_group;
+	    const Group* m_groupsEnd;
+	    size_t m_index;
+	};
+	typedef const_iterator iterator;
+	typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+	typedef const_reverse_iterator reverse_iterator;
+	typedef ReferencedTarget value_type;
+	typedef const ReferencedTarget& reference;
+	typedef const ReferencedTarget& const_reference;
+	typedef size_t size_type;
+
+	ReferencedTargets(): m_size(0) {}
+	const_iterator begin() const
+	{
+	    const_iterator first ( m_groups.data(), m_groups.data() + m_groups.size() );
+	    if (!m_groups.empty() && !m_groups.front().targets.front().target)
+		++first;
+	    return first;
+	}
+	const_iterator end() const { return const_iterator( m_groups.data() + m_groups.size(), m_groups.data() + m_groups.size() ); }
+	const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+	const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+    private:
+	friend class UaNode;
+	std::vector<Group> m_groups; // by reference type index; a node has references of a few types at most
+	size_t m_size;
+    };
+
+    //! The references of one type, in order of addition
+    class ReferencedTargetRange
+    {
+    public:
+	class const_iterator: public std::iterator<std::forward_iterator_tag, const ReferencedTarget>
+	{
+	public:
+	    const_iterator( const ReferencedTarget* at, const ReferencedTarget* end ): m_at(at), m_end(end) { skipRemoved(); }
+	    const ReferencedTarget& operator*() const { return *m_at; }
+	    const ReferencedTarget* operator->() const { return m_at; }
+	    const_iterator& operator++() { ++m_at; skipRemoved(); return *this; }
+	    const_iterator operator++(int) { const_iterator previous (*this); ++*this; return previous; }
+	    bool operator==( const const_iterator& other ) const { return m_at == other.m_at; }
+	    bool operator!=( const const_iterator& other ) const { return m_at != other.m_at; }
+	private:
+	    void skipRemoved() { while (m_at != m_end && !m_at->target) ++m_at; }
+	    const ReferencedTarget* m_at;
+	    const ReferencedTarget* m_end;
+	};
+	typedef const_iterator iterator;
+
+	ReferencedTargetRange( const ReferencedTarget* begin, const ReferencedTarget* end, size_t size ): m_begin(begin), m_end(end), m_size(size) {}
+	const_iterator begin() const { return const_iterator( m_begin, m_end ); }
+	const_iterator end() const { return const_iterator( m_end, m_end ); }
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+    private:
+	const ReferencedTarget* m_begin;
+	const ReferencedTarget* m_end;
+	size_t m_size;
     };
 
     void releaseReference() {} // TODO: ??
 
-    void addReferencedTarget( UaNode* targetNode, UaNodeId referenceTypeId ) { m_referenceTargets.push_back( ReferencedTarget(targetNode, referenceTypeId));  }
-    const std::list<ReferencedTarget>* referencedTargets() const { return &m_referenceTargets; }
-private:    
-    std::list<ReferencedTarget> m_referenceTargets;
+    //! Appends to the references of that type: amortized O(1), whatever the number of references the node has.
+    //! The target remembers the reference, so that NodeManagerBase can remove it when deleting the target: a node
+    //! referencing a node added to NodeManagerBase must not be destroyed before it, or remove its reference first.
+    void addReferencedTarget( UaNode* targetNode, const UaNodeId& referenceTypeId );
+    //! Removes one reference of given type to the target, returns false if there's none. Scans the references of that
+    //! type only; NodeManagerBase removes the references to a node it deletes in amortized O(1) each.
+    bool removeReferencedTarget( UaNode* targetNode, const UaNodeId& referenceTypeId );
+    const ReferencedTargets* referencedTargets() const { return &m_referenceTargets; }
+    //! All references of given type, without scanning the other ones. Doesn't register unknown reference types.
+    ReferencedTargetRange referencedTargets( const UaNodeId& referenceTypeId ) const;
+private:
+    //! A reference from another node to this one
+    struct Referencing
+    {
+	UaNode* source;
+	ReferenceTypeRegistry::Index type;
+	OpcUa_UInt32 position; // in the source's group of references of that type
+    };
+    static const OpcUa_UInt32 NoPosition = 0xFFFFFFFF;
+
+    //! Appends the reference without the target remembering it; returns its position in its group
+    OpcUa_UInt32 appendReference( UaNode* targetNode, ReferenceTypeRegistry::Index type );
+    //! Removes the reference at that position (leaving a hole), false if it isn't one to targetNode.
+    //! The target's bookkeeping of it is up to the caller.
+    bool removeReferenceAt( UaNode* targetNode, ReferenceTypeRegistry::Index type, OpcUa_UInt32 position );
+    //! Squeezes the holes out of the group, telling the targets of the references which move their new position
+    void compact( ReferencedTargets::Group& group );
+    //! Forgets one reference from source of that type to this node (the target's side of removing it)
+    void forgetReferencing( const UaNode* source, ReferenceTypeRegistry::Index type, OpcUa_UInt32 position );
+
+    ReferencedTargets m_referenceTargets;
 
- 
+    // Bookkeeping of NodeManagerBase, so that it can unlink a node in O(1) when it's deleted
+    friend class NodeManagerBase;
+    boost::intrusive::list_member_hook<> m_ownerHook; // position in the list of nodes owned by NodeManagerBase
+    UaNode* m_parentNode; // the node this one was added under, 0 when not owned by NodeManagerBase
+    ReferenceTypeRegistry::Index m_parentReferenceTypeIndex;
+    OpcUa_UInt32 m_parentPosition; // of the reference from the parent, NoPosition if it was removed by other means
+    std::vector<Referencing> m_referencedBy; // the references to this node other than the one from its parent
 };
 
 
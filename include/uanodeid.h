@@ -25,6 +25,7 @@
 
 #include <uastring.h>
 #include <opcua_platformdefs.h>
+#include <cstddef>
 
 //TODO: switch for amalgamation
 #include <open62541.h>
@@ -44,6 +45,8 @@ public:
     UaNodeId ( const UaString& stringAddress, int ns);
     UaNodeId ( int numericAddress, int ns);
     UaNodeId ( const UaNodeId& other);
+    //! Deep copy of a stack NodeId
+    explicit UaNodeId ( const UA_NodeId& other );
     ~UaNodeId ();
     
     const UaNodeId& operator=(const UaNodeId & other);
@@ -60,12 +63,20 @@ public:
     void copyTo( UA_NodeId* other) const;
     void copyTo( UaNodeId* other) const;
     bool operator==(const UaNodeId& other) const;
+    //! Hash of namespace index and identifier, consistent with operator==. Only numeric and string identifiers are hashed by content.
+    std::size_t hash() const { return hash(m_impl); }
+    //! Same hash for a stack NodeId, e.g. for indexes keyed by NodeIds owned by someone else
+    static std::size_t hash( const UA_NodeId& nodeId );
 private:
     /* UaString m_stringId; */
     UA_NodeId m_impl;
 
 };
 
-
+//! Hash functor so that UaNodeId can be used as a key of unordered containers
+struct UaNodeIdHash
+{
+    std::size_t operator()(const UaNodeId& nodeId) const { return nodeId.hash(); }
+};
 
 #endif // __UANODEID_H__
@@ -0,0 +1,107 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * updatequeue.h
+ *
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPEN62541_COMPAT_INCLUDE_UPDATEQUEUE_H_
+#define OPEN62541_COMPAT_INCLUDE_UPDATEQUEUE_H_
+
+#include <opcua_basedatavariabletype.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+//! Optional pipeline between device threads and variables: producers push() updates into a bounded lock-free ring
+//! and never block nor touch the variables; a single consumer applies them in batches, with drain() or from its own
+//! thread at a fixed period (start()). When the ring is full, or the value can't be copied, the update is dropped and
+//! counted.
+//! Updates are applied the way BaseDataVariableType::setValues() applies them (server-side, deadbands apply),
+//! each with the source timestamp taken at its push().
+//! The variables must outlive the updates queued for them.
+class UpdateQueue
+{
+public:
+    //! capacity gets rounded up to a power of 2
+    explicit UpdateQueue( size_t capacity );
+    //! Stops the consumer thread; updates still queued are discarded
+    ~UpdateQueue();
+
+    //! Thread-safe, wait-free unless other producers keep winning the slot. Copies the value. False if dropped.
+    bool push( OpcUa::BaseDataVariableType* variable, const UaVariant& value, OpcUa_StatusCode status = OpcUa_Good );
+
+    //! Consumer only: applies up to maxUpdates queued updates, returns how many were taken from the ring
+    size_t drain( size_t maxUpdates = SIZE_MAX );
+
+    //! Starts a consumer thread which drains the ring every period. The queue must not be drained by anybody else then.
+    void start( boost::posix_time::time_duration period );
+    //! Stops the consumer thread, then drains what is left (from the calling thread)
+    void stop();
+
+    size_t capacity() const { return m_mask + 1; }
+    std::uint64_t pushed() const { return m_pushed.load( std::memory_order_relaxed ); }
+    std::uint64_t dropped() const { return m_dropped.load( std::memory_order_relaxed ); }
+    //! Updates set, not counting those the deadband dropped
+    std::uint64_t applied() const { return m_applied.load( std::memory_order_relaxed ); }
+    //! Updates dropped by the variables' deadbands when applied: the growth of the variable's suppressedUpdates()
+    //! across each setValue(), so exact as long as nothing else updates the same variables meanwhile
+    std::uint64_t suppressed() const { return m_suppressed.load( std::memory_order_relaxed ); }
+
+private:
+    UpdateQueue( const UpdateQueue& other );
+    void operator=( const UpdateQueue& other );
+
+    //! Producers and the consumer each get their own cache lines, so that they don't invalidate each other's
+    static const size_t CacheLineSize = 64;
+
+    //! One slot of the ring: its sequence says whose turn it is (Vyukov's bounded queue).
+    //! Cache line sized, so producers filling neighbouring slots don't share a line.
+    struct alignas(CacheLineSize) Cell
+    {
+        std::atomic<size_t> sequence;
+        OpcUa::BaseDataVariableType* variable; // 0 if the value couldn't be copied: skipped, counted as dropped
+        UA_DataValue value;
+    };
+
+    void consume( boost::posix_time::time_duration period );
+
+    const size_t m_mask;
+    void* m_cellStorage; // m_cells, aligned to a cache line within it
+    Cell* m_cells;
+
+    char m_padding0[CacheLineSize];
+    std::atomic<size_t> m_enqueuePosition;
+    std::atomic<std::uint64_t> m_pushed;
+    std::atomic<std::uint64_t> m_dropped;
+    char m_padding1[CacheLineSize];
+    size_t m_dequeuePosition; // only the consumer touches it
+    std::atomic<std::uint64_t> m_applied;
+    std::atomic<std::uint64_t> m_suppressed;
+    char m_padding2[CacheLineSize];
+
+    boost::scoped_ptr<boost::thread> m_consumer;
+    boost::mutex m_consumerLock;
+    boost::condition_variable m_consumerWakeup;
+    bool m_stopping; // guarded by m_consumerLock
+};
+
+#endif /* OPEN62541_COMPAT_INCLUDE_UPDATEQUEUE_H_ */
@@ -0,0 +1,58 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * valueclock.h
+ *
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPEN62541_COMPAT_INCLUDE_VALUECLOCK_H_
+#define OPEN62541_COMPAT_INCLUDE_VALUECLOCK_H_
+
+#include <uadatetime.h>
+
+//! Where the source and server timestamps of values come from. UaDateTime::now() stays precise; ValueClock::now() is
+//! meant for stamping values at high rates and uses the source chosen with setSource():
+//!  - Precise: the same as UaDateTime::now()
+//!  - Coarse: CLOCK_REALTIME_COARSE on Linux (no syscall, resolution of the kernel tick, typically 1-4 ms);
+//!    GetSystemTimeAsFileTime() on Windows, which is coarse already; Precise elsewhere
+//!  - Batched: inside a Batch, the time the batch was opened; Coarse outside of any
+//! The source is process-wide and may be changed at any time.
+class ValueClock
+{
+public:
+    enum Source { Precise, Coarse, Batched };
+
+    static void setSource( Source source );
+    static Source source();
+
+    static UaDateTime now();
+
+    //! Opens a batch of updates on the calling thread: with the Batched source, all of them get the same timestamp,
+    //! taken once here. Batches may be nested, the outermost one gives the time. Doesn't do anything with other sources.
+    class Batch
+    {
+    public:
+        Batch();
+        ~Batch();
+    private:
+        Batch( const Batch& other );
+        void operator=( const Batch& other );
+    };
+
+private:
+    static UA_DateTime coarseNow();
+};
+
+#endif /* OPEN62541_COMPAT_INCLUDE_VALUECLOCK_H_ */
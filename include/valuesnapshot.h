@@ -0,0 +1,130 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * valuesnapshot.h
+ *
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPEN62541_COMPAT_INCLUDE_VALUESNAPSHOT_H_
+#define OPEN62541_COMPAT_INCLUDE_VALUESNAPSHOT_H_
+
+#include <open62541.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
+//! Immutable, refcounted UA_DataValue. Every UaDataValue holding the same value shares one snapshot,
+//! so assigning or cloning a value of any size costs a reference count increment instead of a deep copy.
+//! Never modified after adopt(); freed by the release() which drops the last reference.
+class ValueSnapshot
+{
+public:
+    //! Moves the contents of value into a new snapshot holding one reference; value is left empty
+    static ValueSnapshot* adopt( UA_DataValue& value );
+
+    void acquire() { m_references.fetch_add( 1, std::memory_order_relaxed ); }
+    void release();
+
+    const UA_DataValue& value() const { return m_value; }
+    unsigned int references() const { return m_references.load( std::memory_order_relaxed ); }
+    //! Approximate memory held: the snapshot, the variant's data and the contents of strings in it
+    std::size_t size() const { return m_size; }
+
+private:
+    ValueSnapshot();
+    ~ValueSnapshot();
+    ValueSnapshot( const ValueSnapshot& other );
+    void operator=( const ValueSnapshot& other );
+
+    std::atomic<unsigned int> m_references;
+    UA_DataValue m_value;
+    std::size_t m_size;
+};
+
+//! Epoch-based reclamation of the snapshots replaced by writers.
+//! A reader may load the current snapshot pointer of a UaDataValue and use it (copy from it, or acquire() it) only inside a
+//! ReadSection. A writer which swapped a snapshot out retire()s it instead of releasing it: the reference is dropped once
+//! every read section which might still see the old pointer has ended. Read sections don't block and don't write to
+//! shared cache lines. Neither does retire(): each thread keeps its own list of retired snapshots and only every
+//! RetireThreshold retire()s, or RetireBytes of retired snapshots (or more, when readers hold them back), it scans the
+//! threads which ever entered a read section, without locking, and releases what no reader can see anymore. So a writer
+//! which goes idle holds back less than RetireThreshold snapshots of less than RetireBytes until it retires again,
+//! calls reclaim() or exits; what it holds back when it exits is released by the next reclaim() of any thread.
+class EpochReclaimer
+{
+public:
+    //! Read-side critical section of the calling thread; may be nested
+    class ReadSection
+    {
+    public:
+        ReadSection();
+        ~ReadSection();
+    private:
+        ReadSection( const ReadSection& other );
+        void operator=( const ReadSection& other );
+
+        bool m_untracked; // in a destructor of a thread_local running after the thread's record was given back
+    };
+
+    //! How many snapshots a thread retires before it looks for ones to release
+    static const std::size_t RetireThreshold = 64;
+    //! The same in bytes (see ValueSnapshot::size()): large values aren't held back by the dozen
+    static const std::size_t RetireBytes = 256 * 1024;
+
+    static EpochReclaimer& instance();
+
+    //! Releases the snapshot's reference once no read section may still be using it (possibly much later)
+    void retire( ValueSnapshot* snapshot );
+    //! Releases whatever snapshots retired by the calling thread, or by threads which have exited, are no longer
+    //! visible to readers. Those of other threads are left to them.
+    void reclaim();
+
+    //! Retired snapshots not released yet, of all threads
+    std::size_t numRetired() const;
+
+    struct ThreadRecord;
+
+private:
+    EpochReclaimer();
+    EpochReclaimer( const EpochReclaimer& other );
+    void operator=( const EpochReclaimer& other );
+
+    typedef std::vector< std::pair<std::uint64_t, ValueSnapshot*> > Retired; // with the epoch at which each was retired
+
+    ThreadRecord* registerThread();
+    void unregisterThread( ThreadRecord* record );
+    //! Oldest epoch a reader is in right now; UINT64_MAX when none is. Doesn't lock.
+    std::uint64_t oldestActiveEpoch() const;
+    //! Releases the snapshots of the calling thread no reader can see anymore
+    void collect( ThreadRecord* record );
+    //! Moves the snapshots no reader can see anymore from retired to reclaimable
+    static void collect( Retired& retired, std::uint64_t oldestActiveEpoch, std::vector<ValueSnapshot*>& reclaimable );
+    //! The same for the snapshots left by exited threads. Needs m_lock.
+    void collectOrphans();
+
+    std::atomic<std::uint64_t> m_epoch;
+    std::atomic<ThreadRecord*> m_threads; // linked list, only ever prepended to; records of exited threads are reused
+    boost::mutex m_lock; // serializes (un)registrations of threads and guards m_orphans
+    Retired m_orphans; // left by threads which exited
+    std::atomic<std::size_t> m_numOrphans;
+    std::atomic<std::size_t> m_untrackedReaders; // read sections of threads whose record is gone already, see ReadSection
+
+    friend struct ThreadRecordHolder;
+};
+
+#endif /* OPEN62541_COMPAT_INCLUDE_VALUESNAPSHOT_H_ */
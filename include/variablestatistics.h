@@ -0,0 +1,94 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * variablestatistics.h
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPEN62541_COMPAT_INCLUDE_VARIABLESTATISTICS_H_
+#define OPEN62541_COMPAT_INCLUDE_VARIABLESTATISTICS_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <boost/thread/mutex.hpp>
+
+//! Counts and latency histograms of one variable's reads and writes by clients and of its updates from the server side
+//! (setValue() without a session). Opt-in, see BaseDataVariableType::enableStatistics(). Thread-safe.
+class VariableStatistics
+{
+public:
+    enum Operation
+    {
+        Read,
+        Write,
+        Update,
+        NumOperations
+    };
+
+    //! Bucket 0 counts operations which took less than 1 us, bucket i those of [2^(i-1), 2^i) us, the last one anything longer
+    enum { NumLatencyBuckets = 16 };
+
+    //! Times one operation from construction to destruction. Does nothing (not even read the clock) with null statistics.
+    class Scope
+    {
+    public:
+        Scope( VariableStatistics* statistics, Operation operation ):
+            m_statistics(statistics),
+            m_operation(operation)
+        {
+            if (m_statistics)
+                m_start = std::chrono::steady_clock::now();
+        }
+        ~Scope()
+        {
+            if (m_statistics)
+                m_statistics->record( m_operation, std::chrono::nanoseconds( std::chrono::steady_clock::now() - m_start ).count() );
+        }
+    private:
+        Scope( const Scope& other );
+        void operator=( const Scope& other );
+
+        VariableStatistics* m_statistics;
+        Operation m_operation;
+        std::chrono::steady_clock::time_point m_start;
+    };
+
+    VariableStatistics();
+
+    void record( Operation operation, std::uint64_t nanoseconds );
+
+    std::uint64_t count( Operation operation ) const;
+    //! Copies NumLatencyBuckets counters of the operation to histogram
+    void latencyHistogram( Operation operation, std::uint64_t* histogram ) const;
+    static unsigned int latencyBucket( std::uint64_t nanoseconds );
+
+    //! Server-side updates per second, averaged over the time since the rate was last computed. It's recomputed at most
+    //! once per second, so that many readers polling it don't shorten the interval.
+    double updateRate();
+
+private:
+    VariableStatistics( const VariableStatistics& other );
+    void operator=( const VariableStatistics& other );
+
+    std::atomic<std::uint64_t> m_counts[NumOperations];
+    std::atomic<std::uint64_t> m_latencies[NumOperations][NumLatencyBuckets];
+
+    boost::mutex m_rateLock; // guards the rest
+    std::chrono::steady_clock::time_point m_rateSampleTime;
+    std::uint64_t m_rateSampleUpdates;
+    double m_rate;
+};
+
+#endif /* OPEN62541_COMPAT_INCLUDE_VARIABLESTATISTICS_H_ */
@@ -0,0 +1,423 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * addressspaceimage.cpp
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <addressspaceimage.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <boost/filesystem/operations.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/lexical_cast.hpp>
+
+namespace
+{
+
+const char         Magic[8] = { 'O','6','C','O','M','P','A','T' };
+const OpcUa_UInt32 EndiannessMarker = 0x01020304;
+
+struct Header
+{
+    char         magic[8];
+    OpcUa_UInt32 version;
+    OpcUa_UInt32 endianness;
+    OpcUa_UInt64 configHash;
+    OpcUa_UInt64 checksum; // of everything after the header
+    OpcUa_UInt64 numNodes;
+    OpcUa_UInt64 numArguments;
+    OpcUa_UInt64 numArrayDimensions;
+    OpcUa_UInt64 stringsSize;
+};
+
+struct StringRecord
+{
+    OpcUa_UInt32 offset;
+    OpcUa_UInt32 length;
+};
+
+struct NodeIdRecord
+{
+    OpcUa_UInt16 namespaceIndex;
+    OpcUa_Byte   identifierType; // UA_NodeIdType: numeric or string
+    OpcUa_Byte   reserved;
+    OpcUa_UInt32 numeric;
+    StringRecord string;
+};
+
+struct NodeRecord
+{
+    NodeIdRecord nodeId;
+    NodeIdRecord parentId;
+    NodeIdRecord referenceTypeId;
+    NodeIdRecord typeDefinitionId;
+    StringRecord browseName;
+    OpcUa_UInt16 browseNameNamespaceIndex;
+    OpcUa_Byte   nodeClass;
+    OpcUa_Byte   accessLevel;
+    OpcUa_Int32  valueRank;
+    OpcUa_UInt32 firstArgument;
+    OpcUa_UInt16 numInputArguments;
+    OpcUa_UInt16 numOutputArguments;
+};
+
+struct ArgumentRecord
+{
+    StringRecord name;
+    NodeIdRecord dataType;
+    OpcUa_Int32  valueRank;
+    OpcUa_UInt32 firstArrayDimension;
+    OpcUa_UInt32 numArrayDimensions;
+    StringRecord descriptionLocale;
+    StringRecord descriptionText;
+};
+
+static_assert( sizeof(Header) == 64, "image header layout changed, bump FormatVersion" );
+static_assert( sizeof(NodeRecord) == 88, "image node layout changed, bump FormatVersion" );
+static_assert( sizeof(ArgumentRecord) == 52, "image argument layout changed, bump FormatVersion" );
+
+OpcUa_UInt64 fnv1a( const char* data, size_t size, OpcUa_UInt64 hash = 14695981039346656037ULL )
+{
+    for (size_t i=0; i<size; ++i)
+    {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+}
+
+struct AddressSpaceImageWriter::Impl
+{
+    OpcUa_UInt64 configHash;
+    std::vector<NodeRecord> nodes;
+    std::vector<ArgumentRecord> arguments;
+    std::vector<OpcUa_UInt32> arrayDimensions;
+    std::string strings;
+
+    StringRecord addString( const UA_String& s )
+    {
+        StringRecord record;
+        record.offset = strings.size();
+        record.length = s.length;
+        strings.append( reinterpret_cast<const char*>(s.data), s.length );
+        return record;
+    }
+
+    NodeIdRecord addNodeId( const UA_NodeId& id )
+    {
+        NodeIdRecord record;
+        std::memset( &record, 0, sizeof record );
+        record.namespaceIndex = id.namespaceIndex;
+        record.identifierType = id.identifierType;
+        switch (id.identifierType)
+        {
+        case UA_NODEIDTYPE_NUMERIC: record.numeric = id.identifier.numeric; break;
+        case UA_NODEIDTYPE_STRING:  record.string = addString( id.identifier.string ); break;
+        default: throw std::invalid_argument("AddressSpaceImageWriter: only numeric and string NodeIds are supported");
+        }
+        return record;
+    }
+
+    void addArguments( const std::vector<UA_Argument>& from )
+    {
+        for (std::vector<UA_Argument>::const_iterator it = from.begin(); it != from.end(); ++it)
+        {
+            ArgumentRecord record;
+            record.name = addString( it->name );
+            record.dataType = addNodeId( it->dataType );
+            record.valueRank = it->valueRank;
+            record.firstArrayDimension = arrayDimensions.size();
+            record.numArrayDimensions = it->arrayDimensionsSize;
+            arrayDimensions.insert( arrayDimensions.end(), it->arrayDimensions, it->arrayDimensions + it->arrayDimensionsSize );
+            record.descriptionLocale = addString( it->description.locale );
+            record.descriptionText = addString( it->description.text );
+            arguments.push_back( record );
+        }
+    }
+};
+
+const OpcUa_UInt32 AddressSpaceImageWriter::FormatVersion;
+
+AddressSpaceImageWriter::AddressSpaceImageWriter( OpcUa_UInt64 configHash ):
+    m_impl( new Impl )
+{
+    m_impl->configHash = configHash;
+}
+
+AddressSpaceImageWriter::~AddressSpaceImageWriter()
+{
+}
+
+void AddressSpaceImageWriter::add( const AddressSpaceImageNode& node )
+{
+    if (node.inputArguments.size() > 0xFFFF || node.outputArguments.size() > 0xFFFF)
+        throw std::invalid_argument("AddressSpaceImageWriter: too many method arguments");
+    NodeRecord record;
+    std::memset( &record, 0, sizeof record );
+    record.nodeId = m_impl->addNodeId( node.nodeId );
+    record.parentId = m_impl->addNodeId( node.parentId );
+    record.referenceTypeId = m_impl->addNodeId( node.referenceTypeId );
+    record.typeDefinitionId = m_impl->addNodeId( node.typeDefinitionId );
+    record.browseName = m_impl->addString( node.browseName.name );
+    record.browseNameNamespaceIndex = node.browseName.namespaceIndex;
+    record.nodeClass = node.nodeClass;
+    record.accessLevel = node.accessLevel;
+    record.valueRank = node.valueRank;
+    record.firstArgument = m_impl->arguments.size();
+    record.numInputArguments = node.inputArguments.size();
+    record.numOutputArguments = node.outputArguments.size();
+    m_impl->addArguments( node.inputArguments );
+    m_impl->addArguments( node.outputArguments );
+    m_impl->nodes.push_back( record );
+}
+
+size_t AddressSpaceImageWriter::numNodes() const
+{
+    return m_impl->nodes.size();
+}
+
+void AddressSpaceImageWriter::write( const std::string& path ) const
+{
+    if (m_impl->strings.size() > 0xFFFFFFFFu)
+        throw std::runtime_error("AddressSpaceImageWriter: string pool exceeds 4GB");
+    if (m_impl->arrayDimensions.size() > 0xFFFFFFFFu)
+        throw std::runtime_error("AddressSpaceImageWriter: too many argument array dimensions");
+    const char* nodes = reinterpret_cast<const char*>( m_impl->nodes.data() );
+    const size_t nodesSize = m_impl->nodes.size() * sizeof (NodeRecord);
+    const char* arguments = reinterpret_cast<const char*>( m_impl->arguments.data() );
+    const size_t argumentsSize = m_impl->arguments.size() * sizeof (ArgumentRecord);
+    const char* arrayDimensions = reinterpret_cast<const char*>( m_impl->arrayDimensions.data() );
+    const size_t arrayDimensionsSize = m_impl->arrayDimensions.size() * sizeof (OpcUa_UInt32);
+
+    Header header;
+    std::memset( &header, 0, sizeof header );
+    std::memcpy( header.magic, Magic, sizeof Magic );
+    header.version = FormatVersion;
+    header.endianness = EndiannessMarker;
+    header.configHash = m_impl->configHash;
+    header.numNodes = m_impl->nodes.size();
+    header.numArguments = m_impl->arguments.size();
+    header.numArrayDimensions = m_impl->arrayDimensions.size();
+    header.stringsSize = m_impl->strings.size();
+    header.checksum = fnv1a( m_impl->strings.data(), m_impl->strings.size(),
+                             fnv1a( arrayDimensions, arrayDimensionsSize, fnv1a( arguments, argumentsSize, fnv1a( nodes, nodesSize ) ) ) );
+
+    const std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file( temporaryPath.c_str(), std::ios::binary | std::ios::trunc );
+        file.write( reinterpret_cast<const char*>(&header), sizeof header );
+        file.write( nodes, nodesSize );
+        file.write( arguments, argumentsSize );
+        file.write( arrayDimensions, arrayDimensionsSize );
+        file.write( m_impl->strings.data(), m_impl->strings.size() );
+        file.close();
+        if (file.fail())
+        {
+            std::remove( temporaryPath.c_str() );
+            throw std::runtime_error("AddressSpaceImageWriter: couldn't write "+temporaryPath);
+        }
+    }
+    // replaces the old image in one step (also on Windows, unlike std::rename): readers see either image, never none
+    boost::system::error_code error;
+    boost::filesystem::rename( temporaryPath, path, error );
+    if (error)
+    {
+        std::remove( temporaryPath.c_str() );
+        throw std::runtime_error("AddressSpaceImageWriter: couldn't rename "+temporaryPath+" to "+path+": "+error.message());
+    }
+}
+
+struct AddressSpaceImageReader::Impl
+{
+    boost::interprocess::file_mapping  file;
+    boost::interprocess::mapped_region region;
+    const Header*         header;
+    const NodeRecord*     nodes;
+    const ArgumentRecord* arguments;
+    const OpcUa_UInt32*   arrayDimensions;
+    const char*           strings;
+
+    void fail( const std::string& what ) const { throw std::runtime_error("Invalid address space image: "+what); }
+
+    void validate( const StringRecord& s ) const
+    {
+        if (s.offset > header->stringsSize || s.length > header->stringsSize - s.offset)
+            fail("string out of bounds");
+    }
+
+    void validate( const NodeIdRecord& id ) const
+    {
+        if (id.identifierType == UA_NODEIDTYPE_STRING)
+            validate( id.string );
+        else if (id.identifierType != UA_NODEIDTYPE_NUMERIC)
+            fail("unsupported NodeId type "+boost::lexical_cast<std::string>(int(id.identifierType)));
+    }
+
+    UA_String string( const StringRecord& s ) const
+    {
+        UA_String result;
+        result.length = s.length;
+        result.data = reinterpret_cast<UA_Byte*>( const_cast<char*>(strings + s.offset) );
+        return result;
+    }
+
+    UA_NodeId nodeId( const NodeIdRecord& record ) const
+    {
+        UA_NodeId result;
+        result.namespaceIndex = record.namespaceIndex;
+        result.identifierType = static_cast<UA_NodeIdType>(record.identifierType);
+        if (record.identifierType == UA_NODEIDTYPE_STRING)
+            result.identifier.string = string( record.string );
+        else
+            result.identifier.numeric = record.numeric;
+        return result;
+    }
+
+    void fillArguments( OpcUa_UInt32 first, OpcUa_UInt16 count, std::vector<UA_Argument>& out ) const
+    {
+        out.resize( count );
+        for (OpcUa_UInt16 i=0; i<count; ++i)
+        {
+            const ArgumentRecord& record = arguments[first + i];
+            UA_Argument_init( &out[i] );
+            out[i].name = string( record.name );
+            out[i].dataType = nodeId( record.dataType );
+            out[i].valueRank = record.valueRank;
+            out[i].arrayDimensionsSize = record.numArrayDimensions;
+            out[i].arrayDimensions = record.numArrayDimensions ? const_cast<OpcUa_UInt32*>(arrayDimensions + record.firstArrayDimension) : 0;
+            out[i].description.locale = string( record.descriptionLocale );
+            out[i].description.text = string( record.descriptionText );
+        }
+    }
+};
+
+AddressSpaceImageReader::AddressSpaceImageReader( const std::string& path, OpcUa_UInt64 expectedConfigHash ):
+    m_impl( new Impl )
+{
+    Impl& d = *m_impl;
+    try
+    {
+        d.file = boost::interprocess::file_mapping( path.c_str(), boost::interprocess::read_only );
+        d.region = boost::interprocess::mapped_region( d.file, boost::interprocess::read_only );
+    }
+    catch (const boost::interprocess::interprocess_exception& e)
+    {
+        throw std::runtime_error("Couldn't map address space image "+path+": "+e.what());
+    }
+
+    const char* base = static_cast<const char*>( d.region.get_address() );
+    const size_t size = d.region.get_size();
+    if (size < sizeof (Header))
+        d.fail("file too small");
+    d.header = reinterpret_cast<const Header*>( base );
+    if (std::memcmp( d.header->magic, Magic, sizeof Magic ) != 0)
+        d.fail("not an address space image");
+    if (d.header->endianness != EndiannessMarker)
+        d.fail("built on a machine of different endianness");
+    if (d.header->version != AddressSpaceImageWriter::FormatVersion)
+        d.fail("format version "+boost::lexical_cast<std::string>(d.header->version)+", expected "+boost::lexical_cast<std::string>(AddressSpaceImageWriter::FormatVersion));
+    if (d.header->configHash != expectedConfigHash)
+        d.fail("built for another configuration");
+
+    const OpcUa_UInt64 payload = size - sizeof (Header);
+    if (d.header->numNodes > payload / sizeof (NodeRecord) ||
+        d.header->numArguments > payload / sizeof (ArgumentRecord) ||
+        d.header->numArrayDimensions > payload / sizeof (OpcUa_UInt32) ||
+        d.header->stringsSize > payload ||
+        d.header->numNodes * sizeof (NodeRecord) + d.header->numArguments * sizeof (ArgumentRecord) +
+        d.header->numArrayDimensions * sizeof (OpcUa_UInt32) + d.header->stringsSize != payload)
+        d.fail("size doesn't match the header");
+
+    d.nodes = reinterpret_cast<const NodeRecord*>( base + sizeof (Header) );
+    d.arguments = reinterpret_cast<const ArgumentRecord*>( d.nodes + d.header->numNodes );
+    d.arrayDimensions = reinterpret_cast<const OpcUa_UInt32*>( d.arguments + d.header->numArguments );
+    d.strings = reinterpret_cast<const char*>( d.arrayDimensions + d.header->numArrayDimensions );
+
+    if (fnv1a( base + sizeof (Header), payload ) != d.header->checksum)
+        d.fail("checksum mismatch");
+
+    for (OpcUa_UInt64 i=0; i<d.header->numNodes; ++i)
+    {
+        const NodeRecord& n = d.nodes[i];
+        d.validate( n.nodeId );
+        d.validate( n.parentId );
+        d.validate( n.referenceTypeId );
+        d.validate( n.typeDefinitionId );
+        d.validate( n.browseName );
+        if (n.nodeClass != OpcUa_NodeClass_Object && n.nodeClass != OpcUa_NodeClass_Variable && n.nodeClass != OpcUa_NodeClass_Method)
+            d.fail("unknown node class");
+        if (n.firstArgument > d.header->numArguments ||
+            OpcUa_UInt64(n.numInputArguments) + n.numOutputArguments > d.header->numArguments - n.firstArgument)
+            d.fail("method arguments out of bounds");
+    }
+    for (OpcUa_UInt64 i=0; i<d.header->numArguments; ++i)
+    {
+        const ArgumentRecord& a = d.arguments[i];
+        d.validate( a.name );
+        d.validate( a.dataType );
+        d.validate( a.descriptionLocale );
+        d.validate( a.descriptionText );
+        if (a.firstArrayDimension > d.header->numArrayDimensions ||
+            a.numArrayDimensions > d.header->numArrayDimensions - a.firstArrayDimension)
+            d.fail("argument array dimensions out of bounds");
+    }
+}
+
+AddressSpaceImageReader::~AddressSpaceImageReader()
+{
+}
+
+size_t AddressSpaceImageReader::numNodes() const
+{
+    return m_impl->header->numNodes;
+}
+
+void AddressSpaceImageReader::node( size_t i, AddressSpaceImageNode& out ) const
+{
+    const Impl& d = *m_impl;
+    const NodeRecord& record = d.nodes[i];
+    out.nodeClass = static_cast<OpcUa_NodeClass>(record.nodeClass);
+    out.nodeId = d.nodeId( record.nodeId );
+    out.parentId = d.nodeId( record.parentId );
+    out.referenceTypeId = d.nodeId( record.referenceTypeId );
+    out.typeDefinitionId = d.nodeId( record.typeDefinitionId );
+    out.browseName.namespaceIndex = record.browseNameNamespaceIndex;
+    out.browseName.name = d.string( record.browseName );
+    out.valueRank = record.valueRank;
+    out.accessLevel = record.accessLevel;
+    d.fillArguments( record.firstArgument, record.numInputArguments, out.inputArguments );
+    d.fillArguments( record.firstArgument + record.numInputArguments, record.numOutputArguments, out.outputArguments );
+}
+
+OpcUa_UInt64 hashFileContents( const std::string& path )
+{
+    std::ifstream file( path.c_str(), std::ios::binary );
+    if (!file)
+        throw std::runtime_error("hashFileContents: can't open "+path);
+    OpcUa_UInt64 hash = fnv1a( 0, 0 );
+    char buffer[65536];
+    while (file)
+    {
+        file.read( buffer, sizeof buffer );
+        hash = fnv1a( buffer, file.gcount(), hash );
+    }
+    return hash;
+}
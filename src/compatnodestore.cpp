@@ -0,0 +1,296 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * compatnodestore.cpp
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <compatnodestore.h>
+#include <boost/thread/locks.hpp>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// first NodeId handed out to nodes which the server inserts without one, clear of the ids in hand-made address spaces
+static const UA_UInt32 firstGeneratedId = 50000;
+
+namespace
+{
+
+//! In front of every node: one reference held by whoever created the node (the index once it's inserted),
+//! and one per getNode() not released yet
+struct NodeHeader
+{
+    std::atomic<unsigned int> references;
+};
+
+// keeps the node behind it aligned as UA_calloc() would
+const std::size_t HeaderSize = (sizeof (NodeHeader) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+
+NodeHeader& headerOf( const UA_Node* node )
+{
+    return *reinterpret_cast<NodeHeader*>( reinterpret_cast<char*>( const_cast<UA_Node*>(node) ) - HeaderSize );
+}
+
+}
+
+static std::size_t nodeSize( UA_NodeClass nodeClass )
+{
+    switch (nodeClass)
+    {
+    case UA_NODECLASS_OBJECT:        return sizeof (UA_ObjectNode);
+    case UA_NODECLASS_VARIABLE:      return sizeof (UA_VariableNode);
+    case UA_NODECLASS_METHOD:        return sizeof (UA_MethodNode);
+    case UA_NODECLASS_OBJECTTYPE:    return sizeof (UA_ObjectTypeNode);
+    case UA_NODECLASS_VARIABLETYPE:  return sizeof (UA_VariableTypeNode);
+    case UA_NODECLASS_REFERENCETYPE: return sizeof (UA_ReferenceTypeNode);
+    case UA_NODECLASS_DATATYPE:      return sizeof (UA_DataTypeNode);
+    case UA_NODECLASS_VIEW:          return sizeof (UA_ViewNode);
+    default:                         return 0;
+    }
+}
+
+CompatNodestore* CompatNodestore::install( UA_ServerConfig* config )
+{
+    if (config->nodestore.deleteNodestore)
+        config->nodestore.deleteNodestore( config->nodestore.context );
+
+    CompatNodestore* nodestore = new CompatNodestore();
+    UA_Nodestore& plugin = config->nodestore;
+    plugin.context = nodestore;
+    plugin.deleteNodestore = &CompatNodestore::deleteNodestore;
+    plugin.inPlaceEditAllowed = true;
+    plugin.newNode = &CompatNodestore::newNode;
+    plugin.deleteNode = &CompatNodestore::deleteNode;
+    plugin.getNode = &CompatNodestore::getNode;
+    plugin.releaseNode = &CompatNodestore::releaseNode;
+    plugin.getNodeCopy = &CompatNodestore::getNodeCopy;
+    plugin.insertNode = &CompatNodestore::insertNode;
+    plugin.replaceNode = &CompatNodestore::replaceNode;
+    plugin.removeNode = &CompatNodestore::removeNode;
+    plugin.iterate = &CompatNodestore::iterate;
+    return nodestore;
+}
+
+CompatNodestore::CompatNodestore():
+    m_nextGeneratedId(firstGeneratedId)
+{
+}
+
+CompatNodestore::~CompatNodestore()
+{
+    for (Index::iterator it = m_index.begin(); it != m_index.end(); ++it)
+        release( it->second.node );
+}
+
+bool CompatNodestore::attach( const UA_NodeId& nodeId, UaNode* compatNode, void* nodeContext )
+{
+    boost::unique_lock<boost::shared_mutex> lock (m_lock);
+    Index::iterator it = m_index.find( &nodeId );
+    if (it == m_index.end())
+        return false;
+    it->second.compatNode = compatNode;
+    if (nodeContext)
+        it->second.node->context = nodeContext;
+    return true;
+}
+
+UaNode* CompatNodestore::compatNode( const UA_NodeId& nodeId ) const
+{
+    boost::shared_lock<boost::shared_mutex> lock (m_lock);
+    Index::const_iterator it = m_index.find( &nodeId );
+    return it != m_index.end() ? it->second.compatNode : 0;
+}
+
+void CompatNodestore::reserve( std::size_t numNodes )
+{
+    boost::unique_lock<boost::shared_mutex> lock (m_lock);
+    m_index.reserve( numNodes );
+}
+
+std::size_t CompatNodestore::numNodes() const
+{
+    boost::shared_lock<boost::shared_mutex> lock (m_lock);
+    return m_index.size();
+}
+
+void CompatNodestore::freeNode( UA_Node* node )
+{
+    UA_Node_deleteMembers( node );
+    NodeHeader& header = headerOf( node );
+    header.~NodeHeader();
+    UA_free( &header );
+}
+
+void CompatNodestore::acquire( const UA_Node* node )
+{
+    headerOf( node ).references.fetch_add( 1, std::memory_order_relaxed );
+}
+
+void CompatNodestore::release( const UA_Node* node )
+{
+    if (headerOf( node ).references.fetch_sub( 1, std::memory_order_acq_rel ) == 1)
+        freeNode( const_cast<UA_Node*>(node) );
+}
+
+void CompatNodestore::deleteNodestore( void* context )
+{
+    delete static_cast<CompatNodestore*>(context);
+}
+
+UA_Node* CompatNodestore::newNode( void* context, UA_NodeClass nodeClass )
+{
+    const std::size_t size = nodeSize( nodeClass );
+    if (!size)
+        return 0;
+    char* memory = static_cast<char*>( UA_calloc(1, HeaderSize + size) );
+    if (!memory)
+        return 0;
+    new (memory) NodeHeader();
+    reinterpret_cast<NodeHeader*>(memory)->references.store( 1, std::memory_order_relaxed );
+    UA_Node* node = reinterpret_cast<UA_Node*>( memory + HeaderSize );
+    node->nodeClass = nodeClass;
+    return node;
+}
+
+void CompatNodestore::deleteNode( void* context, UA_Node* node )
+{
+    freeNode( node ); // never inserted, so nobody else has it
+}
+
+const UA_Node* CompatNodestore::getNode( void* context, const UA_NodeId* nodeId )
+{
+    const CompatNodestore* self = static_cast<const CompatNodestore*>(context);
+    boost::shared_lock<boost::shared_mutex> lock (self->m_lock);
+    Index::const_iterator it = self->m_index.find( nodeId );
+    if (it == self->m_index.end())
+        return 0;
+    acquire( it->second.node ); // while the index still holds its reference, see removeNode()
+    return it->second.node;
+}
+
+void CompatNodestore::releaseNode( void* context, const UA_Node* node )
+{
+    if (node)
+        release( node );
+}
+
+UA_StatusCode CompatNodestore::getNodeCopy( void* context, const UA_NodeId* nodeId, UA_Node** outNode )
+{
+    const UA_Node* node = getNode( context, nodeId );
+    if (!node)
+        return UA_STATUSCODE_BADNODEIDUNKNOWN;
+    // allocated here, so that it can be inserted (or deleted) like any new node
+    UA_Node* copy = newNode( context, node->nodeClass );
+    UA_StatusCode status = copy ? UA_Node_copy( node, copy ) : UA_STATUSCODE_BADOUTOFMEMORY;
+    release( node );
+    if (status != UA_STATUSCODE_GOOD)
+    {
+        if (copy)
+            freeNode( copy );
+        return status;
+    }
+    *outNode = copy;
+    return UA_STATUSCODE_GOOD;
+}
+
+UA_StatusCode CompatNodestore::insertNode( void* context, UA_Node* node, UA_NodeId* addedNodeId )
+{
+    CompatNodestore* self = static_cast<CompatNodestore*>(context);
+    {
+        boost::unique_lock<boost::shared_mutex> lock (self->m_lock);
+        UA_NodeId& nodeId = node->nodeId;
+        if (nodeId.identifierType == UA_NODEIDTYPE_NUMERIC && nodeId.identifier.numeric == 0)
+        {
+            do
+                nodeId.identifier.numeric = self->m_nextGeneratedId++;
+            while (self->m_index.find( &nodeId ) != self->m_index.end());
+        }
+        Entry entry = { node, 0 }; // the index takes over the reference of the node's creator
+        if (!self->m_index.insert( std::make_pair( &node->nodeId, entry ) ).second)
+        {
+            lock.unlock();
+            freeNode( node ); // the nodestore owns the node it's given, also on failure
+            return UA_STATUSCODE_BADNODEIDEXISTS;
+        }
+        // still under the lock: once it's released, the node may be removed by someone else
+        if (addedNodeId)
+            return UA_NodeId_copy( &node->nodeId, addedNodeId );
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+UA_StatusCode CompatNodestore::replaceNode( void* context, UA_Node* node )
+{
+    CompatNodestore* self = static_cast<CompatNodestore*>(context);
+    UA_Node* replaced = 0;
+    {
+        boost::unique_lock<boost::shared_mutex> lock (self->m_lock);
+        Index::iterator it = self->m_index.find( &node->nodeId );
+        if (it != self->m_index.end())
+        {
+            // the key points into the node being replaced, so the entry is re-keyed rather than updated
+            Entry entry = it->second;
+            replaced = entry.node;
+            entry.node = node;
+            self->m_index.erase( it );
+            self->m_index.insert( std::make_pair( &node->nodeId, entry ) );
+        }
+    }
+    if (!replaced)
+    {
+        freeNode( node );
+        return UA_STATUSCODE_BADNODEIDUNKNOWN;
+    }
+    release( replaced ); // freed now, or by the last releaseNode() of it
+    return UA_STATUSCODE_GOOD;
+}
+
+UA_StatusCode CompatNodestore::removeNode( void* context, const UA_NodeId* nodeId )
+{
+    CompatNodestore* self = static_cast<CompatNodestore*>(context);
+    UA_Node* removed = 0;
+    {
+        boost::unique_lock<boost::shared_mutex> lock (self->m_lock);
+        Index::iterator it = self->m_index.find( nodeId );
+        if (it == self->m_index.end())
+            return UA_STATUSCODE_BADNODEIDUNKNOWN;
+        removed = it->second.node;
+        self->m_index.erase( it );
+    }
+    release( removed ); // freed now, or by the last releaseNode() of it
+    return UA_STATUSCODE_GOOD;
+}
+
+void CompatNodestore::iterate( void* context, void* visitorContext, UA_NodestoreVisitor visitor )
+{
+    const CompatNodestore* self = static_cast<const CompatNodestore*>(context);
+    // visitors may look nodes up again, so they're not called with the lock held (but with the nodes acquired)
+    std::vector<const UA_Node*> nodes;
+    {
+        boost::shared_lock<boost::shared_mutex> lock (self->m_lock);
+        nodes.reserve( self->m_index.size() );
+        for (Index::const_iterator it = self->m_index.begin(); it != self->m_index.end(); ++it)
+        {
+            acquire( it->second.node );
+            nodes.push_back( it->second.node );
+        }
+    }
+    for (std::vector<const UA_Node*>::const_iterator it = nodes.begin(); it != nodes.end(); ++it)
+    {
+        visitor( visitorContext, *it );
+        release( *it );
+    }
+}
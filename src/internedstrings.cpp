@@ -0,0 +1,219 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * internedstrings.cpp
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <internedstrings.h>
+#include <open62541_compat_common.h>
+#include <LogIt.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <boost/unordered_set.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+namespace
+{
+
+//! Precedes the characters of each stored string, in the same allocation
+struct Header
+{
+    std::atomic<std::size_t> references;
+};
+
+Header* headerOf( const UA_String& stored )
+{
+    return reinterpret_cast<Header*>( stored.data ) - 1;
+}
+
+struct UaStringHash
+{
+    std::size_t operator()( const UA_String& s ) const { return boost::hash_range( s.data, s.data + s.length ); }
+};
+
+struct UaStringEqual
+{
+    bool operator()( const UA_String& a, const UA_String& b ) const
+    {
+        return a.length == b.length && (a.length == 0 || std::memcmp(a.data, b.data, a.length) == 0);
+    }
+};
+
+class Table
+{
+public:
+    //! Unreferenced strings are freed when there are that many of them, or a quarter of the table if that's more
+    static const std::size_t MinUnreferencedToReclaim = 1024;
+
+    Table():
+        m_requests(0),
+        m_bytesRequested(0),
+        m_bytesStored(0),
+        m_size(0),
+        m_unreferenced(0)
+    {}
+
+    const UA_String& intern( const UA_String& s )
+    {
+        {
+            boost::shared_lock<boost::shared_mutex> lock (m_lock);
+            Set::const_iterator it = m_strings.find( s );
+            if (it != m_strings.end())
+            {
+                // may revive an unreferenced string: reclaim() only frees under the exclusive lock, and rechecks
+                headerOf( *it )->references.fetch_add( 1, std::memory_order_relaxed );
+                count( s );
+                return *it;
+            }
+        }
+        boost::unique_lock<boost::shared_mutex> lock (m_lock);
+        Set::const_iterator it = m_strings.find( s ); // someone might have been faster
+        if (it == m_strings.end())
+        {
+            Header* header = static_cast<Header*>( ::operator new( sizeof (Header) + s.length ) );
+            new (header) Header;
+            header->references.store( 0, std::memory_order_relaxed );
+            UA_String stored;
+            stored.length = s.length;
+            stored.data = reinterpret_cast<UA_Byte*>( header + 1 );
+            if (s.length)
+                std::memcpy( stored.data, s.data, s.length );
+            it = m_strings.insert( stored ).first;
+            m_bytesStored += s.length;
+            m_size.store( m_strings.size(), std::memory_order_relaxed );
+        }
+        headerOf( *it )->references.fetch_add( 1, std::memory_order_relaxed );
+        count( s );
+        return *it;
+    }
+
+    void release( const UA_String& interned )
+    {
+        if (headerOf( interned )->references.fetch_sub( 1, std::memory_order_acq_rel ) != 1)
+            return;
+        const std::size_t unreferenced = m_unreferenced.fetch_add( 1, std::memory_order_relaxed ) + 1;
+        if (unreferenced >= std::max( MinUnreferencedToReclaim, m_size.load( std::memory_order_relaxed ) / 4 ))
+            reclaim();
+    }
+
+    std::size_t reclaim()
+    {
+        boost::unique_lock<boost::shared_mutex> lock (m_lock);
+        m_unreferenced.store( 0, std::memory_order_relaxed );
+        std::size_t freed = 0;
+        for (Set::iterator it = m_strings.begin(); it != m_strings.end(); )
+        {
+            // nobody can take a reference meanwhile: intern() needs the lock, acquire() an existing reference
+            Header* header = headerOf( *it );
+            if (header->references.load( std::memory_order_acquire ) == 0)
+            {
+                m_bytesStored -= it->length;
+                it = m_strings.erase( it );
+                header->~Header();
+                ::operator delete( header );
+                ++freed;
+            }
+            else
+                ++it;
+        }
+        m_size.store( m_strings.size(), std::memory_order_relaxed );
+        return freed;
+    }
+
+    InternedStrings::Statistics statistics()
+    {
+        boost::shared_lock<boost::shared_mutex> lock (m_lock);
+        InternedStrings::Statistics result;
+        result.distinctStrings = m_strings.size();
+        result.bytesStored = m_bytesStored;
+        result.requests = m_requests;
+        result.bytesRequested = m_bytesRequested;
+        return result;
+    }
+
+private:
+    void count( const UA_String& s )
+    {
+        m_requests.fetch_add( 1, std::memory_order_relaxed );
+        m_bytesRequested.fetch_add( s.length, std::memory_order_relaxed );
+    }
+
+    typedef boost::unordered_set<UA_String, UaStringHash, UaStringEqual> Set;
+
+    Set m_strings; // each one's data follows its Header
+    boost::shared_mutex m_lock;
+    std::atomic<std::size_t> m_requests;
+    std::atomic<std::size_t> m_bytesRequested;
+    std::size_t m_bytesStored; // guarded by m_lock
+    std::atomic<std::size_t> m_size; // of m_strings, for release() which doesn't lock
+    std::atomic<std::size_t> m_unreferenced; // strings whose last reference went since the last reclaim(), roughly
+};
+
+const std::size_t Table::MinUnreferencedToReclaim;
+
+Table& table()
+{
+    // function-local so that it's usable from static initialization of other translation units; never destroyed
+    static Table* instance = new Table;
+    return *instance;
+}
+
+}
+
+const UA_String& InternedStrings::intern( const UA_String& s )
+{
+    return table().intern( s );
+}
+
+const UA_String& InternedStrings::intern( const char* s )
+{
+    UA_String view;
+    view.length = std::strlen( s );
+    view.data = reinterpret_cast<UA_Byte*>( const_cast<char*>(s) );
+    return table().intern( view );
+}
+
+void InternedStrings::acquire( const UA_String& interned )
+{
+    headerOf( interned )->references.fetch_add( 1, std::memory_order_relaxed );
+}
+
+void InternedStrings::release( const UA_String& interned )
+{
+    table().release( interned );
+}
+
+std::size_t InternedStrings::reclaim()
+{
+    return table().reclaim();
+}
+
+InternedStrings::Statistics InternedStrings::statistics()
+{
+    return table().statistics();
+}
+
+void InternedStrings::logStatistics()
+{
+    const Statistics s = statistics();
+    LOG(Log::INF) << "Interned strings: " << s.distinctStrings << " distinct strings (" << s.bytesStored << " bytes) for "
+        << s.requests << " requests (" << s.bytesRequested << " bytes); saved " << s.bytesSaved() << " bytes of string data and "
+        << (s.requests - s.distinctStrings) << " allocations";
+}
@@ -0,0 +1,707 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * methodexecutor.cpp
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <methodexecutor.h>
+#include <LogIt.h>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/thread_time.hpp>
+
+//! For methods run on the server thread: finishCall() is expected before beginCall() returns
+class SynchronousMethodCallback: public MethodManagerCallback
+{
+public:
+    virtual ~SynchronousMethodCallback () {}
+
+    virtual UaStatus 	finishCall (
+        OpcUa_UInt32 callbackHandle,
+        UaStatusCodeArray &inputArgumentResults,
+        UaDiagnosticInfos &inputArgumentDiag,
+        UaVariantArray &outputArguments,
+        UaStatus &statusCode)
+    {
+        // input argument results and diagnostics aren't passed on: open62541 0.3's method callback has no room for them
+        this->m_resultStatus = statusCode;
+        m_outputs = outputArguments;
+        return OpcUa_Good;
+    }
+
+    UaStatus getStatusCode () const {
+        return m_resultStatus;
+    }
+    UaVariantArray& outputs() {
+        return m_outputs;
+    }
+
+private:
+    UaStatus m_resultStatus;
+    UaVariantArray m_outputs;
+
+};
+
+//! The calls in flight per method handle, on the server thread or on the pool, for waitForCalls().
+//! Leaked on purpose, like the pool: a call might finish at exit.
+class MethodExecutor::CallsInFlight
+{
+public:
+    static CallsInFlight& instance()
+    {
+        static CallsInFlight& callsInFlight = *new CallsInFlight;
+        return callsInFlight;
+    }
+
+    void begin( const MethodHandle* methodHandle )
+    {
+        boost::lock_guard<boost::mutex> lock (m_lock);
+        ++m_calls[methodHandle];
+    }
+
+    void end( const MethodHandle* methodHandle )
+    {
+        {
+            boost::lock_guard<boost::mutex> lock (m_lock);
+            std::unordered_map<const MethodHandle*, unsigned int>::iterator it = m_calls.find( methodHandle );
+            if (--it->second)
+                return;
+            m_calls.erase( it );
+        }
+        m_endedCondition.notify_all();
+    }
+
+    //! False if calls are still in flight after timeout
+    bool waitFor( const MethodHandle* methodHandle, boost::posix_time::time_duration timeout )
+    {
+        const boost::system_time deadline = boost::get_system_time() + timeout;
+        boost::unique_lock<boost::mutex> lock (m_lock);
+        while (m_calls.count( methodHandle ))
+            if (!m_endedCondition.timed_wait( lock, deadline ) && m_calls.count( methodHandle ))
+                return false;
+        return true;
+    }
+
+    //! For a call on the server thread
+    class Scope
+    {
+    public:
+        explicit Scope( const MethodHandle* methodHandle ): m_methodHandle(methodHandle) { instance().begin( methodHandle ); }
+        ~Scope() { instance().end( m_methodHandle ); }
+    private:
+        const MethodHandle* const m_methodHandle;
+    };
+
+private:
+    boost::mutex m_lock; // guards the rest
+    boost::condition_variable m_endedCondition;
+    std::unordered_map<const MethodHandle*, unsigned int> m_calls; // only the handles with calls in flight
+};
+
+//! The calls on their way to the workers: per object (receiver) the calls in flight, i.e. begun and not finished yet,
+//! and those waiting for their turn; across objects the calls ready for a worker. Shared by the pool and the calls,
+//! since a call may finish after its pool is gone.
+class MethodExecutor::CallQueues
+{
+public:
+    CallQueues( unsigned int maxInFlightPerObject, size_t maxQueuedPerObject ):
+        m_maxInFlightPerObject(maxInFlightPerObject),
+        m_maxQueuedPerObject(maxQueuedPerObject),
+        m_stopping(false)
+    {}
+
+    //! Server thread: BadResourceUnavailable if the receiver has as many calls in flight and waiting as it may,
+    //! BadShutdown if the pool is stopping
+    UaStatus submit( Completion* completion );
+    //! Workers: the next call to begin; 0 once stopped and nothing is ready
+    Completion* next();
+    //! A call of receiver finished: lets the receiver's next call through
+    void finished( MethodManager* receiver );
+    //! Server thread, for a call it gave up waiting for: if it's still waiting for its object's turn, it's answered
+    //! BadTimeout and leaves its place to the next one
+    void withdraw( Completion* completion );
+    //! Calls ready for a worker still get begun; those waiting for their object's turn are answered BadShutdown
+    void stop();
+
+private:
+    struct ObjectQueue
+    {
+        ObjectQueue(): inFlight(0) {}
+        unsigned int inFlight;
+        std::deque<Completion*> waiting;
+    };
+
+    const unsigned int m_maxInFlightPerObject;
+    const size_t m_maxQueuedPerObject;
+
+    boost::mutex m_lock; // guards the rest
+    boost::condition_variable m_readyCondition;
+    std::deque<Completion*> m_ready;
+    std::unordered_map<MethodManager*, ObjectQueue> m_objects; // only the objects with calls in flight
+    bool m_stopping;
+};
+
+//! One call run on the worker pool: begun by a worker, finished by finishCall() from any thread, waited for by the
+//! server thread. Each of them holds a reference; whoever lets go last deletes it, so a finishCall() coming after the
+//! server thread gave up waiting is harmless. The call is in flight (see CallsInFlight) until the worker and
+//! finishCall() both let go: only they touch the receiver and the method handle.
+//! With a typed binding, the worker runs the binding instead of the receiver's beginCall(), and finishes right away;
+//! its arguments are open62541 variants, moved in and out rather than copied.
+class MethodExecutor::Completion: public MethodManagerCallback
+{
+public:
+    Completion(
+        MethodManager* receiver,
+        MethodHandle* methodHandle,
+        UaVariantArray& inputs,
+        const std::shared_ptr<CallQueues>& queues ):
+        m_receiver(receiver),
+        m_methodHandle(methodHandle),
+        m_queues(queues),
+        m_references(3), // the server thread, the worker, finishCall()
+        m_inFlightReferences(2), // the worker, finishCall()
+        m_finished(false),
+        m_abandoned(false)
+    {
+        std::swap( m_inputs, inputs );
+        CallsInFlight::instance().begin( m_methodHandle );
+    }
+
+    //! A call of a typed binding: typedInputs are taken over
+    Completion(
+        MethodManager* receiver,
+        MethodHandle* methodHandle,
+        const std::shared_ptr<const TypedMethodBinding>& typedBinding,
+        std::vector<UA_Variant>& typedInputs,
+        size_t numTypedOutputs,
+        const std::shared_ptr<CallQueues>& queues ):
+        m_receiver(receiver),
+        m_methodHandle(methodHandle),
+        m_typedBinding(typedBinding),
+        m_queues(queues),
+        m_references(3),
+        m_inFlightReferences(2),
+        m_finished(false),
+        m_abandoned(false),
+        m_typedOutputs(numTypedOutputs)
+    {
+        std::swap( m_typedInputs, typedInputs );
+        for (size_t i = 0; i < m_typedOutputs.size(); ++i)
+            UA_Variant_init( &m_typedOutputs[i] );
+        CallsInFlight::instance().begin( m_methodHandle );
+    }
+
+    ~Completion()
+    {
+        deleteMembers( m_typedInputs );
+        deleteMembers( m_typedOutputs );
+    }
+
+    MethodManager* receiver() const { return m_receiver; }
+
+    //! On a worker; lets go of the worker's reference
+    void begin()
+    {
+        bool abandoned;
+        {
+            boost::lock_guard<boost::mutex> lock (m_lock);
+            abandoned = m_abandoned;
+        }
+        if (abandoned)
+            finish( UA_STATUSCODE_BADTIMEOUT, 0 ); // the client got its answer already, while it was queued
+        else if (m_typedBinding)
+            callTypedBinding();
+        else
+        {
+            ServiceContext serviceContext;
+            UaStatus status = m_receiver->beginCall( this, serviceContext, 0 /* fake callback handle */, m_methodHandle, m_inputs );
+            if (status.isNotGood())
+                finish( status, 0 ); // no finishCall() will come
+        }
+        releaseInFlight();
+    }
+
+    virtual UaStatus finishCall(
+        OpcUa_UInt32 callbackHandle,
+        UaStatusCodeArray &inputArgumentResults,
+        UaDiagnosticInfos &inputArgumentDiag,
+        UaVariantArray &outputArguments,
+        UaStatus &statusCode)
+    {
+        return finish( statusCode, &outputArguments );
+    }
+
+    //! On the server thread: false if the call didn't finish within timeout; if it wasn't begun by then, it won't be.
+    //! The outputs of a typed call are moved into typedOutput.
+    bool wait( boost::posix_time::time_duration timeout, UaStatus& status, UaVariantArray& outputs, UA_Variant* typedOutput )
+    {
+        const boost::system_time deadline = boost::get_system_time() + timeout;
+        boost::unique_lock<boost::mutex> lock (m_lock);
+        while (!m_finished)
+            if (!m_finishedCondition.timed_wait( lock, deadline ))
+                break;
+        if (!m_finished)
+        {
+            m_abandoned = true;
+            lock.unlock();
+            m_queues->withdraw( this );
+            return false;
+        }
+        status = m_resultStatus;
+        std::swap( outputs, m_outputs );
+        if (typedOutput)
+            for (size_t i = 0; i < m_typedOutputs.size(); ++i)
+            {
+                typedOutput[i] = m_typedOutputs[i];
+                UA_Variant_init( &m_typedOutputs[i] );
+            }
+        return true;
+    }
+
+    //! When the call couldn't be submitted: nobody else has a reference yet
+    void discard()
+    {
+        CallsInFlight::instance().end( m_methodHandle );
+        delete this;
+    }
+
+    //! The server thread's reference
+    void release()
+    {
+        if (m_references.fetch_sub( 1, std::memory_order_acq_rel ) == 1)
+            delete this;
+    }
+
+    //! The worker's or finishCall()'s reference
+    void releaseInFlight()
+    {
+        if (m_inFlightReferences.fetch_sub( 1, std::memory_order_acq_rel ) == 1)
+            CallsInFlight::instance().end( m_methodHandle );
+        release();
+    }
+
+    //! The first finish counts; it lets the receiver's next call through and lets go of finishCall()'s reference.
+    //! typedOutputs, the outputs of a typed call, are taken over (swapped) by the first finish.
+    UaStatus finish( const UaStatus& status, const UaVariantArray* outputs, std::vector<UA_Variant>* typedOutputs = 0 )
+    {
+        if (!complete( status, outputs, typedOutputs ))
+            return OpcUa_BadInvalidState;
+        m_queues->finished( m_receiver );
+        releaseInFlight();
+        return OpcUa_Good;
+    }
+
+    //! For a call taken off its object's queue before its turn: no worker nor finishCall() will come, and it had no
+    //! place among the calls in flight to give up
+    void refuse( const UaStatus& status )
+    {
+        complete( status, 0 );
+        releaseInFlight(); // the worker's reference
+        releaseInFlight(); // finishCall()'s
+    }
+
+private:
+    //! False if finished already
+    bool complete( const UaStatus& status, const UaVariantArray* outputs, std::vector<UA_Variant>* typedOutputs = 0 )
+    {
+        {
+            boost::lock_guard<boost::mutex> lock (m_lock);
+            if (m_finished)
+                return false;
+            m_finished = true;
+            m_resultStatus = status;
+            if (outputs)
+                m_outputs = *outputs;
+            if (typedOutputs)
+                std::swap( m_typedOutputs, *typedOutputs );
+        }
+        m_finishedCondition.notify_all();
+        return true;
+    }
+
+    static void deleteMembers( std::vector<UA_Variant>& variants )
+    {
+        for (size_t i = 0; i < variants.size(); ++i)
+            UA_Variant_deleteMembers( &variants[i] );
+    }
+
+    void callTypedBinding()
+    {
+        // the outputs are the binding's own until finished, so no lock: wait() only takes them once finished
+        std::vector<UA_Variant> outputs( m_typedOutputs.size() );
+        for (size_t i = 0; i < outputs.size(); ++i)
+            UA_Variant_init( &outputs[i] );
+        const UA_StatusCode status = m_typedBinding->call(
+                m_typedInputs.size(), m_typedInputs.empty() ? 0 : &m_typedInputs[0],
+                outputs.size(), outputs.empty() ? 0 : &outputs[0] );
+        finish( status, 0, &outputs );
+        deleteMembers( outputs ); // what the swap left: empty variants
+    }
+
+    MethodManager* m_receiver;
+    MethodHandle* m_methodHandle;
+    const std::shared_ptr<const TypedMethodBinding> m_typedBinding; // null unless a typed call
+    UaVariantArray m_inputs;
+    std::vector<UA_Variant> m_typedInputs;
+    const std::shared_ptr<CallQueues> m_queues;
+    std::atomic<int> m_references;
+    std::atomic<int> m_inFlightReferences;
+
+    boost::mutex m_lock; // guards the rest
+    boost::condition_variable m_finishedCondition;
+    bool m_finished;
+    bool m_abandoned; // the server thread gave up waiting
+    UaStatus m_resultStatus;
+    UaVariantArray m_outputs;
+    std::vector<UA_Variant> m_typedOutputs;
+};
+
+UaStatus MethodExecutor::CallQueues::submit( Completion* completion )
+{
+    {
+        boost::lock_guard<boost::mutex> lock (m_lock);
+        if (m_stopping)
+            return OpcUa_BadShutdown;
+        ObjectQueue& object = m_objects[completion->receiver()];
+        if (object.inFlight < m_maxInFlightPerObject)
+        {
+            ++object.inFlight;
+            m_ready.push_back( completion );
+        }
+        else if (object.waiting.size() < m_maxQueuedPerObject)
+        {
+            object.waiting.push_back( completion );
+            return OpcUa_Good;
+        }
+        else
+            return OpcUa_BadResourceUnavailable;
+    }
+    m_readyCondition.notify_one();
+    return OpcUa_Good;
+}
+
+MethodExecutor::Completion* MethodExecutor::CallQueues::next()
+{
+    boost::unique_lock<boost::mutex> lock (m_lock);
+    while (m_ready.empty() && !m_stopping)
+        m_readyCondition.wait( lock );
+    if (m_ready.empty())
+        return 0;
+    Completion* completion = m_ready.front();
+    m_ready.pop_front();
+    return completion;
+}
+
+void MethodExecutor::CallQueues::finished( MethodManager* receiver )
+{
+    {
+        boost::lock_guard<boost::mutex> lock (m_lock);
+        std::unordered_map<MethodManager*, ObjectQueue>::iterator it = m_objects.find( receiver );
+        if (it == m_objects.end())
+            return;
+        ObjectQueue& object = it->second;
+        --object.inFlight;
+        if (object.waiting.empty())
+        {
+            if (!object.inFlight)
+                m_objects.erase( it );
+            return;
+        }
+        // nothing waits once stopping: stop() refused them all
+        ++object.inFlight;
+        m_ready.push_back( object.waiting.front() );
+        object.waiting.pop_front();
+    }
+    m_readyCondition.notify_one();
+}
+
+void MethodExecutor::CallQueues::withdraw( Completion* completion )
+{
+    {
+        boost::lock_guard<boost::mutex> lock (m_lock);
+        std::unordered_map<MethodManager*, ObjectQueue>::iterator it = m_objects.find( completion->receiver() );
+        if (it == m_objects.end())
+            return;
+        std::deque<Completion*>& waiting = it->second.waiting;
+        std::deque<Completion*>::iterator position = std::find( waiting.begin(), waiting.end(), completion );
+        if (position == waiting.end())
+            return; // ready or begun: the worker answers it
+        waiting.erase( position ); // the object has calls in flight, so its entry stays
+    }
+    completion->refuse( UA_STATUSCODE_BADTIMEOUT );
+}
+
+void MethodExecutor::CallQueues::stop()
+{
+    std::vector<Completion*> refused; // no worker might be left to begin them
+    {
+        boost::lock_guard<boost::mutex> lock (m_lock);
+        m_stopping = true;
+        for (std::unordered_map<MethodManager*, ObjectQueue>::iterator it = m_objects.begin(); it != m_objects.end(); ++it)
+        {
+            refused.insert( refused.end(), it->second.waiting.begin(), it->second.waiting.end() );
+            it->second.waiting.clear();
+        }
+    }
+    m_readyCondition.notify_all();
+    for (size_t i = 0; i < refused.size(); ++i)
+        refused[i]->refuse( OpcUa_BadShutdown );
+}
+
+class MethodExecutor::WorkerPool
+{
+public:
+    WorkerPool(
+        unsigned int numThreads,
+        boost::posix_time::time_duration timeout,
+        unsigned int maxInFlightPerObject,
+        size_t maxQueuedPerObject ):
+        m_timeout(timeout),
+        m_queues(std::make_shared<CallQueues>( maxInFlightPerObject, maxQueuedPerObject )),
+        m_numRunning(numThreads)
+    {
+        for (unsigned int i = 0; i < numThreads; ++i)
+            m_threads.create_thread( boost::bind( &WorkerPool::work, this ) );
+    }
+
+    //! Waits for the calls ready for a worker to be begun
+    ~WorkerPool()
+    {
+        m_queues->stop();
+        m_threads.join_all();
+    }
+
+    //! The same, up to timeout; false if a worker is still in a method then (the pool mustn't be destroyed while it is)
+    bool shutDown( boost::posix_time::time_duration timeout )
+    {
+        m_queues->stop();
+        const boost::system_time deadline = boost::get_system_time() + timeout;
+        {
+            boost::unique_lock<boost::mutex> lock (m_runningLock);
+            while (m_numRunning)
+                if (!m_stoppedCondition.timed_wait( lock, deadline ) && m_numRunning)
+                    return false;
+        }
+        m_threads.join_all(); // they're past their last use of the pool
+        return true;
+    }
+
+    unsigned int numThreads() const { return m_threads.size(); }
+    boost::posix_time::time_duration timeout() const { return m_timeout; }
+    const std::shared_ptr<CallQueues>& queues() const { return m_queues; }
+
+private:
+    void work()
+    {
+        while (Completion* completion = m_queues->next())
+            completion->begin();
+        boost::lock_guard<boost::mutex> lock (m_runningLock);
+        --m_numRunning;
+        m_stoppedCondition.notify_all();
+    }
+
+    const boost::posix_time::time_duration m_timeout;
+    const std::shared_ptr<CallQueues> m_queues;
+    boost::thread_group m_threads;
+    boost::mutex m_runningLock; // guards m_numRunning
+    boost::condition_variable m_stoppedCondition;
+    unsigned int m_numRunning; // workers which haven't left work() yet
+};
+
+std::shared_ptr<MethodExecutor::WorkerPool>& MethodExecutor::workerPool()
+{
+    static std::shared_ptr<WorkerPool>& pool = *new std::shared_ptr<WorkerPool>;
+    return pool;
+}
+
+boost::mutex& MethodExecutor::workerPoolLock()
+{
+    static boost::mutex& lock = *new boost::mutex;
+    return lock;
+}
+
+namespace
+{
+std::atomic<std::uint64_t> rejectedCallCount (0);
+boost::posix_time::time_duration drainTimeoutValue = boost::posix_time::seconds(10); // guarded by workerPoolLock()
+}
+
+std::uint64_t MethodExecutor::rejectedCalls()
+{
+    return rejectedCallCount.load( std::memory_order_relaxed );
+}
+
+UaStatus MethodExecutor::startWorkerPool(
+    unsigned int numThreads,
+    boost::posix_time::time_duration timeout,
+    unsigned int maxInFlightPerObject,
+    size_t maxQueuedPerObject )
+{
+    numThreads = std::max( numThreads, 1u );
+    maxInFlightPerObject = std::max( maxInFlightPerObject, 1u );
+    std::shared_ptr<WorkerPool> pool ( std::make_shared<WorkerPool>( numThreads, timeout, maxInFlightPerObject, maxQueuedPerObject ) );
+    {
+        boost::lock_guard<boost::mutex> lock (workerPoolLock());
+        std::swap( pool, workerPool() );
+    }
+    LOG(Log::INF) << "Methods run on " << numThreads << " worker threads, calls time out after " << timeout.total_milliseconds() << " ms"
+                  << "; per object at most " << maxInFlightPerObject << " calls in flight and " << maxQueuedPerObject << " waiting";
+    return pool ? shutDown( pool ) : UaStatus( OpcUa_Good ); // the previous pool
+}
+
+UaStatus MethodExecutor::stopWorkerPool()
+{
+    std::shared_ptr<WorkerPool> pool;
+    {
+        boost::lock_guard<boost::mutex> lock (workerPoolLock());
+        std::swap( pool, workerPool() );
+    }
+    return pool ? shutDown( pool ) : UaStatus( OpcUa_Good );
+}
+
+UaStatus MethodExecutor::shutDown( const std::shared_ptr<WorkerPool>& pool )
+{
+    // a call which got hold of the pool just before is answered BadShutdown; the calls ready for a worker get begun
+    if (pool->shutDown( drainTimeout() ))
+        return OpcUa_Good;
+    new std::shared_ptr<WorkerPool>( pool ); // leaked: its workers are still in methods and use it
+    LOG(Log::ERR) << "Method worker pool shut down with methods still running after " << drainTimeout().total_milliseconds()
+                  << " ms; its threads are left to them";
+    return UA_STATUSCODE_BADTIMEOUT;
+}
+
+bool MethodExecutor::waitForCalls( const MethodHandle* methodHandle )
+{
+    return waitForCalls( methodHandle, drainTimeout() );
+}
+
+bool MethodExecutor::waitForCalls( const MethodHandle* methodHandle, boost::posix_time::time_duration timeout )
+{
+    return CallsInFlight::instance().waitFor( methodHandle, timeout );
+}
+
+void MethodExecutor::setDrainTimeout( boost::posix_time::time_duration timeout )
+{
+    boost::lock_guard<boost::mutex> lock (workerPoolLock());
+    drainTimeoutValue = timeout;
+}
+
+boost::posix_time::time_duration MethodExecutor::drainTimeout()
+{
+    boost::lock_guard<boost::mutex> lock (workerPoolLock());
+    return drainTimeoutValue;
+}
+
+unsigned int MethodExecutor::numWorkers()
+{
+    boost::lock_guard<boost::mutex> lock (workerPoolLock());
+    return workerPool() ? workerPool()->numThreads() : 0;
+}
+
+std::shared_ptr<MethodExecutor::WorkerPool> MethodExecutor::currentWorkerPool()
+{
+    boost::lock_guard<boost::mutex> lock (workerPoolLock());
+    return workerPool();
+}
+
+UaStatus MethodExecutor::callOnPool( const WorkerPool& pool, Completion* completion, UaVariantArray& outputs, UA_Variant* typedOutput )
+{
+    UaStatus status = pool.queues()->submit( completion );
+    if (status.isNotGood())
+    {
+        completion->discard();
+        if (status.statusCode() == OpcUa_BadResourceUnavailable)
+            rejectedCallCount.fetch_add( 1, std::memory_order_relaxed );
+        return status; // right away, rather than after a wait in a long queue
+    }
+    const bool finished = completion->wait( pool.timeout(), status, outputs, typedOutput );
+    completion->release();
+    if (!finished)
+    {
+        LOG(Log::WRN) << "Method call not finished within " << pool.timeout().total_milliseconds() << " ms, answered BadTimeout";
+        return UA_STATUSCODE_BADTIMEOUT;
+    }
+    return status;
+}
+
+UaStatus MethodExecutor::call(
+    MethodManager* receiver,
+    MethodHandle* methodHandle,
+    UaVariantArray& inputs,
+    UaVariantArray& outputs )
+{
+    const std::shared_ptr<WorkerPool> pool = currentWorkerPool();
+    if (!pool)
+    {
+        CallsInFlight::Scope inFlight( methodHandle );
+        ServiceContext serviceContext;
+        SynchronousMethodCallback synchronousCallback;
+        UaStatus status = receiver->beginCall(
+                &synchronousCallback,
+                serviceContext /* fake service context */,
+                0 /* fake callback handle */,
+                methodHandle,
+                inputs );
+        if (status.isNotGood())
+            return status; // beginning failed ...
+        std::swap( outputs, synchronousCallback.outputs() );
+        return synchronousCallback.getStatusCode();
+    }
+    return callOnPool( *pool, new Completion( receiver, methodHandle, inputs, pool->queues() ), outputs );
+}
+
+UaStatus MethodExecutor::call(
+    MethodManager* receiver,
+    MethodHandle* methodHandle,
+    const std::shared_ptr<const TypedMethodBinding>& binding,
+    size_t inputSize,
+    const UA_Variant* input,
+    size_t outputSize,
+    UA_Variant* output )
+{
+    const std::shared_ptr<WorkerPool> pool = currentWorkerPool();
+    if (!pool)
+    {
+        CallsInFlight::Scope inFlight( methodHandle );
+        return binding->call( inputSize, input, outputSize, output );
+    }
+    // the server's variants are gone once it has its answer, and a call which timed out may still run
+    std::vector<UA_Variant> inputs( inputSize );
+    for (size_t i = 0; i < inputSize; ++i)
+        UA_Variant_init( &inputs[i] );
+    for (size_t i = 0; i < inputSize; ++i)
+        if (UA_Variant_copy( input + i, &inputs[i] ) != UA_STATUSCODE_GOOD)
+        {
+            for (size_t j = 0; j < i; ++j)
+                UA_Variant_deleteMembers( &inputs[j] );
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        }
+    UaVariantArray outputs; // unused: a typed call's outputs go straight into output
+    return callOnPool(
+            *pool,
+            new Completion( receiver, methodHandle, binding, inputs, outputSize, pool->queues() ),
+            outputs,
+            output );
+}
@@ -0,0 +1,150 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * nodearena.cpp
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <nodearena.h>
+#include <algorithm>
+#include <stdexcept>
+
+const std::size_t NodeArena::DefaultBlockSize;
+
+NodeArena::NodeArena( std::size_t blockSize ):
+    m_blockSize(blockSize),
+    m_cursor(0),
+    m_end(0),
+    m_bytesReserved(0),
+    m_numObjectsToDestroy(0)
+{
+    if (blockSize == 0)
+        throw std::invalid_argument("NodeArena: block size can't be zero");
+}
+
+NodeArena::~NodeArena()
+{
+    clear();
+}
+
+void NodeArena::clear()
+{
+    for (std::vector<Destructor>::reverse_iterator it = m_destructors.rbegin(); it != m_destructors.rend(); ++it)
+    {
+        if (it->second)
+            it->second( it->first );
+    }
+    m_destructors.clear();
+    m_numObjectsToDestroy = 0;
+    m_sizeClasses.clear();
+    for (std::vector<Block>::iterator it = m_blocks.begin(); it != m_blocks.end(); ++it)
+        delete[] it->begin;
+    m_blocks.clear();
+    m_cursor = m_end = 0;
+    m_bytesReserved = 0;
+}
+
+bool NodeArena::owns( const void* p ) const
+{
+    const char* address = static_cast<const char*>(p);
+    Block key;
+    key.begin = const_cast<char*>(address);
+    key.size = 0;
+    std::vector<Block>::const_iterator it = std::upper_bound( m_blocks.begin(), m_blocks.end(), key );
+    if (it == m_blocks.begin())
+        return false;
+    --it;
+    return address < it->begin + it->size;
+}
+
+void* NodeArena::allocate( std::size_t size, std::size_t alignment )
+{
+    std::size_t padding = m_cursor ? (alignment - reinterpret_cast<std::size_t>(m_cursor) % alignment) % alignment : 0;
+    if (!m_cursor || padding + size > static_cast<std::size_t>(m_end - m_cursor))
+    {
+        // objects bigger than a block get a block of their own; the current block keeps serving small ones
+        const bool dedicated = size + alignment > m_blockSize;
+        Block block;
+        block.size = dedicated ? size + alignment : m_blockSize;
+        block.begin = new char[ block.size ];
+        m_blocks.insert( std::upper_bound(m_blocks.begin(), m_blocks.end(), block), block );
+        m_bytesReserved += block.size;
+
+        padding = (alignment - reinterpret_cast<std::size_t>(block.begin) % alignment) % alignment;
+        if (dedicated)
+            return block.begin + padding;
+        m_cursor = block.begin;
+        m_end = block.begin + block.size;
+    }
+    void* result = m_cursor + padding;
+    m_cursor += padding + size;
+    return result;
+}
+
+void* NodeArena::obtain( std::size_t size, std::size_t alignment )
+{
+    std::vector<SizeClass>::iterator sizeClass = m_sizeClasses.begin();
+    while (sizeClass != m_sizeClasses.end() && (sizeClass->size != size || sizeClass->alignment != alignment))
+        ++sizeClass;
+    if (sizeClass == m_sizeClasses.end())
+    {
+        SizeClass newClass;
+        newClass.size = size;
+        newClass.alignment = alignment;
+        sizeClass = m_sizeClasses.insert( m_sizeClasses.end(), newClass );
+    }
+    else if (!sizeClass->recycled.empty())
+    {
+        void* object = sizeClass->recycled.back();
+        sizeClass->recycled.pop_back();
+        return object;
+    }
+
+    // the header goes right before the object, with the padding the object's alignment needs in front of it
+    const std::size_t blockAlignment = std::max( alignment, alignof(Header) );
+    const std::size_t headerSpace = (sizeof(Header) + blockAlignment - 1) / blockAlignment * blockAlignment;
+    void* object = static_cast<char*>( allocate( headerSpace + size, blockAlignment ) ) + headerSpace;
+    Header* header = headerOf( object );
+    header->destructor = Header::NoDestructor;
+    header->sizeClass = sizeClass - m_sizeClasses.begin();
+    return object;
+}
+
+void NodeArena::track( void* object, void(*destructor)(void*) )
+{
+    if (!destructor)
+        return;
+    Header* header = headerOf( object );
+    if (header->destructor == Header::NoDestructor)
+    {
+        header->destructor = m_destructors.size();
+        m_destructors.push_back( Destructor(object, destructor) );
+    }
+    else
+        m_destructors[header->destructor].second = destructor;
+    ++m_numObjectsToDestroy;
+}
+
+void NodeArena::recycle( void* object )
+{
+    Header* header = headerOf( object );
+    if (header->destructor != Header::NoDestructor && m_destructors[header->destructor].second)
+    {
+        Destructor& destructor = m_destructors[header->destructor];
+        destructor.second( object );
+        destructor.second = 0;
+        --m_numObjectsToDestroy;
+    }
+    m_sizeClasses[header->sizeClass].recycled.push_back( object );
+}
@@ -22,32 +22,205 @@
 
 #include <nodemanagerbase.h>
 #include <boost/foreach.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/unordered_set.hpp>
+#include <boost/functional/hash.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
 #include <iostream>
 #include <opcua_basedatavariabletype.h>
 #include <stdexcept>
+#include <utility>
 #include <uadatavariablecache.h>
+#include <internedstrings.h>
+#include <addressspaceimage.h>
+#include <open62541_compat_common.h>
+#include <valueclock.h>
+#include <methodexecutor.h>
+
+static StartupProfiler::NodeKind nodeKindOf( OpcUa_NodeClass nodeClass )
+{
+    switch (nodeClass)
+    {
+    case OpcUa_NodeClass_Object:   return StartupProfiler::Object;
+    case OpcUa_NodeClass_Variable: return StartupProfiler::Variable;
+    case OpcUa_NodeClass_Method:   return StartupProfiler::Method;
+    default:                       return StartupProfiler::Unknown;
+    }
+}
+
+//! Deduplicated method argument lists: objects of one class have methods of identical signatures, so each
+//! distinct list of arguments is deep-copied once and then shared by all methods having it. Thread-safe.
+class NodeManagerBase::ArgumentListCache
+{
+public:
+    typedef std::vector<UA_Argument> ArgumentList;
+
+    ~ArgumentListCache()
+    {
+        BOOST_FOREACH (ArgumentList& arguments, m_lists)
+        {
+            BOOST_FOREACH (UA_Argument& argument, arguments)
+                UA_Argument_deleteMembers( &argument );
+        }
+    }
+
+    //! The shared list equal to the given arguments. Valid as long as the cache.
+    const ArgumentList* intern( const UA_Argument* arguments, size_t numArguments )
+    {
+        if (numArguments == 0)
+            return &m_emptyList;
+        const Key key = { arguments, numArguments };
+        {
+            boost::shared_lock<boost::shared_mutex> lock (m_lock);
+            Index::const_iterator it = m_index.find( key, KeyHash(), KeyEqual() );
+            if (it != m_index.end())
+                return *it;
+        }
+        boost::unique_lock<boost::shared_mutex> lock (m_lock);
+        Index::const_iterator it = m_index.find( key, KeyHash(), KeyEqual() );
+        if (it != m_index.end())
+            return *it; // added by another thread in the meantime
+        m_lists.push_back( ArgumentList(numArguments) );
+        ArgumentList& list = m_lists.back();
+        for (size_t i=0; i<numArguments; ++i)
+        {
+            UA_Argument_init( &list[i] );
+            if (UA_Argument_copy( &arguments[i], &list[i] ) != UA_STATUSCODE_GOOD)
+                throw alloc_error();
+        }
+        m_index.insert( &list );
+        return &list;
+    }
+
+    size_t numLists() const
+    {
+        boost::shared_lock<boost::shared_mutex> lock (m_lock);
+        return m_lists.size();
+    }
+
+private:
+    struct Key
+    {
+        const UA_Argument* arguments;
+        size_t             numArguments;
+    };
+
+    static size_t hash( const UA_Argument* arguments, size_t numArguments )
+    {
+        size_t seed = numArguments;
+        for (size_t i=0; i<numArguments; ++i)
+        {
+            const UA_Argument& argument = arguments[i];
+            boost::hash_range( seed, argument.name.data, argument.name.data + argument.name.length );
+            boost::hash_combine( seed, UaNodeId::hash(argument.dataType) );
+            boost::hash_combine( seed, argument.valueRank );
+            boost::hash_range( seed, argument.arrayDimensions, argument.arrayDimensions + argument.arrayDimensionsSize );
+        }
+        return seed;
+    }
+
+    static bool equal( const UA_Argument& a, const UA_Argument& b )
+    {
+        return UA_String_equal( &a.name, &b.name ) &&
+               UA_NodeId_equal( &a.dataType, &b.dataType ) &&
+               a.valueRank == b.valueRank &&
+               a.arrayDimensionsSize == b.arrayDimensionsSize &&
+               std::equal( a.arrayDimensions, a.arrayDimensions + a.arrayDimensionsSize, b.arrayDimensions ) &&
+               UA_String_equal( &a.description.locale, &b.description.locale ) &&
+               UA_String_equal( &a.description.text, &b.description.text );
+    }
+
+    static bool equal( const UA_Argument* a, size_t numA, const UA_Argument* b, size_t numB )
+    {
+        if (numA != numB)
+            return false;
+        for (size_t i=0; i<numA; ++i)
+            if (!equal( a[i], b[i] ))
+                return false;
+        return true;
+    }
+
+    // lists are looked up by the caller's arguments (Key), without building an ArgumentList first
+    struct KeyHash
+    {
+        size_t operator()( const Key& key ) const { return hash( key.arguments, key.numArguments ); }
+        size_t operator()( const ArgumentList* list ) const { return hash( &(*list)[0], list->size() ); }
+    };
+    struct KeyEqual
+    {
+        bool operator()( const Key& key, const ArgumentList* list ) const { return equal( key.arguments, key.numArguments, &(*list)[0], list->size() ); }
+        bool operator()( const ArgumentList* a, const ArgumentList* b ) const { return equal( &(*a)[0], a->size(), &(*b)[0], b->size() ); }
+    };
+    typedef boost::unordered_set<const ArgumentList*, KeyHash, KeyEqual> Index;
+
+    std::deque<ArgumentList>  m_lists; // deque: lists don't move when it grows
+    Index                     m_index;
+    const ArgumentList        m_emptyList;
+    mutable boost::shared_mutex m_lock;
+};
 
 NodeManagerBase::NodeManagerBase( const char* uri, bool sth, int hashtablesize ):
     m_server(0),
-    m_nameSpaceUri(uri)
+    m_nodestore(0),
+    m_nameSpaceUri(uri),
+    m_nodeArena(0),
+    m_expectedNumNodes(hashtablesize > 0 ? hashtablesize : 0),
+    m_numUnclaimedImageNodes(0),
+    m_argumentLists(new ArgumentListCache)
 {
-
+    if (hashtablesize > 0)
+        m_nodeIndex.reserve( hashtablesize );
 }
 
 NodeManagerBase::~NodeManagerBase()
 {
-
-
-    std::cout << __FUNCTION__ << std::endl;
-    std::cout << "m_listNodes.size=" << m_listNodes.size() << std::endl;
+    LOG(Log::TRC) << __FUNCTION__ << " m_listNodes.size=" << m_listNodes.size();
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t numDeleted = 0;
     while (!m_listNodes.empty())
     {
-        auto node = m_listNodes.back();
+        UaNode* node = &m_listNodes.back();
         m_listNodes.pop_back();
 
-        delete node;
+        // nodes from the arena are destroyed in bulk with it, only the heap-allocated ones are deleted one by one
+        if (!m_nodeArena || !m_nodeArena->owns(node))
+        {
+            delete node;
+            ++numDeleted;
+        }
     }
+    const size_t numArenaDestroyed = m_nodeArena ? m_nodeArena->numObjectsToDestroy() : 0;
+    delete m_nodeArena;
+    m_nodeArena = 0;
+    LOG(Log::INF) << "Destroyed " << numDeleted << " heap-allocated and " << numArenaDestroyed << " arena-allocated nodes in "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - start ).count() << " ms";
+}
 
+void NodeManagerBase::useNodeArena( std::size_t blockSize )
+{
+    if (m_nodeArena)
+        throw std::logic_error("useNodeArena: node arena already in use");
+    if (!m_listNodes.empty())
+        throw std::logic_error("useNodeArena: must be called before any node is added");
+    m_nodeArena = new NodeArena( blockSize );
+}
+
+void NodeManagerBase::useNodestore( CompatNodestore* nodestore )
+{
+    if (!m_listNodes.empty())
+        throw std::logic_error("useNodestore: must be called before any node is added");
+    m_nodestore = nodestore;
+    m_nodestore->reserve( m_nodestore->numNodes() + m_expectedNumNodes );
+    NodeIndex().swap( m_nodeIndex ); // not used from now on
 }
 
 UaNode* NodeManagerBase::getNode( const UaNodeId& nodeId ) const
@@ -56,12 +229,33 @@ UaNode* NodeManagerBase::getNode( const UaNodeId& nodeId ) const
     if (nodeId == m_serverRootNode.nodeId())
         return (UaNode*)(&m_serverRootNode);
 
-    BOOST_FOREACH (UaNode* node,  m_listNodes)
+    if (m_nodestore)
+        return m_nodestore->compatNode( *nodeId.pimpl() );
+    boost::shared_lock<boost::shared_mutex> lock (m_nodeIndexLock);
+    NodeIndex::const_iterator it = m_nodeIndex.find( nodeId );
+    if (it != m_nodeIndex.end())
+        return it->second;
+    return 0; // not found
+}
+
+void NodeManagerBase::registerNode( UaNode* parent, UaNode* node, const UaNodeId& nodeId, const UaNodeId& referenceTypeId, void* nodeContext )
+{
+    StartupProfiler::Scope registration( m_profiler.get(), StartupProfiler::Registration,
+                                         m_profiler ? nodeKindOf(node->nodeClass()) : StartupProfiler::Unknown );
+    const ReferenceTypeRegistry::Index referenceType = ReferenceTypeRegistry::indexOf( referenceTypeId );
+    node->m_parentPosition = parent->appendReference( node, referenceType );
+    node->m_parentNode = parent;
+    node->m_parentReferenceTypeIndex = referenceType;
+
+    boost::unique_lock<boost::shared_mutex> lock (m_nodeIndexLock);
+    m_listNodes.push_back( *node );
+    if (m_nodestore)
     {
-        if (node->nodeId() == nodeId)
-            return node;
+        if (!m_nodestore->attach( *nodeId.pimpl(), node, nodeContext ))
+            LOG(Log::ERR) << "node " << nodeId.toString().toUtf8() << " was added but isn't in the nodestore";
     }
-    return 0; // not found
+    else
+        m_nodeIndex.insert( std::make_pair(nodeId, node) );
 }
 
 
@@ -78,18 +272,44 @@ static UA_StatusCode unifiedRead(
 
 
 {
+    if ( !nodeContext )
+        return UA_STATUSCODE_BADINTERNALERROR; // e.g. an address space image node not claimed (yet), see removeUnclaimedImageNodes()
     // we expect that the handle points to an object of subclass of BaseDataVariableType -- cause it's how we add then
     OpcUa::BaseDataVariableType *variable = static_cast<OpcUa::BaseDataVariableType*>(nodeContext);
+    VariableStatistics::Scope timing( variable->statistics(), VariableStatistics::Read );
 
-    UaDataValue aCopy( variable->value(0) ); // internally cloned so we can do anything with this object
-    UA_DataValue_copy( aCopy.impl(), dataValue );
-
-    // Piotr: I think that this version of open6 is leaking, try to use this code and you will see:
-    // dataValue->hasValue = true;
-    // double v = rand();
-    // UA_Variant_setScalarCopy(&dataValue->value, &v, &UA_TYPES[UA_TYPES_DOUBLE]);
+    // one deep copy, straight into the buffer the server encodes from; of the requested slice only, if any
+    if (range)
+        return variable->copyValueTo( dataValue, *range );
+    return variable->copyValueTo( dataValue );
+}
 
-    return UA_STATUSCODE_GOOD;
+//! What a write of an IndexRange makes of the variable's value: a copy of the current one with the slice replaced.
+//! The current value is shared with readers, so it isn't modified in place. Needs the variable's writeLock() until
+//! the result is set.
+static UA_StatusCode writtenRange(
+    OpcUa::BaseDataVariableType *variable,
+    const UA_Variant& slice,
+    const UA_NumericRange& range,
+    UA_DataValue* written)
+{
+    UA_DataValue current;
+    UA_DataValue_init( &current );
+    UA_StatusCode status = variable->copyValueTo( &current );
+    if (status != UA_STATUSCODE_GOOD)
+        return status;
+    if (!current.hasValue || !slice.type || slice.type != current.value.type)
+        status = UA_STATUSCODE_BADTYPEMISMATCH; // setRangeCopy would copy the slice with the variable's type
+    else
+        status = UA_Variant_setRangeCopy(
+                &current.value, slice.data, UA_Variant_isScalar( &slice ) ? 1 : slice.arrayLength, range );
+    if (status == UA_STATUSCODE_GOOD)
+    {
+        written->value = current.value;
+        UA_Variant_init( &current.value );
+    }
+    UA_DataValue_deleteMembers( &current );
+    return status;
 }
 
 static UA_StatusCode unifiedWrite(
@@ -115,43 +335,29 @@ static UA_StatusCode unifiedWrite(
     }
     // we expect that the handle points to an object of subclass of BaseDataVariableType
     OpcUa::BaseDataVariableType *variable = static_cast<OpcUa::BaseDataVariableType*>(nodeContext);
-    UaVariant variant ( dataValue->value );
-    UaStatus status = variable->setValue( /*anything non zero*/(Session*)-1, UaDataValue( variant, OpcUa_Good, UaDateTime::now(), UaDateTime::now() ), OpcUa_True );
+    VariableStatistics::Scope timing( variable->statistics(), VariableStatistics::Write );
+    boost::lock_guard<boost::mutex> lock (variable->writeLock());
+    // the only copy of the written value: from the server's buffer straight into what becomes the variable's value.
+    // setValue() shares it, so this costs no further copy.
+    UA_DataValue written;
+    UA_DataValue_init( &written );
+    UA_StatusCode copyStatus = range ?
+            writtenRange( variable, dataValue->value, *range, &written ) :
+            UA_Variant_copy( &dataValue->value, &written.value );
+    if (copyStatus != UA_STATUSCODE_GOOD)
+        return copyStatus;
+    written.hasValue = true;
+    written.status = OpcUa_Good;
+    written.hasStatus = true;
+    written.serverTimestamp = ValueClock::now().impl();
+    written.hasServerTimestamp = true;
+    // a client may stamp what it writes; otherwise the value originates here and now
+    written.sourceTimestamp = dataValue->hasSourceTimestamp ? dataValue->sourceTimestamp : written.serverTimestamp;
+    written.hasSourceTimestamp = true;
+    UaStatus status = variable->setValue( /*anything non zero*/(Session*)-1, UaDataValue( std::move( written ) ), OpcUa_True );
     return status;
 }
 
-class SynchronousMethodCallback: public MethodManagerCallback
-{
-public:
-    virtual ~SynchronousMethodCallback () {}
-
-    virtual UaStatus 	finishCall (
-        OpcUa_UInt32 callbackHandle,
-        UaStatusCodeArray &inputArgumentResults,
-        UaDiagnosticInfos &inputArgumentDiag,
-        UaVariantArray &outputArguments,
-        UaStatus &statusCode)
-    {
-        // TODO: store the answer
-        this->m_resultStatus = statusCode;
-        m_outputs = outputArguments;
-        return OpcUa_Good;
-    }
-
-    UaStatus getStatusCode () const {
-        return m_resultStatus;
-    }
-    UaVariantArray& outputs() {
-        return m_outputs;
-    }
-
-private:
-    UaStatus m_resultStatus;
-    UaVariantArray m_outputs;
-
-};
-
-
 //! IMPORTANT: in adding methods we pass nodeContext but where is this routed to in the end? To methodContext or objectContext?
 UA_StatusCode unifiedCall(
     UA_Server *server,
@@ -176,9 +382,16 @@ UA_StatusCode unifiedCall(
 {
     LOG(Log::TRC) << "called! handle=" << methodContext << " size=" << inputSize;
     MethodHandleUaNode *handle = static_cast<MethodHandleUaNode*> (methodContext);
+    if (!handle)
+        return UA_STATUSCODE_BADINTERNALERROR; // e.g. an address space image node not claimed (yet), see removeUnclaimedImageNodes()
     OpcUa::BaseObjectType *receiver = static_cast<OpcUa::BaseObjectType*> ( handle->pUaObject() );
+    // a typed binding takes the arguments straight from (and puts the outputs straight into) the server's variants,
+    // unless it runs on the worker pool
+    const std::shared_ptr<const TypedMethodBinding> typedBinding =
+            handle->pUaMethod() ? handle->pUaMethod()->typedBinding() : std::shared_ptr<const TypedMethodBinding>();
+    if (typedBinding)
+        return MethodExecutor::call( receiver, handle, typedBinding, inputSize, input, outputSize, output );
 
-    ServiceContext sc;
     UaVariantArray inputArgs;
 
     inputArgs.create( inputSize );
@@ -187,76 +400,403 @@ UA_StatusCode unifiedCall(
         inputArgs[i] = UaVariant( input[i] );
     }
 
-    SynchronousMethodCallback synchronousCallback;
-
-    UaStatus status =
-        receiver->beginCall(
-            &synchronousCallback  /* callback */,
-            sc /* fake service context */,
-            0 /* fake callback handle */,
-            handle /* fake method handle */,
-            inputArgs
-        );
-
+    // on this thread or on the worker pool, see MethodExecutor
+    UaVariantArray outputArgs;
+    UaStatus status = MethodExecutor::call( receiver, handle, inputArgs, outputArgs );
     if (status.isNotGood())
-        return status; // beginning failed ...
-
+        return status;
 
-
-    for (size_t i=0; i<outputSize; ++i)
+    for (size_t i=0; i<outputSize && i<outputArgs.size(); ++i)
     {
-        const UA_Variant* from = synchronousCallback.outputs()[i].impl();
+        const UA_Variant* from = outputArgs[i].impl();
         UA_Variant_copy(from, output+i);
     }
 
 
-    return synchronousCallback.getStatusCode();
+    return status;
 }
 
 
-UaString localisationCode("en_US");
+static const UA_String& localisationCode = InternedStrings::intern("en_US");
+static const UA_String& dummyDescriptionText = InternedStrings::intern("DummyDescription");
 
+//! The returned text is interned (see InternedStrings), so it must not be freed; its reference is never dropped
 UA_LocalizedText make_localised( UaString text )
 {
     UA_LocalizedText out;
-    out.locale = *localisationCode.impl();
-    out.text = *(new UaString(text))->impl();
+    out.locale = localisationCode;
+    out.text = InternedStrings::intern( *text.impl() );
     return out;
 }
 
+//! Attribute structs prepared once and shared by all nodes inserted in one go.
+//! open62541 deep-copies the attributes while adding a node, so they may just borrow
+//! (i.e. shallow-copy) strings owned by us or by the node being added.
+struct NodeManagerBase::AddNodeScratch
+{
+    AddNodeScratch():
+        lastParent(0),
+        lastParentId(0, 0)
+    {
+        UA_LocalizedText description;
+        description.locale = localisationCode;
+        description.text = dummyDescriptionText;
+
+        UA_ObjectAttributes_init( &objectAttributes );
+        objectAttributes.description = description;
+        objectAttributes.displayName.locale = localisationCode;
+
+        UA_VariableAttributes_init( &variableAttributes );
+        variableAttributes.description = description;
+        variableAttributes.displayName.locale = localisationCode;
+
+        UA_MethodAttributes_init( &methodAttributes );
+        methodAttributes.executable = true;
+        methodAttributes.userExecutable = true;
+        methodAttributes.description = description;
+        methodAttributes.displayName.locale = localisationCode;
+
+        dataSource.read = unifiedRead;
+        dataSource.write = unifiedWrite;
+    }
+
+    //! Consecutive children of the same parent are the common case, so parent's NodeId is computed once for them
+    const UA_NodeId& parentId( UaNode* parent )
+    {
+        if (parent != lastParent)
+        {
+            lastParentId = parent->nodeId();
+            lastParent = parent;
+        }
+        return *lastParentId.pimpl();
+    }
+
+    UA_ObjectAttributes   objectAttributes;
+    UA_VariableAttributes variableAttributes;
+    UA_MethodAttributes   methodAttributes;
+    UA_DataSource         dataSource;
+    UaNode*               lastParent;
+    UaNodeId              lastParentId;
+};
+
+//! Everything that addition of a node needs and that can be derived from the node alone, without touching UA_Server.
+//! Building it is the CPU-heavy part of addition (virtual getters returning deep copies, method argument marshaling)
+//! so it can be done on any thread; it's then committed to the server by commitNode().
+//! A method takes its arguments from its argument properties: those it references, or the given ones instead.
+struct NodeManagerBase::PreparedNode
+{
+    PreparedNode(
+            UaNode* aParent,
+            UaNode* aNode,
+            const UaNodeId& aReferenceTypeId,
+            ArgumentListCache& argumentLists,
+            const std::vector<const UaNode*>* properties = 0 ):
+        parent(aParent),
+        node(aNode),
+        referenceTypeId(aReferenceTypeId),
+        nodeClass(aNode->nodeClass()),
+        nodeId(aNode->nodeId()),
+        browseName(aNode->browseName()),
+        typeDefinitionId(aNode->typeDefinitionId()),
+        valueRank(-1),
+        accessLevel(0),
+        inputArguments(0),
+        outputArguments(0)
+    {
+        switch (nodeClass)
+        {
+        case OpcUa_NodeClass_Variable:
+        {
+            if (isProperty())
+                break;
+            OpcUa::BaseDataVariableType *variable = dynamic_cast<OpcUa::BaseDataVariableType*>(node);
+            if (!variable)
+            {
+                throw std::logic_error("Given variable is not castable to BaseDataVariableType, sth went wrong");
+            }
+            valueRank = variable->valueRank();
+            accessLevel = variable->accessLevel();
+            break;
+        }
+        case OpcUa_NodeClass_Method:
+        {
+            if (properties)
+            {
+                for (size_t i = 0; i < properties->size(); ++i)
+                    takeArguments( (*properties)[i], argumentLists );
+            }
+            else
+            {
+                const UaNode::ReferencedTargetRange referenced = node->referencedTargets( OpcUaId_HasProperty );
+                for ( UaNode::ReferencedTargetRange::const_iterator it = referenced.begin(); it != referenced.end(); ++it )
+                    takeArguments( it->target, argumentLists );
+            }
+            if (!inputArguments)
+                inputArguments = argumentLists.intern( 0, 0 );
+            if (!outputArguments)
+                outputArguments = argumentLists.intern( 0, 0 );
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    void takeArguments( const UaNode* target, ArgumentListCache& argumentLists )
+    {
+        const UaPropertyMethodArgument* property = dynamic_cast<const UaPropertyMethodArgument*> ( target );
+        if (!property)
+            return;
+        const ArgumentListCache::ArgumentList*& arguments =
+            property->argumentType() == UaPropertyMethodArgument::INARGUMENTS ? inputArguments : outputArguments;
+        arguments = argumentLists.intern( property->implArguments(), property->numArguments() );
+    }
+
+    //! Properties aren't added to the address space (see commitNode), they only become a reference of the parent
+    bool isProperty() const { return nodeClass == OpcUa_NodeClass_Variable && referenceTypeId == OpcUaId_HasProperty; }
+
+    StartupProfiler::NodeKind kind() const { return isProperty() ? StartupProfiler::Property : nodeKindOf( nodeClass ); }
+
+    UaNode*         parent;
+    UaNode*         node;
+    UaNodeId        referenceTypeId;
+    OpcUa_NodeClass nodeClass;
+    UaNodeId        nodeId;
+    UaQualifiedName browseName;
+    UaNodeId        typeDefinitionId;
+    OpcUa_Int32     valueRank;   // variables only
+    OpcUa_Byte      accessLevel; // variables only
+    const ArgumentListCache::ArgumentList* inputArguments;  // methods only, shared by all methods of the same signature
+    const ArgumentListCache::ArgumentList* outputArguments; // methods only, as above
+};
+
+//! Prepares nodes of a bulk insertion on a pool of worker threads, in chunks claimed from a shared counter.
+//! The committer (i.e. the thread that runs addNodesAndReferences) takes prepared nodes strictly in order.
+//! It links nodes to their parents as it goes, so a method which gets argument properties in the same insertion is
+//! prepared from the properties it will have by its turn, collected up front, rather than from its references.
+class NodeManagerBase::PreparationPipeline
+{
+public:
+    PreparationPipeline( const std::vector<NodeAndReference>& nodes, unsigned int numThreads, ArgumentListCache& argumentLists, StartupProfiler* profiler ):
+        m_nodes(nodes),
+        m_argumentLists(argumentLists),
+        m_profiler(profiler),
+        m_slots(nodes.size()),
+        m_nextChunk(0),
+        m_aborted(false)
+    {
+        collectMethodProperties();
+        for (unsigned int i=0; i<numThreads; ++i)
+            m_workers.create_thread( boost::bind(&PreparationPipeline::work, this) );
+    }
+
+    ~PreparationPipeline()
+    {
+        m_aborted = true;
+        m_workers.join_all();
+        for (std::vector<Slot>::iterator it = m_slots.begin(); it != m_slots.end(); ++it)
+            delete it->prepared; // whatever the committer didn't take
+    }
+
+    //! Blocks until i-th node is prepared. Ownership of the result goes to the caller. Rethrows preparation failure.
+    PreparedNode* take( size_t i )
+    {
+        Slot& slot = m_slots[i];
+        if (!slot.ready.load(std::memory_order_acquire))
+        {
+            boost::unique_lock<boost::mutex> lock (m_readyLock);
+            while (!slot.ready.load(std::memory_order_acquire))
+                m_readyCondition.wait( lock );
+        }
+        if (slot.error)
+            std::rethrow_exception( slot.error );
+        PreparedNode* prepared = slot.prepared;
+        slot.prepared = 0;
+        return prepared;
+    }
+
+private:
+    static const size_t ChunkSize = 256;
+
+    typedef std::unordered_map<const UaNode*, std::vector<const UaNode*> > MethodProperties;
+
+    //! For each method which is the parent of another entry: its properties as of its own entry
+    void collectMethodProperties()
+    {
+        std::unordered_map<const UaNode*, size_t> methodEntries;
+        for (size_t i = 0; i < m_nodes.size(); ++i)
+            if (m_nodes[i].node->nodeClass() == OpcUa_NodeClass_Method)
+                methodEntries[m_nodes[i].node] = i;
+        for (size_t i = 0; i < m_nodes.size(); ++i)
+        {
+            std::unordered_map<const UaNode*, size_t>::const_iterator method = methodEntries.find( m_nodes[i].parent );
+            if (method == methodEntries.end())
+                continue;
+            MethodProperties::iterator properties = m_methodProperties.find( method->first );
+            if (properties == m_methodProperties.end())
+            {
+                // what it references already: nobody touches that before the committer gets going
+                properties = m_methodProperties.insert( MethodProperties::value_type( method->first, std::vector<const UaNode*>() ) ).first;
+                const UaNode::ReferencedTargetRange referenced = method->first->referencedTargets( OpcUaId_HasProperty );
+                for (UaNode::ReferencedTargetRange::const_iterator it = referenced.begin(); it != referenced.end(); ++it)
+                    properties->second.push_back( it->target );
+            }
+            if (i < method->second && m_nodes[i].referenceTypeId == OpcUaId_HasProperty)
+                properties->second.push_back( m_nodes[i].node );
+        }
+    }
+
+    struct Slot
+    {
+        Slot(): prepared(0), ready(false) {}
+        PreparedNode*       prepared;
+        std::exception_ptr   error;
+        std::atomic<bool>   ready;
+    };
+
+    void work()
+    {
+        while (!m_aborted)
+        {
+            const size_t begin = m_nextChunk.fetch_add(ChunkSize);
+            if (begin >= m_nodes.size())
+                return;
+            const size_t end = std::min( begin + ChunkSize, m_nodes.size() );
+            for (size_t i = begin; i < end; ++i)
+            {
+                const NodeAndReference& entry = m_nodes[i];
+                try
+                {
+                    MethodProperties::const_iterator properties = m_methodProperties.find( entry.node );
+                    StartupProfiler::Scope preparation( m_profiler, StartupProfiler::Preparation );
+                    m_slots[i].prepared = new PreparedNode( entry.parent, entry.node, entry.referenceTypeId, m_argumentLists,
+                                                            properties == m_methodProperties.end() ? 0 : &properties->second );
+                    preparation.setKind( m_slots[i].prepared->kind() );
+                }
+                catch (...)
+                {
+                    m_slots[i].error = std::current_exception();
+                }
+                m_slots[i].ready.store( true, std::memory_order_release );
+            }
+            boost::lock_guard<boost::mutex> lock (m_readyLock);
+            m_readyCondition.notify_all();
+        }
+    }
+
+    const std::vector<NodeAndReference>& m_nodes;
+    ArgumentListCache&        m_argumentLists;
+    StartupProfiler*          m_profiler; // optional
+    MethodProperties          m_methodProperties;
+    std::vector<Slot>         m_slots;
+    std::atomic<size_t>       m_nextChunk;
+    std::atomic<bool>         m_aborted;
+    boost::mutex              m_readyLock;
+    boost::condition_variable m_readyCondition;
+    boost::thread_group       m_workers;
+};
+
 UaStatus NodeManagerBase::addNodeAndReference(
     UaNode* parent,
     UaNode* to,
     const UaNodeId& refType)
 {
-    UaLocalizedText displayName( "en_US", to->browseName().unqualifiedName().toUtf8().c_str());
-    UaLocalizedText dummyDescription( "en_US", "DummyDescription" );
-    switch( to->nodeClass() )
+    if (m_numUnclaimedImageNodes && adoptPreloadedNode( parent, to, refType ))
+        return OpcUa_Good;
+    AddNodeScratch scratch;
+    StartupProfiler::Scope preparation( m_profiler.get(), StartupProfiler::Preparation );
+    PreparedNode prepared( parent, to, refType, *m_argumentLists );
+    preparation.setKind( prepared.kind() );
+    preparation.finish();
+    return commitNode( prepared, scratch );
+}
+
+UaStatus NodeManagerBase::addNodesAndReferences(
+    const std::vector<NodeAndReference>& nodes,
+    unsigned int preparationThreads )
+{
+    if (m_nodestore)
+        m_nodestore->reserve( m_nodestore->numNodes() + nodes.size() );
+    else
+    {
+        boost::unique_lock<boost::shared_mutex> lock (m_nodeIndexLock);
+        m_nodeIndex.reserve( m_nodeIndex.size() + nodes.size() );
+    }
+    if (preparationThreads == 0)
+        preparationThreads = std::max( 1u, boost::thread::hardware_concurrency() );
+    AddNodeScratch scratch;
+
+    // with an address space image, nodes are taken from it rather than prepared, so there's little to prepare in parallel
+    if (preparationThreads == 1 || m_numUnclaimedImageNodes)
+    {
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            if (m_numUnclaimedImageNodes && adoptPreloadedNode( nodes[i].parent, nodes[i].node, nodes[i].referenceTypeId ))
+                continue;
+            StartupProfiler::Scope preparation( m_profiler.get(), StartupProfiler::Preparation );
+            PreparedNode prepared( nodes[i].parent, nodes[i].node, nodes[i].referenceTypeId, *m_argumentLists );
+            preparation.setKind( prepared.kind() );
+            preparation.finish();
+            UaStatus s = commitNode( prepared, scratch );
+            if (s.isNotGood())
+            {
+                LOG(Log::ERR) << "Bulk insertion stopped at node " << i << " of " << nodes.size() << ": " << s.toString().toUtf8();
+                return s;
+            }
+        }
+        InternedStrings::logStatistics();
+        LOG(Log::INF) << "Distinct method argument lists: " << m_argumentLists->numLists();
+        return OpcUa_Good;
+    }
+
+    PreparationPipeline pipeline( nodes, preparationThreads, *m_argumentLists, m_profiler.get() );
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        boost::scoped_ptr<PreparedNode> prepared( pipeline.take(i) );
+        UaStatus s = commitNode( *prepared, scratch );
+        if (s.isNotGood())
+        {
+            LOG(Log::ERR) << "Bulk insertion stopped at node " << i << " of " << nodes.size() << ": " << s.toString().toUtf8();
+            return s;
+        }
+    }
+    InternedStrings::logStatistics();
+    LOG(Log::INF) << "Distinct method argument lists: " << m_argumentLists->numLists();
+    return OpcUa_Good;
+}
+
+UaStatus NodeManagerBase::commitNode(
+    const PreparedNode& prepared,
+    AddNodeScratch& scratch)
+{
+    UaNode* parent = prepared.parent;
+    UaNode* to = prepared.node;
+    const UaNodeId& refType = prepared.referenceTypeId;
+    const UaNodeId& nodeId = prepared.nodeId;
+    const UA_QualifiedName browseName = prepared.browseName.impl();
+    switch( prepared.nodeClass )
     {
     case OpcUa_NodeClass_Object:
     {
-        UA_ObjectAttributes objectAttributes;
-        UA_ObjectAttributes_init( &objectAttributes );
-        objectAttributes.description = *dummyDescription.impl();
-        objectAttributes.displayName = *displayName.impl();
-        UA_NodeId out;
+        UA_ObjectAttributes& objectAttributes = scratch.objectAttributes;
+        objectAttributes.displayName.text = browseName.name;
+        StartupProfiler::Scope insertion( m_profiler.get(), StartupProfiler::ServerInsertion, StartupProfiler::Object );
         UA_StatusCode s = UA_Server_addObjectNode(
                               /*server*/ m_server,
-                              /*newnodeid*/ to->nodeId().impl(),
-                              /*parentid*/ parent->nodeId().impl(),
+                              /*newnodeid*/ nodeId.impl(),
+                              /*parentid*/ scratch.parentId(parent),
                               /*ref id*/ refType.impl(),
-                              /*browsename*/ to->browseName().impl(),
-                              /*type def*/ to->typeDefinitionId().impl(),
+                              /*browsename*/ browseName,
+                              /*type def*/ prepared.typeDefinitionId.impl(),
                               /* object attrs*/ objectAttributes,
                               /* instantiation cbk*/ 0,
-                              /*out new node id*/ &out
+                              /*out new node id*/ nullptr
                           );
+        insertion.finish();
 
-        LOG(Log::TRC) << "obtained output: ns=" << out.namespaceIndex << "," << UaString(&out.identifier.string).toUtf8();
         if (UA_STATUSCODE_GOOD == s)
         {
-            m_listNodes.push_back( to );
-            parent->addReferencedTarget( to, refType );
+            registerNode( parent, to, nodeId, refType );
         }
         else
             LOG(Log::ERR) << "Failed to add new node: " << std::hex << s;
@@ -266,50 +806,39 @@ UaStatus NodeManagerBase::addNodeAndReference(
     {
         // skip HasProperty
 
-        if (refType == OpcUaId_HasProperty)
+        if (prepared.isProperty())
         {
             // We don't add Properties to the Address Space when open62541-compat is in use
             // open62541 does it differently: when you add a method, then you specify the properties
-            parent->addReferencedTarget(to, refType);
+            StartupProfiler::Scope registration( m_profiler.get(), StartupProfiler::Registration, StartupProfiler::Property );
+            parent->appendReference( to, ReferenceTypeRegistry::indexOf(refType) ); // never deleted by us: needn't know its method
             return OpcUa_Good;
 
         }
 
-        UA_DataSource dateDataSource
-        {
-            unifiedRead,
-            unifiedWrite
-        };
-        UA_VariableAttributes attr;
-        UA_VariableAttributes_init(&attr);
-        attr.description = *dummyDescription.impl();
-        attr.displayName = *displayName.impl();
-        attr.dataType = to->typeDefinitionId().impl();
-        attr.valueRank = static_cast<OpcUa::BaseDataVariableType*>(to)->valueRank();
-
-        OpcUa::BaseDataVariableType *variable = dynamic_cast<OpcUa::BaseDataVariableType*>(to);
-        if (!variable)
-        {
-            throw std::logic_error("Given variable is not castable to BaseDataVariableType, sth went wrong");
-        }
-        attr.accessLevel = variable->accessLevel();
+        UA_VariableAttributes& attr = scratch.variableAttributes;
+        attr.displayName.text = browseName.name;
+        attr.dataType = *prepared.typeDefinitionId.pimpl();
+        attr.valueRank = prepared.valueRank;
+        attr.accessLevel = prepared.accessLevel;
 
+        StartupProfiler::Scope insertion( m_profiler.get(), StartupProfiler::ServerInsertion, StartupProfiler::Variable );
         UA_StatusCode s =
             UA_Server_addDataSourceVariableNode(m_server,
-                                                to->nodeId().impl(),
-                                                parent->nodeId().impl(),
+                                                nodeId.impl(),
+                                                scratch.parentId(parent),
                                                 refType.impl(),
-                                                to->browseName().impl(),
-                                                UaNodeId(UA_NS0ID_BASEDATAVARIABLETYPE ,0).impl() ,
+                                                browseName,
+                                                UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
                                                 attr,
-                                                dateDataSource,
+                                                scratch.dataSource,
                                                 static_cast<void*>(to),  // this is our nodeContext - we'll use it to map to the variable
                                                 nullptr
                                                );
+        insertion.finish();
         if (UA_STATUSCODE_GOOD == s)
         {
-            m_listNodes.push_back( to );
-            parent->addReferencedTarget( to, refType );
+            registerNode( parent, to, nodeId, refType );
         }
 
 
@@ -318,77 +847,36 @@ UaStatus NodeManagerBase::addNodeAndReference(
 
     case OpcUa_NodeClass_Method:
     {
-        UA_MethodAttributes attr;
-        UA_MethodAttributes_init(&attr);
-        attr.executable = true;
-        attr.userExecutable = true;
-        attr.displayName = *displayName.impl();
-        attr.description = *dummyDescription.impl();
+        UA_MethodAttributes& attr = scratch.methodAttributes;
+        attr.displayName.text = browseName.name;
 
-        MethodHandleUaNode *handle = new MethodHandleUaNode;
-        handle->setUaNodes( static_cast<UaObject*>(parent), static_cast<UaMethod*>(to) );
+        MethodHandleUaNode *handle = acquireMethodHandle( parent, to );
 
         LOG(Log::TRC) << "parent node: " << parent->nodeId().toFullString().toUtf8();
 
-        const std::list<UaNode::ReferencedTarget>* referenced =  to->referencedTargets();
-        LOG(Log::TRC) << "Referenced nodes: " << referenced->size();
-
-        UA_Argument *inArgs = 0;
-        int inArgsSize = 0;
-        UA_Argument *outArgs = 0;
-        int outArgsSize = 0;
-
-        for ( std::list<UaNode::ReferencedTarget>::const_iterator it = referenced->cbegin(); it!=referenced->cend(); it++ )
-        {
-            const UaNode::ReferencedTarget& refTarget = *it;
-            if (refTarget.referenceTypeId == OpcUaId_HasProperty)
-            {
-                const UaPropertyMethodArgument* property = dynamic_cast<const UaPropertyMethodArgument*> ( refTarget.target );
-                if (property->argumentType() == UaPropertyMethodArgument::INARGUMENTS)
-                {
-                    inArgsSize = property->numArguments();
-                    inArgs = new UA_Argument[ property->numArguments() ];
-                    for (unsigned int i=0; i < property->numArguments(); ++i )
-                    {
-                        inArgs[i] = property->implArgument(i);
-                    }
-                }
-                else
-                {
-                    outArgsSize = property->numArguments();
-                    outArgs = new UA_Argument[ property->numArguments() ];
-                    for (unsigned int i=0; i < property->numArguments(); ++i )
-                    {
-                        outArgs[i] = property->implArgument(i);
-                        //LOG(Log::INF) << "Configured: " << outArgs[i].name.data;
-                    }
-                }
-
-            }
-
-        }
-
+        StartupProfiler::Scope insertion( m_profiler.get(), StartupProfiler::ServerInsertion, StartupProfiler::Method );
         UaStatus s =
             UA_Server_addMethodNode(
                 m_server,
-                to->nodeId().impl(),
-                parent->nodeId().impl(),
+                nodeId.impl(),
+                scratch.parentId(parent),
                 refType.impl(),
-                to->browseName().impl(),
+                browseName,
                 attr,
                 unifiedCall,
-                /*size_t inputArgumentsSize*/ inArgsSize,
-                /*const UA_Argument* inputArguments*/ inArgs,
-                /*size_t outputArgumentsSize*/ outArgsSize,
-                /*const UA_Argument* outputArguments*/ outArgs,
+                /*size_t inputArgumentsSize*/ prepared.inputArguments->size(),
+                /*const UA_Argument* inputArguments*/ prepared.inputArguments->empty() ? 0 : &(*prepared.inputArguments)[0],
+                /*size_t outputArgumentsSize*/ prepared.outputArguments->size(),
+                /*const UA_Argument* outputArguments*/ prepared.outputArguments->empty() ? 0 : &(*prepared.outputArguments)[0],
                 /*void *nodeContext */ (void*)handle,
                 nullptr);
+        insertion.finish();
         if (! s.isGood())
         {
+            releaseMethodHandle( handle );
             throw std::runtime_error("failed to add the method node:"+std::string(s.toString().toUtf8()));
         }
-        m_listNodes.push_back( to );
-        parent->addReferencedTarget( to, refType );
+        registerNode( parent, to, nodeId, refType );
         return 0;
     };
 
@@ -400,12 +888,244 @@ UaStatus NodeManagerBase::addNodeAndReference(
 }
 
 
+bool NodeManagerBase::adoptPreloadedNode( UaNode* parent, UaNode* node, const UaNodeId& referenceTypeId )
+{
+    const OpcUa_NodeClass nodeClass = node->nodeClass();
+    if (nodeClass == OpcUa_NodeClass_Variable && referenceTypeId == OpcUaId_HasProperty)
+    {
+        // not in the address space, see commitNode()
+        StartupProfiler::Scope registration( m_profiler.get(), StartupProfiler::Registration, StartupProfiler::Property );
+        parent->appendReference( node, ReferenceTypeRegistry::indexOf( referenceTypeId ) );
+        return true;
+    }
+    const UaNodeId nodeId = node->nodeId();
+    PreloadedNodes::iterator it = m_preloadedNodes.find( nodeId );
+    if (it == m_preloadedNodes.end() || it->second.adoptedBy || it->second.removed)
+        return false;
+    PreloadedNode& preloaded = it->second;
+    const bool sameParent = preloaded.parent ? preloaded.parent->adoptedBy == parent : parent == &m_serverRootNode;
+    if (preloaded.nodeClass != nodeClass || !sameParent || preloaded.referenceType != ReferenceTypeRegistry::indexOf( referenceTypeId ))
+    {
+        LOG(Log::WRN) << "Node " << nodeId.toString().toUtf8() << " differs from the one in the address space image, building it anew";
+        const UA_StatusCode s = UA_Server_deleteNode( m_server, nodeId.impl(), /*deleteReferences*/ true );
+        if (s != UA_STATUSCODE_GOOD)
+            LOG(Log::WRN) << "Couldn't remove image node " << nodeId.toString().toUtf8() << ": " << UaStatus(s).toString().toUtf8();
+        preloaded.removed = true;
+        --m_numUnclaimedImageNodes;
+        return false;
+    }
+
+    void* nodeContext = 0;
+    if (nodeClass == OpcUa_NodeClass_Variable)
+        nodeContext = static_cast<void*>( node );
+    else if (nodeClass == OpcUa_NodeClass_Method)
+        nodeContext = acquireMethodHandle( parent, node );
+    if (nodeContext && !m_nodestore) // with the nodestore, registerNode() sets it in the same lookup
+    {
+        StartupProfiler::Scope insertion( m_profiler.get(), StartupProfiler::ServerInsertion, nodeKindOf( nodeClass ) );
+        const UA_StatusCode s = UA_Server_setNodeContext( m_server, nodeId.impl(), nodeContext );
+        if (s != UA_STATUSCODE_GOOD)
+        {
+            if (nodeClass == OpcUa_NodeClass_Method)
+                releaseMethodHandle( static_cast<MethodHandleUaNode*>(nodeContext) );
+            throw std::runtime_error("failed to attach a node to its preloaded counterpart: "+std::string(UaStatus(s).toString().toUtf8()));
+        }
+    }
+    preloaded.adoptedBy = node;
+    --m_numUnclaimedImageNodes;
+    registerNode( parent, node, nodeId, referenceTypeId, nodeContext );
+    return true;
+}
+
+size_t NodeManagerBase::removeUnclaimedImageNodes()
+{
+    size_t numRemoved = 0;
+    // children before their parents
+    for (std::vector<PreloadedNodes::value_type*>::reverse_iterator it = m_preloadedOrder.rbegin(); it != m_preloadedOrder.rend(); ++it)
+    {
+        const PreloadedNode& preloaded = (*it)->second;
+        if (preloaded.adoptedBy || preloaded.removed)
+            continue;
+        const UA_StatusCode s = UA_Server_deleteNode( m_server, (*it)->first.impl(), /*deleteReferences*/ true );
+        if (s == UA_STATUSCODE_GOOD)
+            ++numRemoved;
+        else
+            LOG(Log::WRN) << "Couldn't remove image node " << (*it)->first.toString().toUtf8() << ": " << UaStatus(s).toString().toUtf8();
+    }
+    if (numRemoved)
+        LOG(Log::INF) << "Removed " << numRemoved << " address space image nodes which no node corresponded to";
+    std::vector<PreloadedNodes::value_type*>().swap( m_preloadedOrder );
+    PreloadedNodes().swap( m_preloadedNodes );
+    m_numUnclaimedImageNodes = 0;
+    return numRemoved;
+}
+
+UaStatus NodeManagerBase::saveAddressSpaceImage( const std::string& path, OpcUa_UInt64 configHash ) const
+{
+    try
+    {
+        AddressSpaceImageWriter writer( configHash );
+        AddressSpaceImageNode imageNode;
+        // depth-first from the root, so that parents precede their children
+        std::vector<UaNode*> stack;
+        stack.push_back( const_cast<ServerRootNode*>(&m_serverRootNode) );
+        while (!stack.empty())
+        {
+            UaNode* parent = stack.back();
+            stack.pop_back();
+            const UaNodeId parentId ( parent->nodeId() );
+            const UaNode::ReferencedTargets* references = parent->referencedTargets();
+            for (UaNode::ReferencedTargets::const_reverse_iterator it = references->rbegin(); it != references->rend(); ++it)
+            {
+                // a node is written once, under the parent it was added to; other references to it aren't in the image
+                if (it->target->m_parentNode != parent)
+                    continue;
+                PreparedNode prepared( parent, it->target, it->referenceTypeId, *m_argumentLists );
+                if (prepared.isProperty())
+                    continue; // not in the address space, method arguments are taken from them though
+                imageNode.nodeClass = prepared.nodeClass;
+                imageNode.nodeId = prepared.nodeId.impl();
+                imageNode.parentId = parentId.impl();
+                imageNode.referenceTypeId = prepared.referenceTypeId.impl();
+                imageNode.typeDefinitionId = prepared.typeDefinitionId.impl();
+                imageNode.browseName = prepared.browseName.impl();
+                imageNode.valueRank = prepared.valueRank;
+                imageNode.accessLevel = prepared.accessLevel;
+                if (prepared.nodeClass == OpcUa_NodeClass_Method)
+                {
+                    imageNode.inputArguments = *prepared.inputArguments;
+                    imageNode.outputArguments = *prepared.outputArguments;
+                }
+                else
+                {
+                    imageNode.inputArguments.clear();
+                    imageNode.outputArguments.clear();
+                }
+                writer.add( imageNode );
+                stack.push_back( it->target );
+            }
+        }
+        writer.write( path );
+        LOG(Log::INF) << "Saved address space image of " << writer.numNodes() << " nodes to " << path;
+        return OpcUa_Good;
+    }
+    catch (const std::exception& e)
+    {
+        LOG(Log::ERR) << "Couldn't save address space image: " << e.what();
+        return OpcUa_Bad;
+    }
+}
+
+UaStatus NodeManagerBase::loadAddressSpaceImage( const std::string& path, OpcUa_UInt64 configHash )
+{
+    if (!m_server)
+        throw std::logic_error("loadAddressSpaceImage: call linkServer() first");
+    if (!m_listNodes.empty() || !m_preloadedNodes.empty())
+        throw std::logic_error("loadAddressSpaceImage: must be called before any node is added");
+    boost::scoped_ptr<AddressSpaceImageReader> reader;
+    try
+    {
+        reader.reset( new AddressSpaceImageReader( path, configHash ) );
+    }
+    catch (const std::exception& e)
+    {
+        LOG(Log::WRN) << "Not using address space image: " << e.what();
+        return OpcUa_BadInvalidState;
+    }
+
+    AddNodeScratch scratch;
+    AddressSpaceImageNode node;
+    const UaNodeId objectsFolder (OpcUaId_ObjectsFolder, 0);
+    m_preloadedNodes.reserve( reader->numNodes() );
+    m_preloadedOrder.reserve( reader->numNodes() );
+    UA_StatusCode s = UA_STATUSCODE_GOOD;
+    try
+    {
+        for (size_t i = 0; i < reader->numNodes() && s == UA_STATUSCODE_GOOD; ++i)
+        {
+            reader->node( i, node );
+            PreloadedNode preloaded;
+            preloaded.parent = 0;
+            preloaded.adoptedBy = 0;
+            preloaded.nodeClass = node.nodeClass;
+            preloaded.referenceType = ReferenceTypeRegistry::indexOf( UaNodeId(node.referenceTypeId) );
+            preloaded.removed = false;
+            const UaNodeId parentId (node.parentId);
+            if (!(parentId == objectsFolder))
+            {
+                PreloadedNodes::const_iterator parent = m_preloadedNodes.find( parentId );
+                if (parent == m_preloadedNodes.end())
+                {
+                    LOG(Log::WRN) << "Not using address space image: the parent of node " << i << " doesn't precede it";
+                    s = UA_STATUSCODE_BADINVALIDSTATE;
+                    break;
+                }
+                preloaded.parent = &parent->second;
+            }
+            std::pair<PreloadedNodes::iterator, bool> inserted = m_preloadedNodes.insert( std::make_pair( UaNodeId(node.nodeId), preloaded ) );
+            if (!inserted.second)
+            {
+                LOG(Log::WRN) << "Not using address space image: node " << i << " is in it twice";
+                s = UA_STATUSCODE_BADNODEIDEXISTS;
+                break;
+            }
+            switch (node.nodeClass)
+            {
+            case OpcUa_NodeClass_Object:
+                scratch.objectAttributes.displayName.text = node.browseName.name;
+                s = UA_Server_addObjectNode( m_server, node.nodeId, node.parentId, node.referenceTypeId, node.browseName,
+                                             node.typeDefinitionId, scratch.objectAttributes, 0, nullptr );
+                break;
+            case OpcUa_NodeClass_Variable:
+                scratch.variableAttributes.displayName.text = node.browseName.name;
+                scratch.variableAttributes.dataType = node.typeDefinitionId;
+                scratch.variableAttributes.valueRank = node.valueRank;
+                scratch.variableAttributes.accessLevel = node.accessLevel;
+                s = UA_Server_addDataSourceVariableNode( m_server, node.nodeId, node.parentId, node.referenceTypeId, node.browseName,
+                                                         UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                                         scratch.variableAttributes, scratch.dataSource, 0, nullptr );
+                break;
+            case OpcUa_NodeClass_Method:
+                scratch.methodAttributes.displayName.text = node.browseName.name;
+                s = UA_Server_addMethodNode( m_server, node.nodeId, node.parentId, node.referenceTypeId, node.browseName,
+                                             scratch.methodAttributes, unifiedCall,
+                                             node.inputArguments.size(), node.inputArguments.empty() ? 0 : &node.inputArguments[0],
+                                             node.outputArguments.size(), node.outputArguments.empty() ? 0 : &node.outputArguments[0],
+                                             0, nullptr );
+                break;
+            }
+            if (s != UA_STATUSCODE_GOOD)
+            {
+                LOG(Log::WRN) << "Not using address space image: failed to add node " << i << ": " << UaStatus(s).toString().toUtf8();
+                m_preloadedNodes.erase( inserted.first );
+                break;
+            }
+            m_preloadedOrder.push_back( &*inserted.first );
+            ++m_numUnclaimedImageNodes;
+        }
+    }
+    catch (...)
+    {
+        removeUnclaimedImageNodes(); // nothing claimed yet: removes all that was added
+        throw;
+    }
+    if (s != UA_STATUSCODE_GOOD)
+    {
+        removeUnclaimedImageNodes();
+        return s;
+    }
+    LOG(Log::INF) << "Preloaded " << reader->numNodes() << " nodes from address space image " << path;
+    return OpcUa_Good;
+}
+
 UaStatus NodeManagerBase::addNodeAndReference(
     const UaNodeId& from,
     UaNode* to,
     const UaNodeId& refType)
 {
+    StartupProfiler::Scope parentLookup( m_profiler.get(), StartupProfiler::ParentLookup );
     UaNode* parentNode = getNode (from);
+    parentLookup.finish();
     if (!parentNode)
         return UA_STATUSCODE_BADNODEIDUNKNOWN;
     return addNodeAndReference( parentNode, to, refType);
@@ -419,3 +1139,360 @@ void NodeManagerBase::linkServer( UA_Server* server )
     if (nsIndex != 2)
         throw std::logic_error("UA_Server_addNamespace: namespace added to nsindex different than 2. ");
 }
+
+UaNode* NodeManagerBase::ownedNode( const UaNodeId& nodeId ) const
+{
+    UaNode* node = getNode( nodeId );
+    return node && node->m_parentNode ? node : 0; // the server root node has no parent and isn't ours
+}
+
+UaStatus NodeManagerBase::deleteNode( const UaNodeId& nodeId )
+{
+    UaNode* node = ownedNode( nodeId );
+    if (!node)
+        return OpcUa_BadNodeIdUnknown;
+    BOOST_FOREACH (const UaNode::ReferencedTarget& reference, *node->referencedTargets())
+    {
+        if (reference.target->m_parentNode == node)
+            return OpcUa_BadInvalidState; // has children, see deleteSubtree()
+    }
+    return removeNodes( std::vector<UaNode*>(1, node) );
+}
+
+UaStatus NodeManagerBase::deleteSubtree( const UaNodeId& nodeId )
+{
+    UaNode* root = ownedNode( nodeId );
+    if (!root)
+        return OpcUa_BadNodeIdUnknown;
+    // breadth-first through the children (i.e. the targets added under each node, not properties or foreign references)
+    std::vector<UaNode*> nodes( 1, root );
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        BOOST_FOREACH (const UaNode::ReferencedTarget& reference, *nodes[i]->referencedTargets())
+        {
+            if (reference.target->m_parentNode == nodes[i])
+                nodes.push_back( reference.target );
+        }
+    }
+    return removeNodes( nodes );
+}
+
+UaStatus NodeManagerBase::removeNodes( const std::vector<UaNode*>& nodes )
+{
+    // The server goes first: once it doesn't have a node, nothing calls back into the node's object.
+    // Children go before their parents, so the nodes the server has removed are always whole subtrees.
+    UaStatus status = OpcUa_Good;
+    size_t firstRemoved = nodes.size();
+    while (firstRemoved > 0)
+    {
+        UaNode* node = nodes[firstRemoved - 1];
+        const UaNodeId nodeId = node->nodeId();
+        void* methodHandle = 0;
+        if (node->nodeClass() == OpcUa_NodeClass_Method)
+            UA_Server_getNodeContext( m_server, nodeId.impl(), &methodHandle );
+        UA_StatusCode s = UA_Server_deleteNode( m_server, nodeId.impl(), /*deleteReferences*/ true );
+        if (s != UA_STATUSCODE_GOOD && s != UA_STATUSCODE_BADNODEIDUNKNOWN) // unknown: the server already took it away with its parent
+        {
+            LOG(Log::ERR) << "Couldn't delete node " << nodeId.toString().toUtf8() << ": " << UaStatus(s).toString().toUtf8();
+            status = s;
+            break;
+        }
+        if (methodHandle)
+        {
+            // no new call can come through it now; those in flight still use it, and its object
+            if (!MethodExecutor::waitForCalls( static_cast<MethodHandleUaNode*>(methodHandle) ))
+            {
+                // left to them: the handle is never reused, the method and the nodes above it stay
+                LOG(Log::ERR) << "Method " << nodeId.toString().toUtf8() << " still has calls in flight, not deleted";
+                status = UA_STATUSCODE_BADTIMEOUT;
+                break;
+            }
+            releaseMethodHandle( static_cast<MethodHandleUaNode*>(methodHandle) );
+        }
+        --firstRemoved;
+    }
+
+    // Then NodeManagerBase forgets what the server doesn't have anymore, even if the server stopped halfway,
+    // and the nodes which stay forget their references to and from the removed ones (amortized O(1) each)
+    const std::unordered_set<const UaNode*> removed( nodes.begin() + firstRemoved, nodes.end() );
+    for (size_t i = firstRemoved; i < nodes.size(); ++i)
+    {
+        UaNode* node = nodes[i];
+        if (!removed.count( node->m_parentNode ) && node->m_parentPosition != UaNode::NoPosition)
+            node->m_parentNode->removeReferenceAt( node, node->m_parentReferenceTypeIndex, node->m_parentPosition );
+        BOOST_FOREACH (const UaNode::Referencing& referencing, node->m_referencedBy)
+        {
+            if (!removed.count( referencing.source ))
+                referencing.source->removeReferenceAt( node, referencing.type, referencing.position );
+        }
+        BOOST_FOREACH (const UaNode::ReferencedTarget& reference, *node->referencedTargets())
+        {
+            if (!removed.count( reference.target ))
+                reference.target->forgetReferencing( node, reference.referenceTypeId.index(), UaNode::NoPosition );
+        }
+    }
+    for (std::vector<UaNode*>::const_reverse_iterator it = nodes.rbegin(); it != nodes.rend() - firstRemoved; ++it)
+    {
+        UaNode* node = *it;
+        {
+            boost::unique_lock<boost::shared_mutex> lock (m_nodeIndexLock);
+            if (!m_nodestore) // otherwise the server has removed it from the nodestore already
+                m_nodeIndex.erase( node->nodeId() );
+            m_listNodes.erase( m_listNodes.iterator_to(*node) );
+        }
+        node->m_parentNode = 0;
+        if (m_nodeArena && m_nodeArena->owns(node))
+            m_nodeArena->recycle( dynamic_cast<void*>(node) );
+        else
+            delete node;
+    }
+    LOG(Log::TRC) << "Deleted " << (nodes.size() - firstRemoved) << " of " << nodes.size() << " node(s)";
+    return status;
+}
+
+MethodHandleUaNode* NodeManagerBase::acquireMethodHandle( UaNode* object, UaNode* method )
+{
+    MethodHandleUaNode* handle;
+    {
+        boost::lock_guard<boost::mutex> lock (m_methodHandlesLock);
+        if (m_freeMethodHandles.empty())
+        {
+            m_methodHandles.push_back( MethodHandleUaNode() );
+            handle = &m_methodHandles.back();
+        }
+        else
+        {
+            handle = m_freeMethodHandles.back();
+            m_freeMethodHandles.pop_back();
+        }
+    }
+    handle->setUaNodes( static_cast<UaObject*>(object), static_cast<UaMethod*>(method) );
+    return handle;
+}
+
+void NodeManagerBase::releaseMethodHandle( MethodHandleUaNode* handle )
+{
+    handle->setUaNodes( 0, 0 );
+    boost::lock_guard<boost::mutex> lock (m_methodHandlesLock);
+    m_freeMethodHandles.push_back( handle );
+}
+
+void NodeManagerBase::enableStartupProfiling( const std::string& jsonPath )
+{
+    m_profiler.reset( new StartupProfiler );
+    m_profileJsonPath = jsonPath;
+    if (!StartupProfiler::countsAllocations())
+        LOG(Log::INF) << "Startup profiling on; allocations aren't counted in this build (see PROFILE_STARTUP_ALLOCATIONS)";
+}
+
+void NodeManagerBase::finishStartupProfiling()
+{
+    if (!m_profiler)
+        return;
+    LOG(Log::INF) << "Address space construction profile:\n" << m_profiler->summaryTable();
+    if (!m_profileJsonPath.empty())
+    {
+        try
+        {
+            m_profiler->writeJson( m_profileJsonPath );
+            LOG(Log::INF) << "Address space construction profile written to " << m_profileJsonPath;
+        }
+        catch (const std::exception& e)
+        {
+            LOG(Log::ERR) << e.what();
+        }
+    }
+    m_profiler.reset();
+}
+
+//! The folder and the per-variable objects of the diagnostic nodes published by enableVariableStatistics()
+class StatisticsObjectNode: public UaObject
+{
+public:
+    StatisticsObjectNode( const UaNodeId& nodeId, const UaString& name, bool isFolder ):
+        m_nodeId(nodeId),
+        m_browseName(nodeId.namespaceIndex(), name),
+        m_isFolder(isFolder) {}
+    virtual UaQualifiedName browseName() const { return m_browseName; }
+    virtual UaNodeId typeDefinitionId() const { return UaNodeId(m_isFolder ? UA_NS0ID_FOLDERTYPE : UA_NS0ID_BASEOBJECTTYPE, 0); }
+    virtual OpcUa_NodeClass nodeClass() const { return OpcUa_NodeClass_Object; }
+    virtual UaNodeId nodeId() const { return m_nodeId; }
+private:
+    UaNodeId m_nodeId;
+    UaQualifiedName m_browseName;
+    bool m_isFolder;
+};
+
+//! Read-only diagnostic variable, computed from a variable's statistics whenever it's read
+class StatisticsVariableNode: public OpcUa::BaseDataVariableType
+{
+public:
+    enum Quantity
+    {
+        Reads,
+        Writes,
+        Updates,
+        UpdateRate,
+        ReadLatency,
+        WriteLatency,
+        UpdateLatency,
+        NumQuantities
+    };
+
+    StatisticsVariableNode(
+        const UaNodeId& parentId,
+        Quantity quantity,
+        const std::shared_ptr<VariableStatistics>& statistics,
+        NodeManagerConfig* config ):
+        OpcUa::BaseDataVariableType(
+            UaNodeId( UaString( (parentId.toString().toUtf8()+"."+quantityName(quantity)).c_str() ), parentId.namespaceIndex() ),
+            quantityName(quantity), parentId.namespaceIndex(), UaVariant(), UA_ACCESSLEVELMASK_READ, config ),
+        m_quantity(quantity),
+        m_statistics(statistics)
+    {
+        setDataType( UaNodeId( quantity == UpdateRate ? OpcUaType_Double : OpcUaType_UInt64, 0 ) );
+        if (quantity >= ReadLatency)
+            setValueRank( 1 ); // histogram, see VariableStatistics::NumLatencyBuckets
+    }
+
+    static const char* quantityName( Quantity quantity )
+    {
+        static const char* names[NumQuantities] = {
+            "Reads", "Writes", "Updates", "UpdateRate", "ReadLatency", "WriteLatency", "UpdateLatency" };
+        return names[quantity];
+    }
+
+    virtual UaDataValue value( Session* session )
+    {
+        UA_DataValue dataValue;
+        UA_DataValue_init( &dataValue );
+        copyValueTo( &dataValue );
+        return UaDataValue( std::move( dataValue ) );
+    }
+
+    virtual UA_StatusCode copyValueTo( UA_DataValue* target )
+    {
+        UA_StatusCode status = computeValue( &target->value );
+        if (status == UA_STATUSCODE_GOOD)
+            stamp( target );
+        return status;
+    }
+
+    virtual UA_StatusCode copyValueTo( UA_DataValue* target, const UA_NumericRange& range )
+    {
+        UA_Variant whole;
+        UA_Variant_init( &whole );
+        UA_StatusCode status = computeValue( &whole );
+        if (status == UA_STATUSCODE_GOOD)
+            status = UA_Variant_copyRange( &whole, &target->value, range );
+        UA_Variant_deleteMembers( &whole );
+        if (status == UA_STATUSCODE_GOOD)
+            stamp( target );
+        return status;
+    }
+
+private:
+    UA_StatusCode computeValue( UA_Variant* out )
+    {
+        switch (m_quantity)
+        {
+        case Reads:
+        case Writes:
+        case Updates:
+        {
+            const UA_UInt64 count = m_statistics->count( static_cast<VariableStatistics::Operation>(m_quantity - Reads) );
+            return UA_Variant_setScalarCopy( out, &count, &UA_TYPES[UA_TYPES_UINT64] );
+        }
+        case UpdateRate:
+        {
+            const UA_Double rate = m_statistics->updateRate();
+            return UA_Variant_setScalarCopy( out, &rate, &UA_TYPES[UA_TYPES_DOUBLE] );
+        }
+        default:
+        {
+            UA_UInt64 histogram[VariableStatistics::NumLatencyBuckets];
+            m_statistics->latencyHistogram( static_cast<VariableStatistics::Operation>(m_quantity - ReadLatency), histogram );
+            return UA_Variant_setArrayCopy( out, histogram, VariableStatistics::NumLatencyBuckets, &UA_TYPES[UA_TYPES_UINT64] );
+        }
+        }
+    }
+
+    static void stamp( UA_DataValue* target )
+    {
+        target->hasValue = true;
+        target->status = OpcUa_Good;
+        target->hasStatus = true;
+        target->serverTimestamp = ValueClock::now().impl();
+        target->hasServerTimestamp = true;
+        target->sourceTimestamp = target->serverTimestamp;
+        target->hasSourceTimestamp = true;
+    }
+
+    const Quantity m_quantity;
+    const std::shared_ptr<VariableStatistics> m_statistics; // shared with the variable, so that deleting it leaves these readable
+};
+
+UaStatus NodeManagerBase::enableVariableStatistics()
+{
+    const UaNodeId folderId( "VariableStatistics", getNameSpaceIndex() );
+    std::vector<NodeAndReference> nodes;
+    UaNode* folder = getNode( folderId );
+    if (!folder)
+    {
+        folder = createNode<StatisticsObjectNode>( folderId, "VariableStatistics", true );
+        nodes.push_back( NodeAndReference( &m_serverRootNode, folder, OpcUaId_Organizes ) );
+    }
+
+    std::vector<OpcUa::BaseDataVariableType*> candidates;
+    {
+        boost::shared_lock<boost::shared_mutex> lock (m_nodeIndexLock);
+        BOOST_FOREACH( UaNode& node, m_listNodes )
+        {
+            OpcUa::BaseDataVariableType* variable = dynamic_cast<OpcUa::BaseDataVariableType*>( &node );
+            if (variable && !dynamic_cast<StatisticsVariableNode*>( variable ))
+                candidates.push_back( variable );
+        }
+    }
+
+    // instrumented are the variables whose statistics are published: a call which failed leaves none of its own
+    std::vector<OpcUa::BaseDataVariableType*> variables;
+    std::vector<UaNodeId> objectIds;
+    BOOST_FOREACH( OpcUa::BaseDataVariableType* variable, candidates )
+    {
+        const std::string name = variable->nodeId().toString().toUtf8();
+        const UaNodeId objectId( UaString( ("VariableStatistics."+name).c_str() ), getNameSpaceIndex() );
+        if (getNode( objectId ))
+            continue;
+        const std::shared_ptr<VariableStatistics> statistics = variable->enableStatistics();
+        UaNode* object = createNode<StatisticsObjectNode>( objectId, UaString( name.c_str() ), false );
+        nodes.push_back( NodeAndReference( folder, object, OpcUaId_HasComponent ) );
+        variables.push_back( variable );
+        objectIds.push_back( objectId );
+        for (int quantity = 0; quantity < StatisticsVariableNode::NumQuantities; ++quantity)
+            nodes.push_back( NodeAndReference(
+                    object,
+                    createNode<StatisticsVariableNode>( objectId, static_cast<StatisticsVariableNode::Quantity>(quantity), statistics, this ),
+                    OpcUaId_HasComponent ) );
+    }
+
+    UaStatus status = addNodesAndReferences( nodes );
+    if (status.isNotGood())
+    {
+        // what didn't make it into the address space isn't owned by anybody
+        if (!m_nodeArena)
+        {
+            BOOST_FOREACH( const NodeAndReference& entry, nodes )
+            {
+                if (getNode( entry.node->nodeId() ) != entry.node)
+                    delete entry.node;
+            }
+        }
+        // what did is removed, so that a retry publishes the statistics of these variables in full
+        BOOST_FOREACH( const UaNodeId& objectId, objectIds )
+            if (getNode( objectId ))
+                deleteSubtree( objectId );
+    }
+    else
+        LOG(Log::INF) << "Statistics of " << variables.size() << " variables published under " << folderId.toString().toUtf8();
+    return status;
+}
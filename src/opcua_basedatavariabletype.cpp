@@ -20,10 +20,48 @@
  */
 
 #include <opcua_basedatavariabletype.h>
+#include <utility>
+#include <valueclock.h>
+#include <cmath>
+#include <stdexcept>
+#include <limits>
+#include <cstdint>
 
 namespace OpcUa
 {
 
+static UaDataValue initialDataValue( const UaVariant& initialValue )
+{
+    const UaDateTime now = ValueClock::now();
+    return UaDataValue( initialValue, OpcUa_Good, now, now );
+}
+
+//! NaN for anything but a numeric scalar
+static double numericValue( const UA_Variant& v )
+{
+    if (!v.type || !UA_Variant_isScalar( &v ))
+        return std::numeric_limits<double>::quiet_NaN();
+    switch (v.type->typeIndex)
+    {
+    case UA_TYPES_SBYTE:  return *static_cast<const UA_SByte*>( v.data );
+    case UA_TYPES_BYTE:   return *static_cast<const UA_Byte*>( v.data );
+    case UA_TYPES_INT16:  return *static_cast<const UA_Int16*>( v.data );
+    case UA_TYPES_UINT16: return *static_cast<const UA_UInt16*>( v.data );
+    case UA_TYPES_INT32:  return *static_cast<const UA_Int32*>( v.data );
+    case UA_TYPES_UINT32: return *static_cast<const UA_UInt32*>( v.data );
+    case UA_TYPES_INT64:  return static_cast<double>( *static_cast<const UA_Int64*>( v.data ) );
+    case UA_TYPES_UINT64: return static_cast<double>( *static_cast<const UA_UInt64*>( v.data ) );
+    case UA_TYPES_FLOAT:  return *static_cast<const UA_Float*>( v.data );
+    case UA_TYPES_DOUBLE: return *static_cast<const UA_Double*>( v.data );
+    default:              return std::numeric_limits<double>::quiet_NaN();
+    }
+}
+
+static double numericValue( const UA_DataValue& dataValue )
+{
+    return dataValue.hasValue ? numericValue( dataValue.value ) : std::numeric_limits<double>::quiet_NaN();
+}
+
 BaseDataVariableType::BaseDataVariableType(
     const UaNodeId&    nodeId,
     const UaString&    name,
@@ -34,14 +72,44 @@ BaseDataVariableType::BaseDataVariableType(
     UaMutexRefCounted* pSharedMutex):
 
     m_browseName( browseNameNameSpaceIndex, name),
-    m_currentValue( initialValue, OpcUa_Good, UaDateTime::now(), UaDateTime::now() ),
+    m_currentValue( initialDataValue( initialValue ) ),
     m_nodeId (nodeId),
     m_typeDefinitionId( OpcUaType_Variant, 0),
     m_valueRank(-1), // by default: scalar
-    m_accessLevel(accessLevel)
+    m_accessLevel(accessLevel),
+    m_copyStoredValueOnRead(false),
+    m_deadband(-1),
+    m_lastReportedValue(std::numeric_limits<double>::quiet_NaN()),
+    m_lastReportedStatus(OpcUa_Good),
+    m_suppressedUpdates(0),
+    m_statistics(0)
 
 {
+    m_deadbandLock.clear();
+}
+
+BaseDataVariableType::BaseDataVariableType(
+    const UaNodeId&    nodeId,
+    const UaString&    name,
+    OpcUa_UInt16       browseNameNameSpaceIndex,
+    OpcUa_Byte         accessLevel,
+    NodeManagerConfig* pNodeConfig,
+    UaMutexRefCounted* pSharedMutex):
 
+    m_browseName( browseNameNameSpaceIndex, name),
+    m_nodeId (nodeId),
+    m_typeDefinitionId( OpcUaType_Variant, 0),
+    m_valueRank(-1), // by default: scalar
+    m_accessLevel(accessLevel),
+    m_copyStoredValueOnRead(false),
+    m_deadband(-1),
+    m_lastReportedValue(std::numeric_limits<double>::quiet_NaN()),
+    m_lastReportedStatus(OpcUa_Good),
+    m_suppressedUpdates(0),
+    m_statistics(0)
+
+{
+    m_deadbandLock.clear();
 }
 
 
@@ -51,9 +119,11 @@ UaStatus BaseDataVariableType::setValue(
     OpcUa_Boolean checkAccessLevel
 )
 {
+    VariableStatistics::Scope timing( session ? 0 : statistics(), VariableStatistics::Update );
     if (!checkAccessLevel || (m_accessLevel & UA_ACCESSLEVELMASK_WRITE))
     {
-        m_currentValue = dataValue;
+        const UA_DataValue& incoming = *dataValue.impl();
+        suppressedByDeadband( session, incoming.status, numericValue( incoming ), [&]() { m_currentValue = dataValue; } );
         return OpcUa_Good;
     }
     else
@@ -61,10 +131,108 @@ UaStatus BaseDataVariableType::setValue(
 
 }
 
+bool BaseDataVariableType::withinDeadband( Session* session, OpcUa_StatusCode status, double value ) const
+{
+    if (session || m_deadband.load( std::memory_order_relaxed ) < 0)
+        return false;
+    lockDeadband();
+    const bool within = withinDeadbandLocked( session, status, value );
+    unlockDeadband();
+    return within;
+}
+
+bool BaseDataVariableType::withinDeadbandLocked( Session* session, OpcUa_StatusCode status, double value ) const
+{
+    const double deadband = m_deadband.load( std::memory_order_relaxed );
+    return deadband >= 0 && !session &&
+            status == m_lastReportedStatus &&
+            std::fabs( value - m_lastReportedValue ) <= deadband; // false if either is NaN
+}
+
+UaStatus BaseDataVariableType::setValues( const Update* updates, size_t numUpdates )
+{
+    // one timestamp for the whole batch
+    const UaDateTime now = ValueClock::now();
+    UaStatus result = OpcUa_Good;
+    for (size_t i=0; i<numUpdates; ++i)
+    {
+        const Update& update = updates[i];
+        // dropped before building the value, setValue() would drop it anyway
+        if (update.variable->withinDeadband( 0, update.status, numericValue( *update.value->impl() ) ))
+        {
+            update.variable->m_suppressedUpdates.fetch_add( 1, std::memory_order_relaxed );
+            if (VariableStatistics* statistics = update.variable->statistics())
+                statistics->record( VariableStatistics::Update, 0 );
+            continue;
+        }
+        UaStatus status = update.variable->setValue( 0, UaDataValue( *update.value, update.status, now, now ), OpcUa_False );
+        if (!status.isGood() && result.isGood())
+            result = status;
+    }
+    return result;
+}
+
+void BaseDataVariableType::setAbsoluteDeadband( double deadband )
+{
+    if (deadband < 0)
+        throw std::invalid_argument( "deadband can't be negative" );
+    // compare with what the variable holds now; subclasses may keep it elsewhere than in m_currentValue
+    const UaDataValue currentValue = value( 0 );
+    const UA_DataValue& current = *currentValue.impl();
+    lockDeadband();
+    m_lastReportedValue = numericValue( current );
+    m_lastReportedStatus = current.status;
+    unlockDeadband();
+    m_deadband.store( deadband );
+}
+
+void BaseDataVariableType::setPercentDeadband( double percent, double euLow, double euHigh )
+{
+    if (percent < 0 || percent > 100 || euHigh < euLow)
+        throw std::invalid_argument( "percent deadband needs 0 <= percent <= 100 and euLow <= euHigh" );
+    setAbsoluteDeadband( percent / 100.0 * (euHigh - euLow) );
+}
+
+void BaseDataVariableType::clearDeadband()
+{
+    m_deadband.store( -1 );
+}
+
+boost::mutex& BaseDataVariableType::writeLock() const
+{
+    static const size_t NumWriteLocks = 64;
+    static boost::mutex writeLocks[NumWriteLocks];
+    return writeLocks[(reinterpret_cast<std::uintptr_t>( this ) / sizeof (BaseDataVariableType)) % NumWriteLocks];
+}
+
+std::shared_ptr<VariableStatistics> BaseDataVariableType::enableStatistics()
+{
+    if (!m_statisticsOwner)
+    {
+        m_statisticsOwner.reset( new VariableStatistics );
+        m_statistics.store( m_statisticsOwner.get(), std::memory_order_release );
+    }
+    return m_statisticsOwner;
+}
+
 UaDataValue BaseDataVariableType::value(Session* session)
 {
     return m_currentValue.clone();
 }
 
+UA_StatusCode BaseDataVariableType::copyValueTo( UA_DataValue* target )
+{
+    if (!readsStoredValue())
+        return value( 0 ).copyTo( target );
+    return m_currentValue.copyTo( target );
+}
+
+UA_StatusCode BaseDataVariableType::copyValueTo( UA_DataValue* target, const UA_NumericRange& range )
+{
+    if (!readsStoredValue())
+        return value( 0 ).copyTo( target, range );
+    return m_currentValue.copyTo( target, range );
+}
+
 }
 
@@ -23,28 +23,45 @@
 #include <iostream>
 #include <sstream>
 #include <open62541_compat_common.h>
+#include <internedstrings.h>
 
 
 
-UaQualifiedName::UaQualifiedName(int ns, const UaString& name):
-    m_unqualifiedName( name )
+UaQualifiedName::UaQualifiedName(int ns, const UaString& name)
 {
-    m_impl.name = *m_unqualifiedName.impl();
+    m_impl.name = InternedStrings::intern( *name.impl() );
     m_impl.namespaceIndex = ns;
 }
 
-UaLocalizedText::UaLocalizedText( const char* locale, const char* text) 
+UaQualifiedName::UaQualifiedName(const UaQualifiedName& other):
+    m_impl(other.m_impl)
 {
-    m_impl = UA_LOCALIZEDTEXT_ALLOC( locale, text ); 
+    InternedStrings::acquire( m_impl.name );
 }
 
-UaLocalizedText::~UaLocalizedText ()
+void UaQualifiedName::operator=(const UaQualifiedName& other)
+{
+    InternedStrings::acquire( other.m_impl.name );
+    InternedStrings::release( m_impl.name );
+    m_impl = other.m_impl;
+}
+
+UaQualifiedName::~UaQualifiedName()
 {
-    UA_LocalizedText_deleteMembers( &m_impl );
+    InternedStrings::release( m_impl.name );
 }
 
-UaNode::UaNode ()
+UaLocalizedText::UaLocalizedText( const char* locale, const char* text) 
+{
+    m_impl.locale = InternedStrings::intern( locale );
+    m_impl.text = InternedStrings::intern( text );
+}
+
+UaLocalizedText::~UaLocalizedText ()
 {
+    // both strings are interned: nothing to free, only the references to drop
+    InternedStrings::release( m_impl.locale );
+    InternedStrings::release( m_impl.text );
 }
 
 namespace OpcUa
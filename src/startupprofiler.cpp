@@ -0,0 +1,202 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * startupprofiler.cpp
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <startupprofiler.h>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef OPEN62541_COMPAT_COUNT_ALLOCATIONS
+
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+thread_local std::uint64_t allocationsOfThisThread = 0;
+}
+
+void* operator new( std::size_t size )
+{
+    ++allocationsOfThisThread;
+    void* p = std::malloc( size ? size : 1 );
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[]( std::size_t size )
+{
+    return operator new( size );
+}
+
+void operator delete( void* p ) noexcept
+{
+    std::free( p );
+}
+
+void operator delete[]( void* p ) noexcept
+{
+    std::free( p );
+}
+
+bool StartupProfiler::countsAllocations() { return true; }
+std::uint64_t StartupProfiler::threadAllocations() { return allocationsOfThisThread; }
+
+#else
+
+bool StartupProfiler::countsAllocations() { return false; }
+std::uint64_t StartupProfiler::threadAllocations() { return 0; }
+
+#endif // OPEN62541_COMPAT_COUNT_ALLOCATIONS
+
+StartupProfiler::Scope::Scope( StartupProfiler* profiler, Phase phase, NodeKind kind ):
+    m_profiler(profiler),
+    m_phase(phase),
+    m_kind(kind),
+    m_startAllocations(0)
+{
+    if (m_profiler)
+    {
+        m_startAllocations = threadAllocations();
+        m_start = std::chrono::steady_clock::now();
+    }
+}
+
+StartupProfiler::Scope::~Scope()
+{
+    finish();
+}
+
+void StartupProfiler::Scope::finish()
+{
+    if (m_profiler)
+    {
+        const std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - m_start;
+        m_profiler->record( m_phase, m_kind, elapsed.count(), threadAllocations() - m_startAllocations );
+        m_profiler = 0;
+    }
+}
+
+StartupProfiler::StartupProfiler()
+{
+    reset();
+}
+
+void StartupProfiler::reset()
+{
+    for (int phase = 0; phase < NumPhases; ++phase)
+        for (int kind = 0; kind < NumNodeKinds; ++kind)
+        {
+            AtomicCounters& counters = m_counters[phase][kind];
+            counters.calls = 0;
+            counters.nanoseconds = 0;
+            counters.allocations = 0;
+        }
+}
+
+void StartupProfiler::record( Phase phase, NodeKind kind, std::uint64_t nanoseconds, std::uint64_t allocations )
+{
+    AtomicCounters& counters = m_counters[phase][kind];
+    counters.calls.fetch_add( 1, std::memory_order_relaxed );
+    counters.nanoseconds.fetch_add( nanoseconds, std::memory_order_relaxed );
+    counters.allocations.fetch_add( allocations, std::memory_order_relaxed );
+}
+
+StartupProfiler::Counters StartupProfiler::counters( Phase phase, NodeKind kind ) const
+{
+    const AtomicCounters& counters = m_counters[phase][kind];
+    Counters result;
+    result.calls = counters.calls.load( std::memory_order_relaxed );
+    result.nanoseconds = counters.nanoseconds.load( std::memory_order_relaxed );
+    result.allocations = counters.allocations.load( std::memory_order_relaxed );
+    return result;
+}
+
+const char* StartupProfiler::phaseName( Phase phase )
+{
+    static const char* names[NumPhases] = { "parentLookup", "preparation", "serverInsertion", "registration" };
+    return names[phase];
+}
+
+const char* StartupProfiler::nodeKindName( NodeKind kind )
+{
+    static const char* names[NumNodeKinds] = { "object", "variable", "method", "property", "unknown" };
+    return names[kind];
+}
+
+std::string StartupProfiler::summaryTable() const
+{
+    std::ostringstream table;
+    table << std::left << std::setw(16) << "phase" << std::setw(10) << "node" << std::right
+          << std::setw(12) << "calls" << std::setw(12) << "total[ms]" << std::setw(12) << "avg[us]"
+          << std::setw(14) << (countsAllocations() ? "allocations" : "allocs(n/a)") << std::setw(12) << "allocs/call" << "\n";
+    table << std::fixed << std::setprecision(3);
+    for (int phase = 0; phase < NumPhases; ++phase)
+    {
+        Counters total = { 0, 0, 0 };
+        for (int kind = 0; kind < NumNodeKinds; ++kind)
+        {
+            const Counters c = counters( static_cast<Phase>(phase), static_cast<NodeKind>(kind) );
+            if (!c.calls)
+                continue;
+            table << std::left << std::setw(16) << phaseName(static_cast<Phase>(phase)) << std::setw(10) << nodeKindName(static_cast<NodeKind>(kind))
+                  << std::right << std::setw(12) << c.calls << std::setw(12) << c.nanoseconds / 1e6 << std::setw(12) << c.nanoseconds / 1e3 / c.calls
+                  << std::setw(14) << c.allocations << std::setw(12) << double(c.allocations) / c.calls << "\n";
+            total.calls += c.calls;
+            total.nanoseconds += c.nanoseconds;
+            total.allocations += c.allocations;
+        }
+        if (total.calls)
+            table << std::left << std::setw(16) << phaseName(static_cast<Phase>(phase)) << std::setw(10) << "(all)"
+                  << std::right << std::setw(12) << total.calls << std::setw(12) << total.nanoseconds / 1e6 << std::setw(12) << total.nanoseconds / 1e3 / total.calls
+                  << std::setw(14) << total.allocations << std::setw(12) << double(total.allocations) / total.calls << "\n";
+    }
+    return table.str();
+}
+
+std::string StartupProfiler::toJson() const
+{
+    std::ostringstream json;
+    json << "{\"countsAllocations\":" << (countsAllocations() ? "true" : "false") << ",\"phases\":[";
+    bool first = true;
+    for (int phase = 0; phase < NumPhases; ++phase)
+        for (int kind = 0; kind < NumNodeKinds; ++kind)
+        {
+            const Counters c = counters( static_cast<Phase>(phase), static_cast<NodeKind>(kind) );
+            if (!c.calls)
+                continue;
+            if (!first)
+                json << ",";
+            first = false;
+            json << "{\"phase\":\"" << phaseName(static_cast<Phase>(phase)) << "\",\"nodeKind\":\"" << nodeKindName(static_cast<NodeKind>(kind))
+                 << "\",\"calls\":" << c.calls << ",\"nanoseconds\":" << c.nanoseconds << ",\"allocations\":" << c.allocations << "}";
+        }
+    json << "]}";
+    return json.str();
+}
+
+void StartupProfiler::writeJson( const std::string& path ) const
+{
+    std::ofstream file( path.c_str() );
+    file << toJson() << "\n";
+    file.close();
+    if (!file)
+        throw std::runtime_error("StartupProfiler: couldn't write "+path);
+}
@@ -9,76 +9,235 @@
  *  of concerns.
  */
 
-#include <stdexcept>
+#include <cstring>
+#include <utility>
 
 #include <LogIt.h>
 #include <uadatavalue.h>
 
-UaDataValue::UaDataValue( const UaVariant& variant, OpcUa_StatusCode statusCode, const UaDateTime& serverTime, const UaDateTime& sourceTime ):
-m_lock()
+UaDataValue::UaDataValue():
+            m_snapshot( emptySnapshot() ),
+            m_lock(),
+            m_sequence(0)
 {
     m_lock.clear();
-    m_impl = UA_DataValue_new ();
-    if (!m_impl)
-        throw std::runtime_error( "UA_DataValue_new returned 0" );
+    publish();
+}
+
+UaDataValue::UaDataValue( const UaVariant& variant, OpcUa_StatusCode statusCode, const UaDateTime& sourceTime, const UaDateTime& serverTime ):
+m_snapshot(0),
+m_lock(),
+m_sequence(0)
+{
+    m_lock.clear();
+    UA_DataValue value;
+    UA_DataValue_init( &value );
 
     // TODO: duplicate the variant
-    UA_Variant_copy( variant.impl(), &m_impl->value );
-    LOG(Log::TRC) << "After UA_Variant_copy: src="<<variant.impl()<<" src.data="<<variant.impl()->data<<" dst="<<&m_impl->value<<" dst.data="<<m_impl->value.data;
+    UA_Variant_copy( variant.impl(), &value.value );
+    LOG(Log::TRC) << "After UA_Variant_copy: src="<<variant.impl()<<" src.data="<<variant.impl()->data<<" dst.data="<<value.value.data;
 
-    m_impl->status = statusCode;
-    m_impl->hasStatus = 1;
+    value.status = statusCode;
+    value.hasStatus = 1;
 
-    // TODO: serverTime passing not implemented,
-    // TODO: sourceTime passing not implemented
+    value.sourceTimestamp = sourceTime.impl();
+    value.hasSourceTimestamp = 1;
+    value.serverTimestamp = serverTime.impl();
+    value.hasServerTimestamp = 1;
 
-    m_impl->hasValue = 1;
+    value.hasValue = 1;
+    m_snapshot = ValueSnapshot::adopt( value );
+    publish();
 
 }
 
 UaDataValue::UaDataValue( const UaDataValue& other ):
-            m_lock()
+            m_snapshot( other.acquireSnapshot() ),
+            m_lock(),
+            m_sequence(0)
 {
     m_lock.clear();
-    m_impl = UA_DataValue_new ();
-    // LOG(Log::INF) << "allocated new UA_DataValue @ " <<  m_impl;
-    UA_DataValue_copy( other.m_impl, m_impl );
+    publish();
+}
+
+UaDataValue::UaDataValue( UaDataValue&& other ):
+            m_snapshot( other.takeSnapshot() ),
+            m_lock(),
+            m_sequence(0)
+{
+    m_lock.clear();
+    publish();
+}
+
+UaDataValue::UaDataValue( UA_DataValue&& value ):
+            m_snapshot( ValueSnapshot::adopt( value ) ),
+            m_lock(),
+            m_sequence(0)
+{
+    m_lock.clear();
+    publish();
 }
 
 void UaDataValue:: operator=(const UaDataValue& other )
+{
+    if (&other == this)
+        return;
+    replaceSnapshot( other.acquireSnapshot() );
+}
+
+void UaDataValue:: operator=( UaDataValue&& other )
+{
+    if (&other == this)
+        return;
+    replaceSnapshot( other.takeSnapshot() );
+}
+
+void UaDataValue::replaceSnapshot( ValueSnapshot* incoming )
 {
     while (m_lock.test_and_set(std::memory_order_acquire));  // acquire lock
-    if (m_impl)
-    {
-        UA_DataValue_deleteMembers (m_impl);
-        UA_DataValue_delete( m_impl );
-        m_impl = 0;
-    }
-    m_impl = UA_DataValue_new ();
-    // LOG(Log::INF) << "allocated new UA_DataValue @ " <<  m_impl;
-    UA_DataValue_copy( other.m_impl, m_impl );
+    ValueSnapshot* replaced = m_snapshot.exchange( incoming );
+    publish();
     m_lock.clear(std::memory_order_release);
+    // readers may still be copying from it
+    EpochReclaimer::instance().retire( replaced );
+}
 
+ValueSnapshot* UaDataValue::acquireSnapshot() const
+{
+    EpochReclaimer::ReadSection readSection;
+    ValueSnapshot* snapshot = m_snapshot.load();
+    snapshot->acquire();
+    return snapshot;
 }
 
-UaDataValue UaDataValue::clone()
+ValueSnapshot* UaDataValue::takeSnapshot()
 {
     while (m_lock.test_and_set(std::memory_order_acquire));  // acquire lock
-    UaDataValue aCopy ( *this );
+    ValueSnapshot* taken = m_snapshot.exchange( emptySnapshot() );
+    publish();
     m_lock.clear(std::memory_order_release);
-    return aCopy;
+    return taken;
+}
 
+static ValueSnapshot* newEmptySnapshot()
+{
+    UA_DataValue value;
+    UA_DataValue_init( &value );
+    return ValueSnapshot::adopt( value );
 }
 
-UaDataValue:: ~UaDataValue ()
+ValueSnapshot* UaDataValue::emptySnapshot()
 {
-    if (m_impl)
+    static ValueSnapshot* empty = newEmptySnapshot(); // this first reference is never dropped
+    empty->acquire();
+    return empty;
+}
+
+void UaDataValue::publish()
+{
+    const UA_DataValue& current = m_snapshot.load( std::memory_order_relaxed )->value();
+    const UA_Variant& value = current.value;
+    const bool publishable =
+            current.hasValue &&
+            value.type && value.type->pointerFree && value.type->memSize <= sizeof (std::uint64_t) &&
+            UA_Variant_isScalar( &value );
+
+    std::uint64_t words[NumPublishedWords] = { 0, 0, 0, 0, 0 };
+    if (publishable)
     {
-        UA_DataValue_deleteMembers( m_impl );
-        UA_DataValue_delete( m_impl );
-        m_impl = 0;
+        words[PublishedType] = reinterpret_cast<std::uintptr_t>( value.type );
+        std::memcpy( &words[PublishedScalar], value.data, value.type->memSize );
+        words[PublishedStatusAndFlags] =
+                std::uint64_t(current.status) |
+                std::uint64_t(current.hasStatus) << 32 |
+                std::uint64_t(current.hasSourceTimestamp) << 33 |
+                std::uint64_t(current.hasServerTimestamp) << 34;
+        words[PublishedSourceTime] = current.sourceTimestamp;
+        words[PublishedServerTime] = current.serverTimestamp;
     }
 
+    const unsigned int sequence = m_sequence.load( std::memory_order_relaxed );
+    m_sequence.store( sequence + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+    for (int i = 0; i < NumPublishedWords; ++i)
+        m_published[i].store( words[i], std::memory_order_relaxed );
+    m_sequence.store( sequence + 2, std::memory_order_release );
 }
 
+bool UaDataValue::readPublished( UA_DataValue* target, UA_StatusCode& status ) const
+{
+    std::uint64_t words[NumPublishedWords];
+    for (;;)
+    {
+        const unsigned int before = m_sequence.load( std::memory_order_acquire );
+        if (before & 1)
+            continue; // a writer is publishing right now; nothing is held, so just look again
+        for (int i = 0; i < NumPublishedWords; ++i)
+            words[i] = m_published[i].load( std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_acquire );
+        if (m_sequence.load( std::memory_order_relaxed ) == before)
+            break;
+    }
+    if (!words[PublishedType])
+        return false;
 
+    const UA_DataType* type = reinterpret_cast<const UA_DataType*>( static_cast<std::uintptr_t>(words[PublishedType]) );
+    UA_DataValue_init( target );
+    void* data = UA_new( type );
+    if (!data)
+    {
+        status = UA_STATUSCODE_BADOUTOFMEMORY;
+        return true;
+    }
+    std::memcpy( data, &words[PublishedScalar], type->memSize );
+    UA_Variant_setScalar( &target->value, data, type );
+    target->hasValue = true;
+    target->status = static_cast<UA_StatusCode>( words[PublishedStatusAndFlags] & 0xFFFFFFFF );
+    target->hasStatus = (words[PublishedStatusAndFlags] >> 32) & 1;
+    target->hasSourceTimestamp = (words[PublishedStatusAndFlags] >> 33) & 1;
+    target->hasServerTimestamp = (words[PublishedStatusAndFlags] >> 34) & 1;
+    target->sourceTimestamp = static_cast<UA_DateTime>( words[PublishedSourceTime] );
+    target->serverTimestamp = static_cast<UA_DateTime>( words[PublishedServerTime] );
+    status = UA_STATUSCODE_GOOD;
+    return true;
+}
+
+UaDataValue UaDataValue::clone()
+{
+    return UaDataValue( *this );
+}
+
+UA_StatusCode UaDataValue::copyTo( UA_DataValue* target )
+{
+    UA_StatusCode status;
+    if (readPublished( target, status ))
+        return status;
+    EpochReclaimer::ReadSection readSection;
+    return UA_DataValue_copy( &m_snapshot.load()->value(), target );
+}
+
+UA_StatusCode UaDataValue::copyTo( UA_DataValue* target, const UA_NumericRange& range )
+{
+    EpochReclaimer::ReadSection readSection;
+    const UA_DataValue& current = m_snapshot.load()->value();
+    UA_DataValue_init( target );
+    if (current.hasValue)
+    {
+        UA_StatusCode status = UA_Variant_copyRange( &current.value, &target->value, range );
+        if (status != UA_STATUSCODE_GOOD)
+            return status;
+    }
+    target->hasValue = current.hasValue;
+    target->status = current.status;
+    target->hasStatus = current.hasStatus;
+    target->sourceTimestamp = current.sourceTimestamp;
+    target->hasSourceTimestamp = current.hasSourceTimestamp;
+    target->serverTimestamp = current.serverTimestamp;
+    target->hasServerTimestamp = current.hasServerTimestamp;
+    return UA_STATUSCODE_GOOD;
+}
+
+UaDataValue:: ~UaDataValue ()
+{
+    m_snapshot.load()->release();
+}
@@ -7,6 +7,7 @@
 
 
 #include <uadatavariablecache.h>
+#include <internedstrings.h>
 #include <stdexcept>
 
 
@@ -17,17 +18,33 @@ UaPropertyMethodArgument::UaPropertyMethodArgument  (
 			OpcUa_UInt32   numberOfArguments,
 			ArgumentType   argumentType):
 			m_nodeId(nodeId),
-			m_numberArguments( numberOfArguments ),
 			m_browseName(0, "args"),
-			m_impl( new UA_Argument* [ numberOfArguments] ),
+			m_impl( numberOfArguments ),
 			m_argumentType(argumentType)
 {
 
 	for (unsigned int i=0; i<numberOfArguments; ++i)
-		m_impl[i] = UA_Argument_new();
+		UA_Argument_init( &m_impl[i] );
 
 }
 
+UaPropertyMethodArgument::~UaPropertyMethodArgument ()
+{
+	// the data types and array dimensions are owned, the names and descriptions are references to interned strings, see setArgument()
+	for (unsigned int i=0; i<m_impl.size(); ++i)
+	{
+		UA_NodeId_deleteMembers( &m_impl[i].dataType );
+		UA_Array_delete( m_impl[i].arrayDimensions, m_impl[i].arrayDimensionsSize, &UA_TYPES[UA_TYPES_UINT32] );
+		if (m_impl[i].name.data)
+			InternedStrings::release( m_impl[i].name );
+		if (m_impl[i].description.locale.data)
+		{
+			InternedStrings::release( m_impl[i].description.locale );
+			InternedStrings::release( m_impl[i].description.text );
+		}
+	}
+}
+
 OpcUa_StatusCode UaPropertyMethodArgument::setArgument 	(
 			OpcUa_UInt32  	        index,
 			const UaString &  	    name,
@@ -37,15 +54,44 @@ OpcUa_StatusCode UaPropertyMethodArgument::setArgument 	(
 			const UaLocalizedText & description
 		)
 {
-	if (index >= m_numberArguments)
+	if (index >= m_impl.size())
 		return OpcUa_BadInvalidArgument; // TODO more refined error code
 
+	UA_Argument& argument = m_impl[index];
+	UA_NodeId_deleteMembers( &argument.dataType );
+	if( UA_NodeId_copy(dataType.pimpl(), &argument.dataType) != OpcUa_Good )
+		return OpcUa_Bad;
 
-	m_impl[index]->dataType = dataType.impl();
+	// objects of one class all have the same argument names, so they're interned rather than copied
+	const UA_String& internedName = InternedStrings::intern( *name.impl() );
+	if (argument.name.data)
+		InternedStrings::release( argument.name );
+	argument.name = internedName;
+	argument.valueRank = valueRank;
 
-	if( UA_String_copy(name.impl(), &m_impl[index]->name) != OpcUa_Good )
-		return OpcUa_Bad;
-	m_impl[index]->valueRank = valueRank;
+	UA_Array_delete( argument.arrayDimensions, argument.arrayDimensionsSize, &UA_TYPES[UA_TYPES_UINT32] );
+	argument.arrayDimensions = 0;
+	argument.arrayDimensionsSize = 0;
+	if (arrayDimensions.size() > 0)
+	{
+		argument.arrayDimensions = static_cast<OpcUa_UInt32*>( UA_Array_new( arrayDimensions.size(), &UA_TYPES[UA_TYPES_UINT32] ) );
+		if (!argument.arrayDimensions)
+			return OpcUa_Bad;
+		argument.arrayDimensionsSize = arrayDimensions.size();
+		for (size_t i=0; i<arrayDimensions.size(); ++i)
+			argument.arrayDimensions[i] = arrayDimensions[i];
+	}
+
+	// interned as well; locale and text are always set together
+	const UA_String& internedLocale = InternedStrings::intern( description.impl()->locale );
+	const UA_String& internedText = InternedStrings::intern( description.impl()->text );
+	if (argument.description.locale.data)
+	{
+		InternedStrings::release( argument.description.locale );
+		InternedStrings::release( argument.description.text );
+	}
+	argument.description.locale = internedLocale;
+	argument.description.text = internedText;
 
 	return OpcUa_Good;
 
@@ -53,7 +99,7 @@ OpcUa_StatusCode UaPropertyMethodArgument::setArgument 	(
 
 const UA_Argument& UaPropertyMethodArgument::implArgument (unsigned int index) const
 {
-	if (index >= m_numberArguments)
+	if (index >= m_impl.size())
 		throw std::runtime_error("wrong arg");
-	return *m_impl[index];
+	return m_impl[index];
 }
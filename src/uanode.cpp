@@ -0,0 +1,301 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * uanode.cpp
+ *
+ *  This code used to live in open62541_compat.cpp since the beginning.
+ *  Now moved to this separate file, together with the compact storage of
+ *  references.
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <uanode.h>
+#include <stdexcept>
+#include <atomic>
+#include <algorithm>
+#include <limits>
+#include <new>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+namespace
+{
+
+// Order matters: the first ones are looked up without going through the registry, see indexOf()
+const OpcUa_UInt32 preregisteredReferenceTypes[] = { UA_NS0ID_HASCOMPONENT, UA_NS0ID_ORGANIZES, UA_NS0ID_HASPROPERTY };
+const size_t numPreregisteredReferenceTypes = sizeof preregisteredReferenceTypes / sizeof preregisteredReferenceTypes[0];
+
+//! Only grows: an entry, once published through m_size, never changes or moves, so readers don't lock
+class Registry
+{
+public:
+    Registry():
+        m_size(0)
+    {
+        std::fill( m_chunks, m_chunks + NumChunks, static_cast<UaNodeId*>(0) );
+        for (size_t i=0; i<numPreregisteredReferenceTypes; ++i)
+            append( UaNodeId(preregisteredReferenceTypes[i], 0) );
+    }
+
+    ReferenceTypeRegistry::Index indexOf( const UaNodeId& referenceTypeId )
+    {
+        size_t size = m_size.load( std::memory_order_acquire );
+        size_t index = find( referenceTypeId, 0, size );
+        if (index != size)
+            return index;
+        boost::lock_guard<boost::mutex> lock (m_lock);
+        // registered by someone else meanwhile?
+        const size_t sizeNow = m_size.load( std::memory_order_relaxed );
+        index = find( referenceTypeId, size, sizeNow );
+        if (index != sizeNow)
+            return index;
+        if (sizeNow > std::numeric_limits<ReferenceTypeRegistry::Index>::max())
+            throw std::runtime_error("ReferenceTypeRegistry: too many reference types");
+        append( referenceTypeId );
+        return sizeNow;
+    }
+
+    bool find( const UaNodeId& referenceTypeId, ReferenceTypeRegistry::Index& index ) const
+    {
+        const size_t size = m_size.load( std::memory_order_acquire );
+        const size_t found = find( referenceTypeId, 0, size );
+        if (found == size)
+            return false;
+        index = found;
+        return true;
+    }
+
+    const UaNodeId& nodeId( ReferenceTypeRegistry::Index index ) const
+    {
+        if (index >= m_size.load( std::memory_order_acquire ))
+            throw std::out_of_range("ReferenceTypeRegistry: no such reference type");
+        return entry( index );
+    }
+
+private:
+    enum { ChunkSize = 64, NumChunks = (std::numeric_limits<ReferenceTypeRegistry::Index>::max() + 1) / ChunkSize };
+
+    const UaNodeId& entry( size_t index ) const { return m_chunks[index / ChunkSize][index % ChunkSize]; }
+
+    size_t find( const UaNodeId& referenceTypeId, size_t from, size_t to ) const
+    {
+        for (size_t i=from; i<to; ++i)
+            if (entry(i) == referenceTypeId)
+                return i;
+        return to;
+    }
+
+    //! Under m_lock (or from the constructor): fills the entry first, then publishes it
+    void append( const UaNodeId& referenceTypeId )
+    {
+        const size_t index = m_size.load( std::memory_order_relaxed );
+        UaNodeId*& chunk = m_chunks[index / ChunkSize];
+        if (!chunk)
+            chunk = static_cast<UaNodeId*>( ::operator new( ChunkSize * sizeof(UaNodeId) ) ); // never freed, see registry()
+        new (chunk + index % ChunkSize) UaNodeId( referenceTypeId );
+        m_size.store( index + 1, std::memory_order_release );
+    }
+
+    boost::mutex m_lock; // serializes registrations
+    std::atomic<size_t> m_size;
+    UaNodeId* m_chunks[NumChunks];
+};
+
+Registry& registry()
+{
+    static Registry* instance = new Registry; // never destroyed, references to its NodeIds are handed out
+    return *instance;
+}
+
+//! True and the index if given reference type is one of the preregistered ones, looked up without the registry
+bool findPreregistered( const UaNodeId& referenceTypeId, ReferenceTypeRegistry::Index& index )
+{
+    const UA_NodeId* id = referenceTypeId.pimpl();
+    if (id->namespaceIndex != 0 || id->identifierType != UA_NODEIDTYPE_NUMERIC)
+        return false;
+    for (size_t i=0; i<numPreregisteredReferenceTypes; ++i)
+    {
+        if (id->identifier.numeric == preregisteredReferenceTypes[i])
+        {
+            index = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+ReferenceTypeRegistry::Index ReferenceTypeRegistry::indexOf( const UaNodeId& referenceTypeId )
+{
+    Index index;
+    if (findPreregistered( referenceTypeId, index ))
+        return index;
+    return registry().indexOf( referenceTypeId );
+}
+
+bool ReferenceTypeRegistry::find( const UaNodeId& referenceTypeId, Index& index )
+{
+    return findPreregistered( referenceTypeId, index ) || registry().find( referenceTypeId, index );
+}
+
+const UaNodeId& ReferenceTypeRegistry::nodeId( Index index )
+{
+    return registry().nodeId( index );
+}
+
+const OpcUa_UInt32 UaNode::NoPosition;
+
+UaNode::UaNode ():
+    m_parentNode(0),
+    m_parentReferenceTypeIndex(0),
+    m_parentPosition(NoPosition)
+{
+}
+
+namespace
+{
+
+struct ByType
+{
+    template<typename Group>
+    bool operator()( const Group& group, ReferenceTypeRegistry::Index type ) const { return group.type < type; }
+};
+
+}
+
+OpcUa_UInt32 UaNode::appendReference( UaNode* targetNode, ReferenceTypeRegistry::Index type )
+{
+    std::vector<ReferencedTargets::Group>& groups = m_referenceTargets.m_groups;
+    std::vector<ReferencedTargets::Group>::iterator group = std::lower_bound( groups.begin(), groups.end(), type, ByType() );
+    if (group == groups.end() || group->type != type)
+    {
+        // a new group: only moves the few groups behind it, not their references
+        ReferencedTargets::Group added;
+        added.type = type;
+        added.numRemoved = 0;
+        added.targets.push_back( ReferencedTarget( targetNode, type ) );
+        groups.insert( group, std::move(added) );
+        ++m_referenceTargets.m_size;
+        return 0;
+    }
+    if (group->targets.size() >= NoPosition)
+        throw std::length_error("UaNode: too many references of one type");
+    group->targets.push_back( ReferencedTarget( targetNode, type ) );
+    ++m_referenceTargets.m_size;
+    return group->targets.size() - 1;
+}
+
+void UaNode::addReferencedTarget( UaNode* targetNode, const UaNodeId& referenceTypeId )
+{
+    const ReferenceTypeRegistry::Index type = ReferenceTypeRegistry::indexOf( referenceTypeId );
+    targetNode->m_referencedBy.reserve( targetNode->m_referencedBy.size() + 1 ); // so that nothing throws once it's added
+    const Referencing referencing = { this, type, appendReference( targetNode, type ) };
+    targetNode->m_referencedBy.push_back( referencing );
+}
+
+UaNode::ReferencedTargetRange UaNode::referencedTargets( const UaNodeId& referenceTypeId ) const
+{
+    ReferenceTypeRegistry::Index type;
+    if (!ReferenceTypeRegistry::find( referenceTypeId, type ))
+        return ReferencedTargetRange( 0, 0, 0 ); // no node has references of a type never registered
+    const std::vector<ReferencedTargets::Group>& groups = m_referenceTargets.m_groups;
+    std::vector<ReferencedTargets::Group>::const_iterator group = std::lower_bound( groups.begin(), groups.end(), type, ByType() );
+    if (group == groups.end() || group->type != type)
+        return ReferencedTargetRange( 0, 0, 0 );
+    return ReferencedTargetRange( group->targets.data(), group->targets.data() + group->targets.size(), group->size() );
+}
+
+bool UaNode::removeReferencedTarget( UaNode* targetNode, const UaNodeId& referenceTypeId )
+{
+    ReferenceTypeRegistry::Index type;
+    if (!ReferenceTypeRegistry::find( referenceTypeId, type ))
+        return false;
+    const std::vector<ReferencedTargets::Group>& groups = m_referenceTargets.m_groups;
+    std::vector<ReferencedTargets::Group>::const_iterator group = std::lower_bound( groups.begin(), groups.end(), type, ByType() );
+    if (group == groups.end() || group->type != type)
+        return false;
+    for (OpcUa_UInt32 position = 0; position < group->targets.size(); ++position)
+    {
+        if (group->targets[position].target != targetNode)
+            continue;
+        if (targetNode->m_parentNode == this && targetNode->m_parentReferenceTypeIndex == type && targetNode->m_parentPosition == position)
+            targetNode->m_parentPosition = NoPosition; // NodeManagerBase won't look for it when deleting the target
+        else
+            targetNode->forgetReferencing( this, type, position );
+        removeReferenceAt( targetNode, type, position );
+        return true;
+    }
+    return false;
+}
+
+bool UaNode::removeReferenceAt( UaNode* targetNode, ReferenceTypeRegistry::Index type, OpcUa_UInt32 position )
+{
+    std::vector<ReferencedTargets::Group>& groups = m_referenceTargets.m_groups;
+    std::vector<ReferencedTargets::Group>::iterator group = std::lower_bound( groups.begin(), groups.end(), type, ByType() );
+    if (group == groups.end() || group->type != type || position >= group->targets.size() || group->targets[position].target != targetNode)
+        return false;
+    group->targets[position].target = 0;
+    ++group->numRemoved;
+    --m_referenceTargets.m_size;
+    if (group->size() == 0)
+        groups.erase( group );
+    else if (group->numRemoved > group->targets.size() / 2)
+        compact( *group ); // linear, but after as many removals as it squeezes out
+    return true;
+}
+
+void UaNode::compact( ReferencedTargets::Group& group )
+{
+    OpcUa_UInt32 to = 0;
+    for (OpcUa_UInt32 from = 0; from < group.targets.size(); ++from)
+    {
+        UaNode* target = group.targets[from].target;
+        if (!target)
+            continue;
+        if (from != to)
+        {
+            group.targets[to] = group.targets[from];
+            if (target->m_parentNode == this && target->m_parentReferenceTypeIndex == group.type && target->m_parentPosition == from)
+                target->m_parentPosition = to;
+            else
+            {
+                for (std::vector<Referencing>::iterator it = target->m_referencedBy.begin(); it != target->m_referencedBy.end(); ++it)
+                {
+                    if (it->source == this && it->type == group.type && it->position == from)
+                    {
+                        it->position = to;
+                        break;
+                    }
+                }
+            }
+        }
+        ++to;
+    }
+    group.targets.erase( group.targets.begin() + to, group.targets.end() );
+    group.numRemoved = 0;
+}
+
+void UaNode::forgetReferencing( const UaNode* source, ReferenceTypeRegistry::Index type, OpcUa_UInt32 position )
+{
+    for (std::vector<Referencing>::iterator it = m_referencedBy.begin(); it != m_referencedBy.end(); ++it)
+    {
+        if (it->source == source && it->type == type && (position == NoPosition || it->position == position))
+        {
+            *it = m_referencedBy.back(); // their order doesn't matter
+            m_referencedBy.pop_back();
+            return;
+        }
+    }
+}
@@ -12,6 +12,7 @@
 #include <uanodeid.h>
 #include <open62541_compat_common.h>
 #include <boost/lexical_cast.hpp>
+#include <boost/functional/hash.hpp>
 
 UaNodeId::UaNodeId ( const UaString& stringAddress, int ns)
 {
@@ -40,6 +41,14 @@ UaNodeId::UaNodeId ( const UaNodeId & other)
 
 }
 
+UaNodeId::UaNodeId ( const UA_NodeId& other )
+{
+    UA_NodeId_init( &m_impl );
+    UA_StatusCode status = UA_NodeId_copy( &other, &this->m_impl );
+    if (status != UA_STATUSCODE_GOOD)
+        throw alloc_error();
+}
+
 const UaNodeId& UaNodeId::operator=(const UaNodeId & other)
 {
     UA_NodeId_deleteMembers( &m_impl );
@@ -78,6 +87,24 @@ bool UaNodeId::operator==(const UaNodeId& other) const
     return UA_NodeId_equal( &m_impl, &other.m_impl );
 }
 
+std::size_t UaNodeId::hash( const UA_NodeId& nodeId )
+{
+    std::size_t seed = nodeId.namespaceIndex;
+    boost::hash_combine( seed, static_cast<int>(nodeId.identifierType) );
+    switch (nodeId.identifierType)
+    {
+    case UA_NODEIDTYPE_NUMERIC:
+        boost::hash_combine( seed, nodeId.identifier.numeric );
+        break;
+    case UA_NODEIDTYPE_STRING:
+        boost::hash_range( seed, nodeId.identifier.string.data, nodeId.identifier.string.data + nodeId.identifier.string.length );
+        break;
+    default:
+        break; // other identifier types all fall into one bucket per namespace; still correct with operator==
+    }
+    return seed;
+}
+
 UaString UaNodeId::toString() const
 {
     if (identifierType() == IdentifierType::OpcUa_IdentifierType_String)
@@ -0,0 +1,186 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * updatequeue.cpp
+ *
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <updatequeue.h>
+#include <valueclock.h>
+#include <LogIt.h>
+
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <stdint.h>
+#include <boost/bind.hpp>
+#include <boost/thread/locks.hpp>
+
+static size_t roundUpToPowerOf2( size_t n )
+{
+    size_t power = 1;
+    while (power < n)
+        power <<= 1;
+    return power;
+}
+
+UpdateQueue::UpdateQueue( size_t capacity ):
+    m_mask( roundUpToPowerOf2( capacity ) - 1 ),
+    m_cellStorage(0),
+    m_cells(0),
+    m_enqueuePosition(0),
+    m_pushed(0),
+    m_dropped(0),
+    m_dequeuePosition(0),
+    m_applied(0),
+    m_suppressed(0),
+    m_stopping(false)
+{
+    if (!capacity)
+        throw std::invalid_argument( "UpdateQueue: capacity can't be 0" );
+    // operator new doesn't honour alignas before C++17: over-allocate and align by hand
+    m_cellStorage = ::operator new( (m_mask + 1) * sizeof (Cell) + CacheLineSize );
+    const uintptr_t address = reinterpret_cast<uintptr_t>( m_cellStorage );
+    m_cells = reinterpret_cast<Cell*>( (address + CacheLineSize - 1) & ~uintptr_t(CacheLineSize - 1) );
+    for (size_t i=0; i<=m_mask; ++i)
+    {
+        Cell* cell = new (&m_cells[i]) Cell;
+        cell->sequence.store( i, std::memory_order_relaxed );
+        cell->variable = 0;
+        UA_DataValue_init( &cell->value );
+    }
+}
+
+UpdateQueue::~UpdateQueue()
+{
+    {
+        boost::lock_guard<boost::mutex> lock (m_consumerLock);
+        m_stopping = true;
+    }
+    m_consumerWakeup.notify_all();
+    if (m_consumer)
+        m_consumer->join();
+    for (size_t i=0; i<=m_mask; ++i)
+    {
+        UA_DataValue_deleteMembers( &m_cells[i].value );
+        m_cells[i].~Cell();
+    }
+    ::operator delete( m_cellStorage );
+}
+
+bool UpdateQueue::push( OpcUa::BaseDataVariableType* variable, const UaVariant& value, OpcUa_StatusCode status )
+{
+    size_t position = m_enqueuePosition.load( std::memory_order_relaxed );
+    Cell* cell;
+    for (;;)
+    {
+        cell = &m_cells[position & m_mask];
+        const size_t sequence = cell->sequence.load( std::memory_order_acquire );
+        const std::ptrdiff_t difference = static_cast<std::ptrdiff_t>( sequence - position );
+        if (difference == 0)
+        {
+            if (m_enqueuePosition.compare_exchange_weak( position, position + 1, std::memory_order_relaxed ))
+                break;
+        }
+        else if (difference < 0)
+        {
+            // the consumer hasn't freed this slot yet: the ring is full
+            m_dropped.fetch_add( 1, std::memory_order_relaxed );
+            return false;
+        }
+        else
+            position = m_enqueuePosition.load( std::memory_order_relaxed );
+    }
+
+    UA_DataValue& target = cell->value;
+    UA_DataValue_init( &target );
+    const bool copied = UA_Variant_copy( value.impl(), &target.value ) == UA_STATUSCODE_GOOD;
+    cell->variable = copied ? variable : 0;
+    target.hasValue = true;
+    target.status = status;
+    target.hasStatus = true;
+    target.sourceTimestamp = ValueClock::now().impl();
+    target.hasSourceTimestamp = true;
+    cell->sequence.store( position + 1, std::memory_order_release ); // the slot is ours anyway: give it to the consumer
+    (copied ? m_pushed : m_dropped).fetch_add( 1, std::memory_order_relaxed );
+    return copied;
+}
+
+size_t UpdateQueue::drain( size_t maxUpdates )
+{
+    const UA_DateTime serverTime = ValueClock::now().impl();
+    size_t taken = 0;
+    while (taken < maxUpdates)
+    {
+        Cell& cell = m_cells[m_dequeuePosition & m_mask];
+        if (cell.sequence.load( std::memory_order_acquire ) != m_dequeuePosition + 1)
+            break; // empty, or the producer of this slot hasn't finished yet
+        OpcUa::BaseDataVariableType* variable = cell.variable;
+        UA_DataValue value = cell.value;
+        UA_DataValue_init( &cell.value );
+        cell.sequence.store( m_dequeuePosition + m_mask + 1, std::memory_order_release );
+        ++m_dequeuePosition;
+        ++taken;
+
+        if (!variable)
+        {
+            UA_DataValue_deleteMembers( &value );
+            continue;
+        }
+        value.serverTimestamp = serverTime;
+        value.hasServerTimestamp = true;
+        const OpcUa_UInt64 suppressedBefore = variable->suppressedUpdates();
+        UaStatus status = variable->setValue( 0, UaDataValue( std::move( value ) ), OpcUa_False );
+        if (status.isGood())
+            (variable->suppressedUpdates() != suppressedBefore ? m_suppressed : m_applied).fetch_add( 1, std::memory_order_relaxed );
+        else
+            LOG(Log::WRN) << "UpdateQueue: setValue failed: " << status.toString().toUtf8();
+    }
+    return taken;
+}
+
+void UpdateQueue::start( boost::posix_time::time_duration period )
+{
+    if (m_consumer)
+        throw std::logic_error( "UpdateQueue: already started" );
+    m_stopping = false;
+    m_consumer.reset( new boost::thread( boost::bind( &UpdateQueue::consume, this, period ) ) );
+}
+
+void UpdateQueue::stop()
+{
+    if (!m_consumer)
+        return;
+    {
+        boost::lock_guard<boost::mutex> lock (m_consumerLock);
+        m_stopping = true;
+    }
+    m_consumerWakeup.notify_all();
+    m_consumer->join();
+    m_consumer.reset();
+    drain(); // whatever came in since the consumer's last round
+}
+
+void UpdateQueue::consume( boost::posix_time::time_duration period )
+{
+    boost::unique_lock<boost::mutex> lock (m_consumerLock);
+    while (!m_stopping)
+    {
+        m_consumerWakeup.timed_wait( lock, period );
+        lock.unlock();
+        drain();
+        lock.lock();
+    }
+}
@@ -0,0 +1,92 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * valueclock.cpp
+ *
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <valueclock.h>
+#include <atomic>
+
+#ifdef __linux__
+#include <time.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+namespace
+{
+std::atomic<int> configuredSource (ValueClock::Precise);
+
+struct BatchOfThisThread
+{
+    unsigned int depth;
+    UA_DateTime time; // 0: not a batch of the Batched source
+};
+thread_local BatchOfThisThread batchOfThisThread = { 0, 0 };
+}
+
+void ValueClock::setSource( Source source )
+{
+    configuredSource.store( source, std::memory_order_relaxed );
+}
+
+ValueClock::Source ValueClock::source()
+{
+    return static_cast<Source>( configuredSource.load( std::memory_order_relaxed ) );
+}
+
+UA_DateTime ValueClock::coarseNow()
+{
+#ifdef __linux__
+    struct timespec ts;
+    if (clock_gettime( CLOCK_REALTIME_COARSE, &ts ) == 0)
+        return ts.tv_sec * UA_DATETIME_SEC + ts.tv_nsec / 100 + UA_DATETIME_UNIX_EPOCH;
+    return UA_DateTime_now();
+#elif defined(_WIN32)
+    // FILETIME counts 100 ns since 1601, just as UA_DateTime does
+    FILETIME ft;
+    GetSystemTimeAsFileTime( &ft );
+    return (static_cast<UA_DateTime>( ft.dwHighDateTime ) << 32) | ft.dwLowDateTime;
+#else
+    return UA_DateTime_now();
+#endif
+}
+
+UaDateTime ValueClock::now()
+{
+    switch (source())
+    {
+    case Coarse:
+        return UaDateTime( coarseNow() );
+    case Batched:
+        if (batchOfThisThread.depth && batchOfThisThread.time) // 0 if the batch was opened with another source
+            return UaDateTime( batchOfThisThread.time );
+        return UaDateTime( coarseNow() );
+    default:
+        return UaDateTime::now();
+    }
+}
+
+ValueClock::Batch::Batch()
+{
+    if (batchOfThisThread.depth++ == 0)
+        batchOfThisThread.time = source() == Batched ? UaDateTime::now().impl() : 0;
+}
+
+ValueClock::Batch::~Batch()
+{
+    --batchOfThisThread.depth;
+}
@@ -0,0 +1,274 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * valuesnapshot.cpp
+ *
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <valuesnapshot.h>
+
+#include <algorithm>
+#include <limits>
+#include <boost/thread/locks.hpp>
+#include <boost/foreach.hpp>
+
+ValueSnapshot::ValueSnapshot():
+    m_references(1),
+    m_size(sizeof (ValueSnapshot))
+{
+    UA_DataValue_init( &m_value );
+}
+
+ValueSnapshot::~ValueSnapshot()
+{
+    UA_DataValue_deleteMembers( &m_value );
+}
+
+//! Bytes of the variant's data, and of the contents of strings in it; what else its elements point to isn't counted
+static std::size_t dataSize( const UA_Variant& v )
+{
+    if (!v.type || !v.data)
+        return 0;
+    const std::size_t numElements = UA_Variant_isScalar( &v ) ? 1 : v.arrayLength;
+    std::size_t size = numElements * v.type->memSize;
+    if (v.type == &UA_TYPES[UA_TYPES_STRING] || v.type == &UA_TYPES[UA_TYPES_BYTESTRING] || v.type == &UA_TYPES[UA_TYPES_XMLELEMENT])
+        for (std::size_t i=0; i<numElements; ++i)
+            size += static_cast<const UA_String*>( v.data )[i].length;
+    return size;
+}
+
+ValueSnapshot* ValueSnapshot::adopt( UA_DataValue& value )
+{
+    ValueSnapshot* snapshot = new ValueSnapshot;
+    snapshot->m_value = value;
+    UA_DataValue_init( &value );
+    if (snapshot->m_value.hasValue)
+        snapshot->m_size += dataSize( snapshot->m_value.value );
+    return snapshot;
+}
+
+void ValueSnapshot::release()
+{
+    if (m_references.fetch_sub( 1, std::memory_order_acq_rel ) == 1)
+        delete this;
+}
+
+struct EpochReclaimer::ThreadRecord
+{
+    std::atomic<std::uint64_t> epoch; // epoch of the read section the thread is in, 0 if none
+    unsigned int nesting; // only touched by the owning thread
+    bool inUse; // guarded by EpochReclaimer::m_lock
+    ThreadRecord* next; // set before the record is published, never changed
+    Retired retired; // only touched by the owning thread
+    std::size_t collectAt; // the same; size of retired at which to collect
+    std::size_t retiredBytes; // the same; sizes of the retired snapshots, summed up
+    std::size_t collectAtBytes; // the same; retiredBytes at which to collect
+    std::atomic<std::size_t> numRetired; // size of retired, for numRetired()
+};
+
+//! Gives each thread its record on its first read section or retire() and gives it back when the thread exits
+struct ThreadRecordHolder
+{
+    ThreadRecordHolder(): record( EpochReclaimer::instance().registerThread() ) {}
+    ~ThreadRecordHolder()
+    {
+        EpochReclaimer::instance().unregisterThread( record );
+        record = 0; // retire()s from destructors running after this one go straight to the orphans
+    }
+    EpochReclaimer::ThreadRecord* record;
+};
+
+namespace
+{
+thread_local ThreadRecordHolder threadRecordHolder;
+}
+
+const std::size_t EpochReclaimer::RetireThreshold;
+const std::size_t EpochReclaimer::RetireBytes;
+
+EpochReclaimer::ReadSection::ReadSection():
+    m_untracked( !threadRecordHolder.record )
+{
+    if (m_untracked)
+    {
+        // rare: nothing is released while it lasts, see oldestActiveEpoch()
+        EpochReclaimer::instance().m_untrackedReaders.fetch_add( 1 );
+        return;
+    }
+    ThreadRecord* record = threadRecordHolder.record;
+    if (record->nesting++ == 0)
+        record->epoch.store( EpochReclaimer::instance().m_epoch.load() );
+    // both seq_cst: a writer which doesn't see this epoch yet swapped its pointer before we load it
+}
+
+EpochReclaimer::ReadSection::~ReadSection()
+{
+    if (m_untracked)
+    {
+        EpochReclaimer::instance().m_untrackedReaders.fetch_sub( 1, std::memory_order_release );
+        return;
+    }
+    ThreadRecord* record = threadRecordHolder.record;
+    if (--record->nesting == 0)
+        record->epoch.store( 0, std::memory_order_release );
+}
+
+EpochReclaimer::EpochReclaimer():
+    m_epoch(1),
+    m_threads(0),
+    m_numOrphans(0),
+    m_untrackedReaders(0)
+{
+}
+
+EpochReclaimer& EpochReclaimer::instance()
+{
+    // never destroyed: threads may still end their read sections during static destruction
+    static EpochReclaimer* reclaimer = new EpochReclaimer;
+    return *reclaimer;
+}
+
+EpochReclaimer::ThreadRecord* EpochReclaimer::registerThread()
+{
+    boost::lock_guard<boost::mutex> lock (m_lock);
+    for (ThreadRecord* record = m_threads.load(); record; record = record->next)
+        if (!record->inUse)
+        {
+            record->inUse = true;
+            return record;
+        }
+    ThreadRecord* record = new ThreadRecord;
+    record->epoch = 0;
+    record->nesting = 0;
+    record->inUse = true;
+    record->next = m_threads.load();
+    record->collectAt = RetireThreshold;
+    record->retiredBytes = 0;
+    record->collectAtBytes = RetireBytes;
+    record->numRetired = 0;
+    m_threads.store( record );
+    return record;
+}
+
+void EpochReclaimer::unregisterThread( ThreadRecord* record )
+{
+    boost::lock_guard<boost::mutex> lock (m_lock);
+    m_orphans.insert( m_orphans.end(), record->retired.begin(), record->retired.end() );
+    m_numOrphans.store( m_orphans.size(), std::memory_order_relaxed );
+    record->retired.clear();
+    record->numRetired.store( 0, std::memory_order_relaxed );
+    record->collectAt = RetireThreshold;
+    record->retiredBytes = 0;
+    record->collectAtBytes = RetireBytes;
+    record->inUse = false;
+}
+
+std::uint64_t EpochReclaimer::oldestActiveEpoch() const
+{
+    if (m_untrackedReaders.load())
+        return 0; // such a reader may see anything retired so far
+    std::uint64_t oldest = std::numeric_limits<std::uint64_t>::max();
+    for (const ThreadRecord* record = m_threads.load(); record; record = record->next)
+    {
+        const std::uint64_t epoch = record->epoch.load();
+        if (epoch)
+            oldest = std::min( oldest, epoch );
+    }
+    return oldest;
+}
+
+void EpochReclaimer::retire( ValueSnapshot* snapshot )
+{
+    // it was swapped out before this load: a reader which may still see it is in this epoch or an older one
+    const std::uint64_t epoch = m_epoch.load();
+    ThreadRecord* record = threadRecordHolder.record;
+    if (!record)
+    {
+        boost::lock_guard<boost::mutex> lock (m_lock);
+        m_orphans.push_back( std::make_pair( epoch, snapshot ) );
+        m_numOrphans.store( m_orphans.size(), std::memory_order_relaxed );
+        return;
+    }
+    record->retired.push_back( std::make_pair( epoch, snapshot ) );
+    record->retiredBytes += snapshot->size();
+    record->numRetired.store( record->retired.size(), std::memory_order_relaxed );
+    if (record->retired.size() < record->collectAt && record->retiredBytes < record->collectAtBytes)
+        return;
+    collect( record );
+    if (m_numOrphans.load( std::memory_order_relaxed ))
+    {
+        boost::unique_lock<boost::mutex> lock (m_lock, boost::try_to_lock); // no waiting here, whoever holds it will do
+        if (lock.owns_lock())
+            collectOrphans();
+    }
+}
+
+void EpochReclaimer::reclaim()
+{
+    if (threadRecordHolder.record)
+        collect( threadRecordHolder.record );
+    boost::lock_guard<boost::mutex> lock (m_lock);
+    collectOrphans();
+}
+
+void EpochReclaimer::collect( ThreadRecord* record )
+{
+    // readers from now on can't see any of the retired snapshots; the ones which might are in older epochs
+    m_epoch.fetch_add( 1 );
+    std::vector<ValueSnapshot*> reclaimable;
+    collect( record->retired, oldestActiveEpoch(), reclaimable );
+    record->numRetired.store( record->retired.size(), std::memory_order_relaxed );
+    // what readers hold back is looked at again only once as many have been retired: amortized constant time
+    record->collectAt = std::max<std::size_t>( RetireThreshold, 2 * record->retired.size() );
+    BOOST_FOREACH (ValueSnapshot* s, reclaimable)
+        record->retiredBytes -= s->size();
+    record->collectAtBytes = std::max<std::size_t>( RetireBytes, 2 * record->retiredBytes );
+    BOOST_FOREACH (ValueSnapshot* s, reclaimable)
+        s->release();
+}
+
+void EpochReclaimer::collectOrphans()
+{
+    m_epoch.fetch_add( 1 );
+    std::vector<ValueSnapshot*> reclaimable;
+    collect( m_orphans, oldestActiveEpoch(), reclaimable );
+    m_numOrphans.store( m_orphans.size(), std::memory_order_relaxed );
+    BOOST_FOREACH (ValueSnapshot* s, reclaimable)
+        s->release();
+}
+
+void EpochReclaimer::collect( Retired& retired, std::uint64_t oldestActiveEpoch, std::vector<ValueSnapshot*>& reclaimable )
+{
+    Retired::iterator it = retired.begin();
+    while (it != retired.end())
+    {
+        if (it->first < oldestActiveEpoch)
+        {
+            reclaimable.push_back( it->second );
+            *it = retired.back();
+            retired.pop_back();
+        }
+        else
+            ++it;
+    }
+}
+
+std::size_t EpochReclaimer::numRetired() const
+{
+    std::size_t result = m_numOrphans.load( std::memory_order_relaxed );
+    for (const ThreadRecord* record = m_threads.load(); record; record = record->next)
+        result += record->numRetired.load( std::memory_order_relaxed );
+    return result;
+}
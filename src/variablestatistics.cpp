@@ -0,0 +1,77 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * variablestatistics.cpp
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <variablestatistics.h>
+#include <boost/thread/locks.hpp>
+
+VariableStatistics::VariableStatistics():
+    m_rateSampleTime(std::chrono::steady_clock::now()),
+    m_rateSampleUpdates(0),
+    m_rate(0)
+{
+    for (int operation = 0; operation < NumOperations; ++operation)
+    {
+        m_counts[operation] = 0;
+        for (int bucket = 0; bucket < NumLatencyBuckets; ++bucket)
+            m_latencies[operation][bucket] = 0;
+    }
+}
+
+unsigned int VariableStatistics::latencyBucket( std::uint64_t nanoseconds )
+{
+    std::uint64_t microseconds = nanoseconds / 1000;
+    unsigned int bucket = 0;
+    while (microseconds && bucket < NumLatencyBuckets - 1)
+    {
+        microseconds >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+void VariableStatistics::record( Operation operation, std::uint64_t nanoseconds )
+{
+    m_counts[operation].fetch_add( 1, std::memory_order_relaxed );
+    m_latencies[operation][latencyBucket( nanoseconds )].fetch_add( 1, std::memory_order_relaxed );
+}
+
+std::uint64_t VariableStatistics::count( Operation operation ) const
+{
+    return m_counts[operation].load( std::memory_order_relaxed );
+}
+
+void VariableStatistics::latencyHistogram( Operation operation, std::uint64_t* histogram ) const
+{
+    for (int bucket = 0; bucket < NumLatencyBuckets; ++bucket)
+        histogram[bucket] = m_latencies[operation][bucket].load( std::memory_order_relaxed );
+}
+
+double VariableStatistics::updateRate()
+{
+    boost::lock_guard<boost::mutex> lock (m_rateLock);
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    const std::chrono::duration<double> elapsed = now - m_rateSampleTime;
+    if (elapsed >= std::chrono::seconds(1))
+    {
+        const std::uint64_t updates = count( Update );
+        m_rate = (updates - m_rateSampleUpdates) / elapsed.count();
+        m_rateSampleUpdates = updates;
+        m_rateSampleTime = now;
+    }
+    return m_rate;
+}
@@ -0,0 +1,43 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * recordingvariable.h
+ *
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TEST_INCLUDE_RECORDINGVARIABLE_H_
+#define TEST_INCLUDE_RECORDINGVARIABLE_H_
+
+#include "opcua_basedatavariabletype.h"
+
+//! Overrides only the const& setValue(), as subclasses written before the rvalue one existed do: for checking that
+//! every path which sets values (client writes, setValues(), UpdateQueue::drain()) reaches such an override
+class RecordingVariable: public OpcUa::BaseDataVariableType
+{
+public:
+	explicit RecordingVariable( const UaVariant& initialValue, NodeManagerConfig* nodeManager = 0 ):
+		OpcUa::BaseDataVariableType(UaNodeId(UaString("recording"), 2), UaString("recording"), 2, initialValue,
+				OpcUa_AccessLevels_CurrentReadOrWrite, nodeManager),
+		m_calls(0)
+	{}
+	virtual UaStatus setValue( Session* session, const UaDataValue& dataValue, OpcUa_Boolean checkAccessLevel )
+	{
+		++m_calls;
+		return OpcUa::BaseDataVariableType::setValue(session, dataValue, checkAccessLevel);
+	}
+	int m_calls;
+};
+
+#endif /* TEST_INCLUDE_RECORDINGVARIABLE_H_ */
@@ -0,0 +1,169 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * addressspaceimage_test.cpp
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "addressspaceimage.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <boost/filesystem/operations.hpp>
+
+namespace
+{
+	UA_String view(const char* s)
+	{
+		UA_String result;
+		result.length = std::strlen(s);
+		result.data = reinterpret_cast<UA_Byte*>(const_cast<char*>(s));
+		return result;
+	}
+
+	UA_NodeId stringId(UA_UInt16 ns, const char* s)
+	{
+		UA_NodeId result;
+		result.namespaceIndex = ns;
+		result.identifierType = UA_NODEIDTYPE_STRING;
+		result.identifier.string = view(s);
+		return result;
+	}
+
+	std::string asString(const UA_String& s)
+	{
+		return std::string(reinterpret_cast<const char*>(s.data), s.length);
+	}
+
+	class AddressSpaceImageTest: public ::testing::Test
+	{
+	public:
+		AddressSpaceImageTest():
+			m_path((boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("addressspaceimage_test-%%%%-%%%%.bin")).string())
+		{}
+		virtual ~AddressSpaceImageTest() { std::remove(m_path.c_str()); }
+
+		void writeSampleImage(OpcUa_UInt64 configHash)
+		{
+			AddressSpaceImageWriter writer(configHash);
+			AddressSpaceImageNode node;
+
+			node.nodeClass = OpcUa_NodeClass_Object;
+			node.nodeId = stringId(2, "dev");
+			node.parentId = UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER);
+			node.referenceTypeId = UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES);
+			node.typeDefinitionId = UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE);
+			node.browseName.namespaceIndex = 2;
+			node.browseName.name = view("dev");
+			node.valueRank = -1;
+			node.accessLevel = 0;
+			writer.add(node);
+
+			node.nodeClass = OpcUa_NodeClass_Method;
+			node.nodeId = stringId(2, "dev.reset");
+			node.parentId = stringId(2, "dev");
+			node.referenceTypeId = UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT);
+			node.browseName.name = view("reset");
+			UA_Argument argument;
+			std::memset(&argument, 0, sizeof argument);
+			argument.name = view("delay");
+			argument.dataType = UA_NODEID_NUMERIC(0, UA_NS0ID_DOUBLE);
+			argument.valueRank = 1;
+			OpcUa_UInt32 dimensions[] = { 3 };
+			argument.arrayDimensionsSize = 1;
+			argument.arrayDimensions = dimensions;
+			argument.description.locale = view("en");
+			argument.description.text = view("per channel, in seconds");
+			node.inputArguments.push_back(argument);
+			writer.add(node);
+
+			writer.write(m_path);
+		}
+
+		const std::string m_path;
+	};
+}
+
+TEST_F(AddressSpaceImageTest, testRoundTrip)
+{
+	writeSampleImage(42);
+	AddressSpaceImageReader reader(m_path, 42);
+	ASSERT_EQ(2, reader.numNodes());
+
+	AddressSpaceImageNode node;
+	reader.node(0, node);
+	EXPECT_EQ(OpcUa_NodeClass_Object, node.nodeClass);
+	EXPECT_EQ(UA_NODEIDTYPE_STRING, node.nodeId.identifierType);
+	EXPECT_EQ("dev", asString(node.nodeId.identifier.string));
+	EXPECT_EQ(UA_NS0ID_OBJECTSFOLDER, node.parentId.identifier.numeric);
+	EXPECT_TRUE(node.inputArguments.empty());
+
+	reader.node(1, node);
+	EXPECT_EQ(OpcUa_NodeClass_Method, node.nodeClass);
+	EXPECT_EQ("dev", asString(node.parentId.identifier.string));
+	EXPECT_EQ("reset", asString(node.browseName.name));
+	EXPECT_EQ(2, node.browseName.namespaceIndex);
+	ASSERT_EQ(1, node.inputArguments.size());
+	EXPECT_EQ("delay", asString(node.inputArguments[0].name));
+	EXPECT_EQ(UA_NS0ID_DOUBLE, node.inputArguments[0].dataType.identifier.numeric);
+	EXPECT_EQ(1, node.inputArguments[0].valueRank);
+	ASSERT_EQ(1, node.inputArguments[0].arrayDimensionsSize);
+	EXPECT_EQ(3, node.inputArguments[0].arrayDimensions[0]);
+	EXPECT_EQ("en", asString(node.inputArguments[0].description.locale));
+	EXPECT_EQ("per channel, in seconds", asString(node.inputArguments[0].description.text));
+	EXPECT_TRUE(node.outputArguments.empty());
+}
+
+TEST_F(AddressSpaceImageTest, testWriteReplacesOldImage)
+{
+	writeSampleImage(42);
+	writeSampleImage(43);
+	EXPECT_THROW(AddressSpaceImageReader(m_path, 42), std::runtime_error);
+	EXPECT_EQ(2, AddressSpaceImageReader(m_path, 43).numNodes());
+	EXPECT_FALSE(boost::filesystem::exists(m_path + ".tmp"));
+}
+
+TEST_F(AddressSpaceImageTest, testOtherConfigurationRejected)
+{
+	writeSampleImage(42);
+	EXPECT_THROW(AddressSpaceImageReader(m_path, 43), std::runtime_error);
+}
+
+TEST_F(AddressSpaceImageTest, testCorruptionDetected)
+{
+	writeSampleImage(42);
+	{
+		std::fstream file(m_path.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+		file.seekp(-2, std::ios::end); // somewhere in the string pool
+		file.put('#');
+	}
+	EXPECT_THROW(AddressSpaceImageReader(m_path, 42), std::runtime_error);
+}
+
+TEST_F(AddressSpaceImageTest, testTruncationDetected)
+{
+	writeSampleImage(42);
+	std::string contents;
+	{
+		std::ifstream file(m_path.c_str(), std::ios::binary);
+		contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+	{
+		std::ofstream file(m_path.c_str(), std::ios::binary | std::ios::trunc);
+		file.write(contents.data(), contents.size() - 10);
+	}
+	EXPECT_THROW(AddressSpaceImageReader(m_path, 42), std::runtime_error);
+}
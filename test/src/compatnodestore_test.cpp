@@ -0,0 +1,132 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * compatnodestore_test.cpp
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "compatnodestore.h"
+
+#include <cstring>
+
+namespace
+{
+	class CompatNodestoreTest: public ::testing::Test
+	{
+	protected:
+		CompatNodestoreTest()
+		{
+			std::memset(&m_config, 0, sizeof m_config);
+			m_testee = CompatNodestore::install(&m_config);
+		}
+		~CompatNodestoreTest()
+		{
+			m_config.nodestore.deleteNodestore(m_config.nodestore.context);
+		}
+
+		UA_StatusCode insert( UA_NodeClass nodeClass, const UA_NodeId& nodeId, UA_NodeId* addedNodeId = 0 )
+		{
+			UA_Node* node = m_config.nodestore.newNode(m_config.nodestore.context, nodeClass);
+			node->nodeId = nodeId;
+			return m_config.nodestore.insertNode(m_config.nodestore.context, node, addedNodeId);
+		}
+
+		//! The node stays valid as long as it's in the nodestore
+		const UA_Node* get( const UA_NodeId& nodeId )
+		{
+			const UA_Node* node = m_config.nodestore.getNode(m_config.nodestore.context, &nodeId);
+			if (node)
+				m_config.nodestore.releaseNode(m_config.nodestore.context, node);
+			return node;
+		}
+
+		UA_ServerConfig m_config;
+		CompatNodestore* m_testee;
+	};
+}
+
+TEST_F(CompatNodestoreTest, testInsertLookupRemove)
+{
+	for (int i=1; i<=1000; ++i)
+		ASSERT_EQ(UA_STATUSCODE_GOOD, insert(UA_NODECLASS_VARIABLE, UA_NODEID_NUMERIC(2, i)));
+	EXPECT_EQ(1000, m_testee->numNodes());
+
+	const UA_Node* node = get(UA_NODEID_NUMERIC(2, 500));
+	ASSERT_TRUE(node != 0);
+	EXPECT_EQ(UA_NODECLASS_VARIABLE, node->nodeClass);
+	EXPECT_EQ(500, node->nodeId.identifier.numeric);
+	EXPECT_TRUE(get(UA_NODEID_NUMERIC(3, 500)) == 0);
+
+	EXPECT_EQ(UA_STATUSCODE_BADNODEIDEXISTS, insert(UA_NODECLASS_OBJECT, UA_NODEID_NUMERIC(2, 500)));
+
+	UA_NodeId removed = UA_NODEID_NUMERIC(2, 500);
+	EXPECT_EQ(UA_STATUSCODE_GOOD, m_config.nodestore.removeNode(m_config.nodestore.context, &removed));
+	EXPECT_TRUE(get(removed) == 0);
+	EXPECT_EQ(UA_STATUSCODE_BADNODEIDUNKNOWN, m_config.nodestore.removeNode(m_config.nodestore.context, &removed));
+	EXPECT_EQ(999, m_testee->numNodes());
+}
+
+TEST_F(CompatNodestoreTest, testCompatNodeSurvivesReplace)
+{
+	ASSERT_EQ(UA_STATUSCODE_GOOD, insert(UA_NODECLASS_OBJECT, UA_NODEID_NUMERIC(2, 7)));
+	UaNode* compat = reinterpret_cast<UaNode*>(&m_config); // only compared, never dereferenced
+	EXPECT_TRUE(m_testee->attach(UA_NODEID_NUMERIC(2, 7), compat));
+	EXPECT_FALSE(m_testee->attach(UA_NODEID_NUMERIC(2, 8), compat));
+
+	UA_Node* copy = 0;
+	UA_NodeId nodeId = UA_NODEID_NUMERIC(2, 7);
+	ASSERT_EQ(UA_STATUSCODE_GOOD, m_config.nodestore.getNodeCopy(m_config.nodestore.context, &nodeId, &copy));
+	ASSERT_EQ(UA_STATUSCODE_GOOD, m_config.nodestore.replaceNode(m_config.nodestore.context, copy));
+
+	EXPECT_EQ(copy, get(nodeId)) << "the server sees the new node";
+	EXPECT_EQ(compat, m_testee->compatNode(nodeId)) << "and the compat node stays bound to it";
+}
+
+TEST_F(CompatNodestoreTest, testNodeValidUntilReleased)
+{
+	ASSERT_EQ(UA_STATUSCODE_GOOD, insert(UA_NODECLASS_VARIABLE, UA_NODEID_NUMERIC(2, 7)));
+	UA_NodeId nodeId = UA_NODEID_NUMERIC(2, 7);
+	const UA_Node* held = m_config.nodestore.getNode(m_config.nodestore.context, &nodeId);
+	ASSERT_TRUE(held != 0);
+
+	UA_Node* copy = 0;
+	ASSERT_EQ(UA_STATUSCODE_GOOD, m_config.nodestore.getNodeCopy(m_config.nodestore.context, &nodeId, &copy));
+	ASSERT_EQ(UA_STATUSCODE_GOOD, m_config.nodestore.replaceNode(m_config.nodestore.context, copy));
+	EXPECT_EQ(7, held->nodeId.identifier.numeric) << "the replaced node is still there for whoever got it";
+	EXPECT_EQ(UA_STATUSCODE_GOOD, m_config.nodestore.removeNode(m_config.nodestore.context, &nodeId));
+	EXPECT_EQ(UA_NODECLASS_VARIABLE, held->nodeClass);
+	m_config.nodestore.releaseNode(m_config.nodestore.context, held); // frees it (the sanitizers would tell otherwise)
+	EXPECT_TRUE(get(nodeId) == 0);
+}
+
+TEST_F(CompatNodestoreTest, testAttachSetsNodeContext)
+{
+	ASSERT_EQ(UA_STATUSCODE_GOOD, insert(UA_NODECLASS_VARIABLE, UA_NODEID_NUMERIC(2, 7)));
+	UaNode* compat = reinterpret_cast<UaNode*>(&m_config); // only compared, never dereferenced
+	EXPECT_TRUE(m_testee->attach(UA_NODEID_NUMERIC(2, 7), compat));
+	EXPECT_TRUE(get(UA_NODEID_NUMERIC(2, 7))->context == 0) << "left alone without a context";
+	EXPECT_TRUE(m_testee->attach(UA_NODEID_NUMERIC(2, 7), compat, &m_testee));
+	EXPECT_EQ(static_cast<void*>(&m_testee), get(UA_NODEID_NUMERIC(2, 7))->context);
+	EXPECT_EQ(compat, m_testee->compatNode(UA_NODEID_NUMERIC(2, 7)));
+}
+
+TEST_F(CompatNodestoreTest, testNullNumericIdGetsGenerated)
+{
+	UA_NodeId first, second;
+	ASSERT_EQ(UA_STATUSCODE_GOOD, insert(UA_NODECLASS_OBJECT, UA_NODEID_NUMERIC(1, 0), &first));
+	ASSERT_EQ(UA_STATUSCODE_GOOD, insert(UA_NODECLASS_OBJECT, UA_NODEID_NUMERIC(1, 0), &second));
+	EXPECT_NE(0, first.identifier.numeric);
+	EXPECT_NE(first.identifier.numeric, second.identifier.numeric);
+	EXPECT_TRUE(get(first) != 0);
+}
@@ -0,0 +1,84 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * internedstrings_test.cpp
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "internedstrings.h"
+#include "other.h"
+
+TEST(InternedStringsTest, testSameContentSharesBuffer)
+{
+	const UA_String& a = InternedStrings::intern("temperature");
+	const UA_String& b = InternedStrings::intern(*UaString("temperature").impl());
+	const UA_String& c = InternedStrings::intern("pressure");
+
+	EXPECT_EQ(&a, &b);
+	EXPECT_EQ(a.data, b.data);
+	EXPECT_NE(a.data, c.data);
+	EXPECT_EQ("temperature", UaString(&a).toUtf8());
+}
+
+TEST(InternedStringsTest, testStatisticsCountSavings)
+{
+	const InternedStrings::Statistics before = InternedStrings::statistics();
+	for (int i=0; i<100; ++i)
+		InternedStrings::intern("InternedStringsTest.repeated");
+	const InternedStrings::Statistics after = InternedStrings::statistics();
+
+	EXPECT_EQ(before.distinctStrings + 1, after.distinctStrings);
+	EXPECT_EQ(before.requests + 100, after.requests);
+	EXPECT_EQ(before.bytesSaved() + 99*std::string("InternedStringsTest.repeated").size(), after.bytesSaved());
+}
+
+TEST(InternedStringsTest, testQualifiedNameCopiesShareName)
+{
+	UaQualifiedName original(2, "voltage");
+	UaQualifiedName copy(original);
+	UaQualifiedName other(3, UaString("voltage"));
+
+	EXPECT_EQ(original.impl().name.data, copy.impl().name.data);
+	EXPECT_EQ(original.impl().name.data, other.impl().name.data);
+	EXPECT_EQ(3, other.impl().namespaceIndex);
+	EXPECT_EQ("voltage", copy.unqualifiedName().toUtf8());
+}
+
+TEST(InternedStringsTest, testUnreferencedStringsAreReclaimed)
+{
+	InternedStrings::reclaim();
+	const InternedStrings::Statistics before = InternedStrings::statistics();
+	{
+		UaQualifiedName name(2, "InternedStringsTest.shortLived");
+		UaQualifiedName copy(name);
+		EXPECT_EQ(before.distinctStrings + 1, InternedStrings::statistics().distinctStrings);
+		name = UaQualifiedName(2, "InternedStringsTest.replacement");
+		InternedStrings::reclaim();
+		EXPECT_EQ(before.distinctStrings + 2, InternedStrings::statistics().distinctStrings) << "both still referenced";
+	}
+	EXPECT_EQ(2u, InternedStrings::reclaim());
+	const InternedStrings::Statistics after = InternedStrings::statistics();
+	EXPECT_EQ(before.distinctStrings, after.distinctStrings);
+	EXPECT_EQ(before.bytesStored, after.bytesStored);
+}
+
+TEST(InternedStringsTest, testStringInternedAgainIsRevived)
+{
+	const UA_String& first = InternedStrings::intern("InternedStringsTest.revived");
+	InternedStrings::release(first);
+	const UA_String& second = InternedStrings::intern("InternedStringsTest.revived");
+	InternedStrings::reclaim();
+	EXPECT_EQ("InternedStringsTest.revived", UaString(&second).toUtf8()) << "referenced again before it was reclaimed";
+	InternedStrings::release(second);
+}
@@ -0,0 +1,307 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * methodexecutor_test.cpp
+ *
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "methodexecutor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	//! Doubles its Int32 argument; finishes right away, from another thread after a delay, not at all, or once
+	//! released (and not returning from beginCall() before)
+	class Doubler: public MethodManager
+	{
+	public:
+		enum Mode { Synchronously, Slowly, Later, Never, Refuse, Stuck };
+
+		explicit Doubler( Mode mode ):
+			m_mode(mode), m_calls(0), m_running(0), m_maxRunning(0), m_pending(0), m_begun(false), m_released(false) {}
+		~Doubler() { if (m_finisher.joinable()) m_finisher.join(); }
+
+		virtual UaStatus beginCall(
+				MethodManagerCallback *callback,
+				const ServiceContext  &context,
+				OpcUa_UInt32          callbackHandle,
+				MethodHandle          *methodHandle,
+				const UaVariantArray  &inputArguments)
+		{
+			m_thread = std::this_thread::get_id();
+			++m_calls;
+			if (m_mode == Refuse)
+				return OpcUa_BadInvalidArgument;
+			OpcUa_Int32 argument = 0;
+			inputArguments[0].toInt32(argument);
+			if (m_mode == Synchronously)
+				finish(callback, argument);
+			else if (m_mode == Slowly)
+			{
+				const int running = ++m_running;
+				int maxRunning = m_maxRunning;
+				while (running > maxRunning && !m_maxRunning.compare_exchange_weak(maxRunning, running));
+				std::this_thread::sleep_for(std::chrono::milliseconds(5));
+				--m_running;
+				finish(callback, argument);
+			}
+			else if (m_mode == Later)
+				m_finisher = std::thread([this, callback, argument]() {
+					std::this_thread::sleep_for(std::chrono::milliseconds(20));
+					finish(callback, argument);
+				});
+			else if (m_mode == Stuck)
+			{
+				m_begun = true;
+				while (!m_released)
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				finish(callback, argument);
+			}
+			else
+			{
+				m_pending = callback;
+				m_begun = true;
+			}
+			return OpcUa_Good;
+		}
+
+		void finish( MethodManagerCallback* callback, OpcUa_Int32 argument )
+		{
+			UaStatusCodeArray results;
+			UaDiagnosticInfos diagnostics;
+			UaVariantArray outputs;
+			outputs.create(1);
+			outputs[0] = UaVariant(OpcUa_Int32(2*argument));
+			UaStatus status (OpcUa_Good);
+			callback->finishCall(0, results, diagnostics, outputs, status);
+		}
+
+		Mode m_mode;
+		std::atomic<int> m_calls;
+		std::atomic<int> m_running;
+		std::atomic<int> m_maxRunning;
+		std::thread::id m_thread;
+		std::thread m_finisher;
+		MethodManagerCallback* m_pending; // of the last call in mode Never, once m_begun
+		std::atomic<bool> m_begun;
+		std::atomic<bool> m_released;
+	};
+
+	UaStatus callDoubler( Doubler& doubler, OpcUa_Int32 argument, OpcUa_Int32& result )
+	{
+		UaVariantArray inputs;
+		inputs.create(1);
+		inputs[0] = UaVariant(argument);
+		UaVariantArray outputs;
+		UaStatus status = MethodExecutor::call(&doubler, 0, inputs, outputs);
+		if (outputs.size() == 1)
+			outputs[0].toInt32(result);
+		return status;
+	}
+
+	//! Calls the doubler (Never or Stuck) on the pool until a call is begun, each of them answered BadTimeout: on a
+	//! loaded machine a worker may not get to a call within the timeout, and then it isn't begun at all
+	void callUntilBegun( Doubler& doubler, MethodHandle* handle )
+	{
+		while (!doubler.m_begun)
+		{
+			UaVariantArray inputs;
+			inputs.create(1);
+			inputs[0] = UaVariant(OpcUa_Int32(1));
+			UaVariantArray outputs;
+			ASSERT_EQ(UA_STATUSCODE_BADTIMEOUT, MethodExecutor::call(&doubler, handle, inputs, outputs).statusCode());
+			// either it gets begun, or the worker drops it
+			while (!doubler.m_begun && !MethodExecutor::waitForCalls(handle, boost::posix_time::milliseconds(1)));
+		}
+	}
+}
+
+TEST(MethodExecutorTest, testServerThreadByDefault)
+{
+	ASSERT_EQ(0u, MethodExecutor::numWorkers());
+	Doubler doubler (Doubler::Synchronously);
+	OpcUa_Int32 result = 0;
+	EXPECT_TRUE(callDoubler(doubler, 21, result).isGood());
+	EXPECT_EQ(42, result);
+	EXPECT_EQ(std::this_thread::get_id(), doubler.m_thread);
+
+	Doubler refusing (Doubler::Refuse);
+	EXPECT_EQ(OpcUa_BadInvalidArgument, callDoubler(refusing, 1, result).statusCode());
+}
+
+TEST(MethodExecutorTest, testWorkerPool)
+{
+	MethodExecutor::startWorkerPool(2, boost::posix_time::seconds(10));
+	EXPECT_EQ(2u, MethodExecutor::numWorkers());
+
+	Doubler doubler (Doubler::Later);
+	OpcUa_Int32 result = 0;
+	EXPECT_TRUE(callDoubler(doubler, 5, result).isGood()) << "finished from yet another thread after beginCall returned";
+	EXPECT_EQ(10, result);
+	EXPECT_NE(std::this_thread::get_id(), doubler.m_thread);
+
+	Doubler refusing (Doubler::Refuse);
+	EXPECT_EQ(OpcUa_BadInvalidArgument, callDoubler(refusing, 1, result).statusCode());
+
+	MethodExecutor::stopWorkerPool();
+	EXPECT_EQ(0u, MethodExecutor::numWorkers());
+}
+
+TEST(MethodExecutorTest, testTimeout)
+{
+	MethodExecutor::startWorkerPool(1, boost::posix_time::milliseconds(20));
+	Doubler doubler (Doubler::Never);
+	MethodHandleUaNode handle;
+	callUntilBegun(doubler, &handle);
+	doubler.finish(doubler.m_pending, 1); // too late, and harmless
+	EXPECT_TRUE(MethodExecutor::waitForCalls(&handle));
+	EXPECT_TRUE(MethodExecutor::stopWorkerPool().isGood());
+}
+
+TEST(MethodExecutorTest, testCallsOnOneObjectAreSerialized)
+{
+	MethodExecutor::startWorkerPool(4, boost::posix_time::seconds(10), 1, 16);
+	Doubler doubler (Doubler::Slowly);
+	std::vector<std::thread> callers;
+	std::atomic<int> good (0);
+	for (int i=0; i<4; ++i)
+		callers.push_back(std::thread([&doubler, &good, i]() {
+			OpcUa_Int32 result = 0;
+			if (callDoubler(doubler, i, result).isGood() && result == 2*i)
+				++good;
+		}));
+	std::for_each(callers.begin(), callers.end(), [](std::thread& t) { t.join(); });
+	EXPECT_EQ(4, good);
+	EXPECT_EQ(1, doubler.m_maxRunning) << "one call of the object at a time";
+	MethodExecutor::stopWorkerPool();
+}
+
+TEST(MethodExecutorTest, testOverflowIsRefusedAtOnce)
+{
+	MethodExecutor::startWorkerPool(2, boost::posix_time::milliseconds(20), 1, 1);
+	Doubler doubler (Doubler::Never);
+	MethodHandleUaNode handle;
+	callUntilBegun(doubler, &handle); // stays in flight
+	const std::uint64_t rejectedBefore = MethodExecutor::rejectedCalls();
+	OpcUa_Int32 result = 0;
+	UaStatus overflow;
+	do
+	{
+		// one call waiting for its turn (for the timeout), then one too many; retried if they come the other way round
+		MethodHandleUaNode queuedHandle;
+		std::atomic<bool> answered (false);
+		std::thread queued ([&doubler, &queuedHandle, &answered]() {
+			UaVariantArray inputs;
+			inputs.create(1);
+			inputs[0] = UaVariant(OpcUa_Int32(1));
+			UaVariantArray outputs;
+			MethodExecutor::call(&doubler, &queuedHandle, inputs, outputs);
+			answered = true;
+		});
+		while (MethodExecutor::waitForCalls(&queuedHandle, boost::posix_time::milliseconds(0)) && !answered)
+			std::this_thread::yield();
+		overflow = callDoubler(doubler, 1, result);
+		queued.join();
+	}
+	while (overflow.statusCode() != OpcUa_BadResourceUnavailable);
+	EXPECT_LT(rejectedBefore, MethodExecutor::rejectedCalls());
+
+	Doubler other (Doubler::Synchronously);
+	EXPECT_TRUE(callDoubler(other, 2, result).isGood()) << "other objects aren't affected";
+
+	doubler.finish(doubler.m_pending, 1);
+	MethodExecutor::stopWorkerPool();
+	EXPECT_EQ(1, doubler.m_calls) << "the calls given up on while queued aren't begun";
+}
+
+TEST(MethodExecutorTest, testTimeoutWhileQueuedGivesPlaceUp)
+{
+	MethodExecutor::startWorkerPool(2, boost::posix_time::milliseconds(20), 1, 1);
+	Doubler doubler (Doubler::Never);
+	MethodHandleUaNode handle;
+	callUntilBegun(doubler, &handle); // stays in flight
+	const std::uint64_t rejectedBefore = MethodExecutor::rejectedCalls();
+	OpcUa_Int32 result = 0;
+	for (int i=0; i<3; ++i)
+		EXPECT_EQ(UA_STATUSCODE_BADTIMEOUT, callDoubler(doubler, 1, result).statusCode()) << "queued, not refused";
+	EXPECT_EQ(rejectedBefore, MethodExecutor::rejectedCalls());
+	doubler.finish(doubler.m_pending, 1);
+	MethodExecutor::stopWorkerPool();
+	EXPECT_EQ(1, doubler.m_calls);
+}
+
+TEST(MethodExecutorTest, testWaitForCallsOutlivesTimeout)
+{
+	MethodExecutor::startWorkerPool(1, boost::posix_time::milliseconds(20));
+	Doubler doubler (Doubler::Never);
+	MethodHandleUaNode handle;
+	callUntilBegun(doubler, &handle);
+
+	std::atomic<bool> finished (false);
+	std::thread finisher ([&doubler, &finished]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		finished = true;
+		doubler.finish(doubler.m_pending, 1);
+	});
+	EXPECT_TRUE(MethodExecutor::waitForCalls(&handle));
+	EXPECT_TRUE(finished) << "the call answered BadTimeout was still in flight";
+	finisher.join();
+	EXPECT_TRUE(MethodExecutor::waitForCalls(&handle, boost::posix_time::milliseconds(0))) << "nothing in flight";
+	MethodExecutor::stopWorkerPool();
+}
+
+TEST(MethodExecutorTest, testWaitForCallsGivesUp)
+{
+	MethodExecutor::startWorkerPool(1, boost::posix_time::milliseconds(20));
+	Doubler doubler (Doubler::Never);
+	MethodHandleUaNode handle;
+	callUntilBegun(doubler, &handle);
+	EXPECT_FALSE(MethodExecutor::waitForCalls(&handle, boost::posix_time::milliseconds(10)));
+	doubler.finish(doubler.m_pending, 1);
+	EXPECT_TRUE(MethodExecutor::waitForCalls(&handle));
+	MethodExecutor::stopWorkerPool();
+}
+
+TEST(MethodExecutorTest, testStopWorkerPoolGivesUpOnStuckMethod)
+{
+	MethodExecutor::startWorkerPool(1, boost::posix_time::milliseconds(20));
+	Doubler doubler (Doubler::Stuck);
+	MethodHandleUaNode handle;
+	callUntilBegun(doubler, &handle);
+	MethodExecutor::setDrainTimeout(boost::posix_time::milliseconds(10));
+	EXPECT_EQ(UA_STATUSCODE_BADTIMEOUT, MethodExecutor::stopWorkerPool().statusCode()) << "the worker is still in beginCall()";
+	MethodExecutor::setDrainTimeout(boost::posix_time::seconds(10));
+	EXPECT_EQ(0u, MethodExecutor::numWorkers()) << "stopped nonetheless";
+	doubler.m_released = true;
+	EXPECT_TRUE(MethodExecutor::waitForCalls(&handle)) << "the pool left behind still finishes its call";
+}
+
+TEST(MethodExecutorTest, testWaitForCallsOnServerThread)
+{
+	MethodHandleUaNode handle;
+	MethodExecutor::waitForCalls(&handle); // never called
+	Doubler doubler (Doubler::Synchronously);
+	UaVariantArray inputs;
+	inputs.create(1);
+	inputs[0] = UaVariant(OpcUa_Int32(1));
+	UaVariantArray outputs;
+	EXPECT_TRUE(MethodExecutor::call(&doubler, &handle, inputs, outputs).isGood());
+	MethodExecutor::waitForCalls(&handle); // finished with the call
+}
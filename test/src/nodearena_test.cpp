@@ -0,0 +1,114 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * nodearena_test.cpp
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "nodearena.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace
+{
+	struct Counted
+	{
+		Counted( std::vector<int>& log, int id ): m_log(log), m_id(id) {}
+		~Counted() { m_log.push_back(m_id); }
+		std::vector<int>& m_log;
+		int m_id;
+	};
+
+	struct Plain
+	{
+		double value;
+		char tag;
+	};
+
+	struct Big
+	{
+		double values[32];
+	};
+}
+
+TEST(NodeArenaTest, testDestructorsRunInReverseOrder)
+{
+	std::vector<int> log;
+	{
+		NodeArena testee(128);
+		for (int i=0; i<100; ++i)
+			testee.create<Counted>(log, i);
+		EXPECT_EQ(100, testee.numObjectsToDestroy());
+		EXPECT_TRUE(log.empty()) << "nothing destroyed before the arena goes away";
+	}
+	ASSERT_EQ(100, log.size());
+	for (int i=0; i<100; ++i)
+		EXPECT_EQ(99-i, log[i]);
+}
+
+TEST(NodeArenaTest, testTriviallyDestructibleObjectsAreNotTracked)
+{
+	NodeArena testee;
+	for (int i=0; i<1000; ++i)
+		testee.create<Plain>()->value = i;
+	EXPECT_EQ(0, testee.numObjectsToDestroy());
+}
+
+TEST(NodeArenaTest, testAlignmentAndOwnership)
+{
+	NodeArena testee(64);
+	std::vector<void*> objects;
+	for (int i=0; i<50; ++i)
+	{
+		testee.create<char>('x');
+		Plain* p = testee.create<Plain>();
+		EXPECT_EQ(0, reinterpret_cast<std::uintptr_t>(p) % alignof(Plain));
+		objects.push_back(p);
+	}
+	Big* big = testee.create<Big>(); // bigger than a block
+	objects.push_back(big);
+
+	for (size_t i=0; i<objects.size(); ++i)
+		EXPECT_TRUE(testee.owns(objects[i]));
+	Plain outside;
+	EXPECT_FALSE(testee.owns(&outside));
+
+	testee.clear();
+	EXPECT_EQ(0, testee.bytesReserved());
+	EXPECT_FALSE(testee.owns(objects[0]));
+}
+
+TEST(NodeArenaTest, testRecycledMemoryReused)
+{
+	std::vector<int> log;
+	NodeArena testee;
+	Counted* first = testee.create<Counted>(log, 1);
+	testee.create<Counted>(log, 2);
+	testee.create<Plain>();
+
+	testee.recycle(first);
+	ASSERT_EQ(1, log.size()) << "destroyed right away";
+	EXPECT_EQ(1, log[0]);
+	EXPECT_EQ(1, testee.numObjectsToDestroy());
+
+	EXPECT_NE(static_cast<void*>(first), static_cast<void*>(testee.create<Big>())) << "another size";
+	EXPECT_EQ(first, testee.create<Counted>(log, 3));
+	EXPECT_EQ(2, testee.numObjectsToDestroy());
+
+	testee.clear();
+	ASSERT_EQ(3, log.size()) << "the recycled object isn't destroyed again";
+	EXPECT_EQ(2, log[1]);
+	EXPECT_EQ(3, log[2]) << "in place of the object it replaced";
+}
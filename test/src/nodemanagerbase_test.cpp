@@ -0,0 +1,651 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * nodemanagerbase_test.cpp
+ *
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "nodemanagerbase.h"
+#include "opcua_baseobjecttype.h"
+#include "opcua_basedatavariabletype.h"
+#include "uadatavariablecache.h"
+#include "addressspaceimage.h"
+#include "recordingvariable.h"
+
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/filesystem/operations.hpp>
+
+namespace
+{
+	//! A variable which isn't a BaseDataVariableType: its preparation throws
+	class BrokenVariable: public UaNode
+	{
+	public:
+		explicit BrokenVariable( const UaNodeId& nodeId ): m_nodeId(nodeId) {}
+		virtual UaNodeId nodeId() const { return m_nodeId; }
+		virtual UaQualifiedName browseName() const { return UaQualifiedName(2, "broken"); }
+		virtual UaNodeId typeDefinitionId() const { return UaNodeId(OpcUaType_Double, 0); }
+		virtual OpcUa_NodeClass nodeClass() const { return OpcUa_NodeClass_Variable; }
+	private:
+		UaNodeId m_nodeId;
+	};
+
+	//! Computes its value on read, as subclasses written before copyValueTo() existed do
+	class ComputedVariable: public OpcUa::BaseDataVariableType
+	{
+	public:
+		ComputedVariable( const UaNodeId& nodeId, NodeManagerConfig* nodeManager ):
+			OpcUa::BaseDataVariableType(nodeId, "computed", 2, UaVariant(OpcUa_Double(0)), OpcUa_AccessLevels_CurrentRead, nodeManager)
+		{}
+		virtual UaDataValue value( Session* session )
+		{
+			return UaDataValue(UaVariant(OpcUa_Double(42)), OpcUa_Good, UaDateTime::now(), UaDateTime::now());
+		}
+	};
+
+	class NodeManagerBaseTest: public ::testing::Test
+	{
+	protected:
+		NodeManagerBaseTest():
+			m_config(UA_ServerConfig_new_default()),
+			m_server(UA_Server_new(m_config))
+		{
+			newNodeManager();
+		}
+		~NodeManagerBaseTest()
+		{
+			m_nodeManager.reset();
+			UA_Server_delete(m_server);
+			UA_ServerConfig_delete(m_config);
+		}
+
+		void newNodeManager()
+		{
+			m_nodeManager.reset();
+			UA_Server_delete(m_server);
+			UA_ServerConfig_delete(m_config);
+			m_config = UA_ServerConfig_new_default();
+			m_server = UA_Server_new(m_config);
+			m_nodeManager.reset(new NodeManagerBase("urn:test", true, 1000));
+			m_nodeManager->linkServer(m_server);
+		}
+
+		//! A fresh path in the temporary directory, for address space images
+		static std::string imagePath()
+		{
+			return (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("nodemanagerbase_test-%%%%-%%%%.bin")).string();
+		}
+
+		bool inServer(const char* nodeId) const
+		{
+			void* context = 0;
+			return UA_Server_getNodeContext(m_server, UaNodeId(nodeId, 2).impl(), &context) == UA_STATUSCODE_GOOD;
+		}
+
+		UaNode* objectsFolder() const { return m_nodeManager->getNode(UaNodeId(OpcUaId_ObjectsFolder, 0)); }
+
+		//! An Int32 array variable under the Objects folder holding 0, 1, ... numElements-1
+		OpcUa::BaseDataVariableType* addArrayVariable( const char* nodeId, int numElements )
+		{
+			UaInt32Array array;
+			array.create(numElements);
+			for (int i=0; i<numElements; ++i)
+				array[i] = i;
+			UaVariant value;
+			value.setInt32Array(array);
+			OpcUa::BaseDataVariableType* variable = new OpcUa::BaseDataVariableType(
+					UaNodeId(nodeId, 2), nodeId, 2, value, OpcUa_AccessLevels_CurrentReadOrWrite, m_nodeManager.get());
+			EXPECT_TRUE(m_nodeManager->addNodeAndReference(objectsFolder(), variable, OpcUaId_Organizes).isGood());
+			return variable;
+		}
+
+		//! Writes values to the IndexRange (e.g. "2:3") of the variable, as a client does
+		UA_StatusCode writeRange( const char* nodeId, const char* indexRange, const std::vector<OpcUa_Int32>& values )
+		{
+			const UaNodeId id (nodeId, 2);
+			UA_WriteValue writeValue;
+			std::memset(&writeValue, 0, sizeof writeValue);
+			writeValue.nodeId = *id.pimpl();
+			writeValue.attributeId = UA_ATTRIBUTEID_VALUE;
+			writeValue.indexRange = UA_STRING(const_cast<char*>(indexRange));
+			UA_Variant_setArray(&writeValue.value.value, const_cast<OpcUa_Int32*>(&values[0]), values.size(), &UA_TYPES[UA_TYPES_INT32]);
+			writeValue.value.hasValue = true;
+			return UA_Server_write(m_server, &writeValue);
+		}
+
+		//! Devices under the Objects folder, each with a variable and a method taking one argument
+		std::vector<NodeManagerBase::NodeAndReference> devices( int numDevices )
+		{
+			std::vector<NodeManagerBase::NodeAndReference> nodes;
+			for (int i=0; i<numDevices; ++i)
+			{
+				const std::string name = "dev" + boost::lexical_cast<std::string>(i);
+				OpcUa::BaseObjectType* device = new OpcUa::BaseObjectType(UaNodeId(name.c_str(), 2), name.c_str(), 2, m_nodeManager.get());
+				nodes.push_back(NodeManagerBase::NodeAndReference(objectsFolder(), device, OpcUaId_Organizes));
+				OpcUa::BaseDataVariableType* variable = new OpcUa::BaseDataVariableType(
+						UaNodeId((name+".value").c_str(), 2), "value", 2, UaVariant(OpcUa_Double(i)), OpcUa_AccessLevels_CurrentReadOrWrite, m_nodeManager.get());
+				nodes.push_back(NodeManagerBase::NodeAndReference(device, variable, OpcUaId_HasComponent));
+				OpcUa::BaseMethod* method = new OpcUa::BaseMethod(UaNodeId((name+".reset").c_str(), 2), "reset", 2);
+				UaPropertyMethodArgument* arguments = new UaPropertyMethodArgument(
+						UaNodeId((name+".reset.args").c_str(), 2), OpcUa_AccessLevels_CurrentRead, 1, UaPropertyMethodArgument::INARGUMENTS);
+				UaUInt32Array dimensions;
+				dimensions.create(1);
+				dimensions[0] = 4;
+				arguments->setArgument(0, "delay", UaNodeId(OpcUaType_Double, 0), 1, dimensions, UaLocalizedText("en", "per channel"));
+				nodes.push_back(NodeManagerBase::NodeAndReference(method, arguments, OpcUaId_HasProperty));
+				nodes.push_back(NodeManagerBase::NodeAndReference(device, method, OpcUaId_HasComponent));
+			}
+			return nodes;
+		}
+
+		//! Everything reachable from the Objects folder: references in order, and what the server knows about each target
+		std::string describe() const
+		{
+			std::ostringstream out;
+			std::vector<const UaNode*> stack (1, objectsFolder());
+			while (!stack.empty())
+			{
+				const UaNode* node = stack.back();
+				stack.pop_back();
+				BOOST_FOREACH (const UaNode::ReferencedTarget& reference, *node->referencedTargets())
+				{
+					const UaNodeId targetId = reference.target->nodeId();
+					out << node->nodeId().toString().toUtf8() << " " << reference.referenceTypeId.toString().toUtf8()
+						<< " " << targetId.toString().toUtf8();
+					void* context = 0;
+					if (UA_Server_getNodeContext(m_server, targetId.impl(), &context) == UA_STATUSCODE_GOOD)
+					{
+						out << " in server";
+						if (reference.target->nodeClass() == OpcUa_NodeClass_Method)
+						{
+							const MethodHandleUaNode* handle = static_cast<const MethodHandleUaNode*>(context);
+							out << (handle->pUaObject() == node && handle->pUaMethod() == reference.target ? " bound" : " unbound");
+						}
+						else if (context == reference.target)
+							out << " bound";
+					}
+					if (m_nodeManager->getNode(targetId) == reference.target)
+						out << " indexed";
+					out << "\n";
+					stack.push_back(reference.target);
+				}
+			}
+			return out.str();
+		}
+
+		UA_ServerConfig* m_config;
+		UA_Server* m_server;
+		boost::scoped_ptr<NodeManagerBase> m_nodeManager;
+	};
+}
+
+TEST_F(NodeManagerBaseTest, testBulkInsertionMatchesOneByOne)
+{
+	std::vector<NodeManagerBase::NodeAndReference> nodes = devices(3);
+	for (size_t i=0; i<nodes.size(); ++i)
+		ASSERT_TRUE(m_nodeManager->addNodeAndReference(nodes[i].parent, nodes[i].node, nodes[i].referenceTypeId).isGood());
+	const std::string oneByOne = describe();
+	EXPECT_NE(std::string::npos, oneByOne.find("dev2 (ns=0,47) dev2.reset in server bound indexed")) << oneByOne;
+
+	newNodeManager();
+	ASSERT_TRUE(m_nodeManager->addNodesAndReferences(devices(3)).isGood());
+	EXPECT_EQ(oneByOne, describe());
+}
+
+TEST_F(NodeManagerBaseTest, testParallelPreparationMatchesSerial)
+{
+	// more nodes than a chunk of the preparation pipeline, so that several workers take part
+	ASSERT_TRUE(m_nodeManager->addNodesAndReferences(devices(300), 1).isGood());
+	const std::string serial = describe();
+
+	newNodeManager();
+	ASSERT_TRUE(m_nodeManager->addNodesAndReferences(devices(300), 4).isGood());
+	EXPECT_EQ(serial, describe());
+	EXPECT_TRUE(m_nodeManager->getNode(UaNodeId("dev299.value", 2)) != 0);
+}
+
+TEST_F(NodeManagerBaseTest, testFailedPreparationStopsInsertion)
+{
+	std::string serial;
+	for (unsigned int threads = 1; threads <= 4; threads += 3)
+	{
+		newNodeManager();
+		std::vector<NodeManagerBase::NodeAndReference> nodes = devices(100);
+		const size_t broken = 200; // the first node of the 51st device
+		delete nodes[broken].node;
+		nodes[broken].node = new BrokenVariable(UaNodeId("broken", 2));
+		EXPECT_THROW(m_nodeManager->addNodesAndReferences(nodes, threads), std::logic_error) << threads << " thread(s)";
+
+		EXPECT_TRUE(m_nodeManager->getNode(UaNodeId("dev49.reset", 2)) != 0) << "nodes before the failure stay";
+		EXPECT_TRUE(m_nodeManager->getNode(UaNodeId("broken", 2)) == 0);
+		EXPECT_TRUE(m_nodeManager->getNode(UaNodeId("dev50.value", 2)) == 0) << "nothing after it is added";
+		void* context = 0;
+		EXPECT_EQ(UA_STATUSCODE_BADNODEIDUNKNOWN, UA_Server_getNodeContext(m_server, UaNodeId("dev50.value", 2).impl(), &context));
+		EXPECT_TRUE(nodes[broken+3].node->referencedTargets()->empty()) << "dev50.reset's argument property isn't linked either";
+		if (threads == 1)
+			serial = describe();
+		else
+			EXPECT_EQ(serial, describe()) << "the same address space, whatever the number of threads";
+		for (size_t i=broken; i<nodes.size(); ++i)
+			if (!(nodes[i].referenceTypeId == OpcUaId_HasProperty))
+				delete nodes[i].node; // not owned by the NodeManagerBase
+	}
+}
+
+TEST_F(NodeManagerBaseTest, testFailedCommitStopsInsertion)
+{
+	std::vector<NodeManagerBase::NodeAndReference> nodes = devices(2);
+	// the second device reuses the NodeId of the first one's variable: the server refuses it
+	OpcUa::BaseObjectType* clash = new OpcUa::BaseObjectType(UaNodeId("dev0.value", 2), "clash", 2, m_nodeManager.get());
+	nodes.push_back(NodeManagerBase::NodeAndReference(objectsFolder(), clash, OpcUaId_Organizes));
+	EXPECT_EQ(UA_STATUSCODE_BADNODEIDEXISTS, m_nodeManager->addNodesAndReferences(nodes, 4).statusCode());
+	EXPECT_TRUE(m_nodeManager->getNode(UaNodeId("dev1.reset", 2)) != 0);
+	EXPECT_NE(clash, m_nodeManager->getNode(UaNodeId("dev0.value", 2)));
+	delete clash;
+}
+
+TEST_F(NodeManagerBaseTest, testAddressSpaceImageRoundTrip)
+{
+	const std::string path = imagePath();
+	ASSERT_TRUE(m_nodeManager->addNodesAndReferences(devices(3)).isGood());
+	// another hierarchical reference to a node already added: the node is still saved once
+	m_nodeManager->getNode(UaNodeId("dev0", 2))->addReferencedTarget(m_nodeManager->getNode(UaNodeId("dev1.value", 2)), OpcUaId_Organizes);
+	ASSERT_TRUE(m_nodeManager->saveAddressSpaceImage(path, 42).isGood());
+	const std::string cold = describe();
+
+	{
+		AddressSpaceImageReader image (path, 42);
+		EXPECT_EQ(9, image.numNodes());
+		AddressSpaceImageNode node;
+		for (size_t i=0; i<image.numNodes(); ++i)
+		{
+			image.node(i, node);
+			if (node.nodeClass != OpcUa_NodeClass_Method)
+				continue;
+			ASSERT_EQ(1, node.inputArguments.size());
+			const UA_Argument& argument = node.inputArguments[0];
+			EXPECT_EQ(1, argument.valueRank);
+			ASSERT_EQ(1, argument.arrayDimensionsSize);
+			EXPECT_EQ(4, argument.arrayDimensions[0]);
+			EXPECT_EQ("per channel", std::string(reinterpret_cast<const char*>(argument.description.text.data), argument.description.text.length));
+		}
+	}
+
+	newNodeManager();
+	ASSERT_TRUE(m_nodeManager->loadAddressSpaceImage(path, 42).isGood());
+	ASSERT_TRUE(m_nodeManager->addNodesAndReferences(devices(3)).isGood());
+	m_nodeManager->getNode(UaNodeId("dev0", 2))->addReferencedTarget(m_nodeManager->getNode(UaNodeId("dev1.value", 2)), OpcUaId_Organizes);
+	EXPECT_EQ(cold, describe()) << "warm start builds the same address space";
+	EXPECT_EQ(0, m_nodeManager->numUnclaimedImageNodes());
+	std::remove(path.c_str());
+}
+
+TEST_F(NodeManagerBaseTest, testAddressSpaceImageReplacesConstruction)
+{
+	const std::string path = imagePath();
+	ASSERT_TRUE(m_nodeManager->addNodesAndReferences(devices(3)).isGood());
+	ASSERT_TRUE(m_nodeManager->saveAddressSpaceImage(path, 42).isGood());
+	const std::string cold = describe();
+
+	newNodeManager();
+	m_nodeManager->enableStartupProfiling();
+	ASSERT_TRUE(m_nodeManager->loadAddressSpaceImage(path, 42).isGood());
+	ASSERT_TRUE(m_nodeManager->addNodesAndReferences(devices(3), 4).isGood());
+	EXPECT_EQ(cold, describe());
+	const StartupProfiler* profiler = m_nodeManager->startupProfiler();
+	EXPECT_EQ(0, profiler->counters(StartupProfiler::Preparation, StartupProfiler::Object).calls) << "nodes in the image aren't prepared";
+	EXPECT_EQ(0, profiler->counters(StartupProfiler::Preparation, StartupProfiler::Variable).calls);
+	EXPECT_EQ(0, profiler->counters(StartupProfiler::Preparation, StartupProfiler::Method).calls);
+	EXPECT_EQ(0, profiler->counters(StartupProfiler::ServerInsertion, StartupProfiler::Object).calls) << "nor inserted";
+	EXPECT_EQ(3, profiler->counters(StartupProfiler::Registration, StartupProfiler::Property).calls) << "properties are just linked";
+	std::remove(path.c_str());
+}
+
+TEST_F(NodeManagerBaseTest, testAddressSpaceImageNodeWhichDiffersIsRebuilt)
+{
+	const std::string path = imagePath();
+	ASSERT_TRUE(m_nodeManager->addNodesAndReferences(devices(2)).isGood());
+	ASSERT_TRUE(m_nodeManager->saveAddressSpaceImage(path, 42).isGood());
+
+	// dev0.value with another reference type, dev1.value under dev0
+	newNodeManager();
+	std::vector<NodeManagerBase::NodeAndReference> nodes = devices(2);
+	nodes[1].referenceTypeId = OpcUaId_Organizes;
+	nodes[5].parent = nodes[0].node;
+	ASSERT_TRUE(m_nodeManager->addNodesAndReferences(nodes).isGood());
+	const std::string cold = describe();
+
+	newNodeManager();
+	nodes = devices(2);
+	nodes[1].referenceTypeId = OpcUaId_Organizes;
+	nodes[5].parent = nodes[0].node;
+	ASSERT_TRUE(m_nodeManager->loadAddressSpaceImage(path, 42).isGood());
+	ASSERT_TRUE(m_nodeManager->addNodesAndReferences(nodes).isGood());
+	EXPECT_EQ(cold, describe());
+	EXPECT_EQ(0, m_nodeManager->numUnclaimedImageNodes());
+	std::remove(path.c_str());
+}
+
+TEST_F(NodeManagerBaseTest, testUnclaimedImageNodesRemoved)
+{
+	const std::string path = imagePath();
+	ASSERT_TRUE(m_nodeManager->addNodesAndReferences(devices(3)).isGood());
+	ASSERT_TRUE(m_nodeManager->saveAddressSpaceImage(path, 42).isGood());
+	newNodeManager();
+	ASSERT_TRUE(m_nodeManager->addNodesAndReferences(devices(2)).isGood());
+	const std::string cold = describe();
+
+	newNodeManager();
+	ASSERT_TRUE(m_nodeManager->loadAddressSpaceImage(path, 42).isGood());
+	ASSERT_TRUE(m_nodeManager->addNodesAndReferences(devices(2)).isGood());
+	EXPECT_EQ(3, m_nodeManager->numUnclaimedImageNodes());
+	EXPECT_TRUE(inServer("dev2.value"));
+	EXPECT_EQ(3, m_nodeManager->removeUnclaimedImageNodes());
+	EXPECT_FALSE(inServer("dev2"));
+	EXPECT_FALSE(inServer("dev2.value"));
+	EXPECT_FALSE(inServer("dev2.reset"));
+	EXPECT_EQ(0, m_nodeManager->numUnclaimedImageNodes());
+	EXPECT_EQ(cold, describe());
+	std::remove(path.c_str());
+}
+
+TEST_F(NodeManagerBaseTest, testFailedImageLoadRolledBack)
+{
+	const std::string path = imagePath();
+	ASSERT_TRUE(m_nodeManager->addNodesAndReferences(devices(2)).isGood());
+	ASSERT_TRUE(m_nodeManager->saveAddressSpaceImage(path, 42).isGood());
+
+	newNodeManager();
+	// the server has a node of that NodeId already: loading fails there, after adding the nodes before it
+	UA_ObjectAttributes attributes;
+	UA_ObjectAttributes_init(&attributes);
+	ASSERT_EQ(UA_STATUSCODE_GOOD, UA_Server_addObjectNode(m_server, UaNodeId("dev1.value", 2).impl(), UaNodeId(OpcUaId_ObjectsFolder, 0).impl(),
+			OpcUaId_Organizes.impl(), UaQualifiedName(2, "clash").impl(), UaNodeId(UA_NS0ID_BASEOBJECTTYPE, 0).impl(), attributes, 0, 0));
+	EXPECT_FALSE(m_nodeManager->loadAddressSpaceImage(path, 42).isGood());
+	EXPECT_FALSE(inServer("dev0")) << "what was loaded is removed again";
+	EXPECT_FALSE(inServer("dev0.value"));
+	EXPECT_FALSE(inServer("dev1"));
+	EXPECT_TRUE(inServer("dev1.value")) << "what was there before stays";
+	EXPECT_EQ(0, m_nodeManager->numUnclaimedImageNodes());
+	std::remove(path.c_str());
+}
+
+TEST_F(NodeManagerBaseTest, testDeleteLeaf)
+{
+	ASSERT_TRUE(m_nodeManager->addNodesAndReferences(devices(2)).isGood());
+	UaNode* device = m_nodeManager->getNode(UaNodeId("dev0", 2));
+
+	EXPECT_TRUE(m_nodeManager->deleteNode(UaNodeId("dev0.value", 2)).isGood());
+	EXPECT_TRUE(m_nodeManager->getNode(UaNodeId("dev0.value", 2)) == 0);
+	void* context = 0;
+	EXPECT_EQ(UA_STATUSCODE_BADNODEIDUNKNOWN, UA_Server_getNodeContext(m_server, UaNodeId("dev0.value", 2).impl(), &context));
+	EXPECT_TRUE(device->referencedTargets(OpcUaId_HasComponent).size() == 1) << "only the method is left";
+	EXPECT_EQ(std::string::npos, describe().find("dev0.value"));
+	EXPECT_NE(std::string::npos, describe().find("dev1.value in server bound indexed"));
+
+	EXPECT_EQ(OpcUa_BadNodeIdUnknown, m_nodeManager->deleteNode(UaNodeId("dev0.value", 2)).statusCode());
+}
+
+TEST_F(NodeManagerBaseTest, testDeleteRefused)
+{
+	ASSERT_TRUE(m_nodeManager->addNodesAndReferences(devices(2)).isGood());
+	const std::string before = describe();
+
+	EXPECT_EQ(OpcUa_BadInvalidState, m_nodeManager->deleteNode(UaNodeId("dev0", 2)).statusCode()) << "has children";
+	EXPECT_EQ(OpcUa_BadNodeIdUnknown, m_nodeManager->deleteNode(UaNodeId("nosuchnode", 2)).statusCode());
+	EXPECT_EQ(OpcUa_BadNodeIdUnknown, m_nodeManager->deleteSubtree(UaNodeId(OpcUaId_ObjectsFolder, 0)).statusCode()) << "not ours";
+	EXPECT_EQ(before, describe());
+}
+
+TEST_F(NodeManagerBaseTest, testDeleteSubtree)
+{
+	std::vector<NodeManagerBase::NodeAndReference> nodes = devices(3);
+	ASSERT_TRUE(m_nodeManager->addNodesAndReferences(nodes).isGood());
+	EXPECT_TRUE(m_nodeManager->deleteSubtree(UaNodeId("dev1", 2)).isGood());
+	const std::string afterDeletion = describe();
+
+	// the same as if dev1 had never been there
+	newNodeManager();
+	nodes = devices(3);
+	std::vector<NodeManagerBase::NodeAndReference> withoutDev1;
+	for (size_t i=0; i<nodes.size(); ++i)
+	{
+		if (i >= 4 && i < 8)
+		{
+			if (!(nodes[i].referenceTypeId == OpcUaId_HasProperty))
+				delete nodes[i].node;
+		}
+		else
+			withoutDev1.push_back(nodes[i]);
+	}
+	ASSERT_TRUE(m_nodeManager->addNodesAndReferences(withoutDev1).isGood());
+	EXPECT_EQ(describe(), afterDeletion);
+	void* context = 0;
+	EXPECT_EQ(UA_STATUSCODE_BADNODEIDUNKNOWN, UA_Server_getNodeContext(m_server, UaNodeId("dev1.reset", 2).impl(), &context));
+}
+
+TEST_F(NodeManagerBaseTest, testDeleteRemovesReferencesToAndFromIt)
+{
+	ASSERT_TRUE(m_nodeManager->addNodesAndReferences(devices(3)).isGood());
+	UaNode* dev0 = m_nodeManager->getNode(UaNodeId("dev0", 2));
+	UaNode* dev2 = m_nodeManager->getNode(UaNodeId("dev2", 2));
+	UaNode* dev1Value = m_nodeManager->getNode(UaNodeId("dev1.value", 2));
+	dev0->addReferencedTarget(dev1Value, OpcUaId_Organizes); // into the subtree
+	dev2->addReferencedTarget(m_nodeManager->getNode(UaNodeId("dev1", 2)), OpcUaId_Organizes); // to its root
+	dev1Value->addReferencedTarget(dev2, OpcUaId_Organizes); // out of it
+
+	EXPECT_TRUE(m_nodeManager->deleteSubtree(UaNodeId("dev1", 2)).isGood());
+	EXPECT_TRUE(dev0->referencedTargets(OpcUaId_Organizes).empty()) << "no reference left into freed memory";
+	EXPECT_TRUE(dev2->referencedTargets(OpcUaId_Organizes).empty());
+	EXPECT_EQ(std::string::npos, describe().find("dev1"));
+
+	// dev2 doesn't remember being referenced by the deleted dev1.value either
+	EXPECT_TRUE(m_nodeManager->deleteSubtree(UaNodeId("dev2", 2)).isGood());
+	EXPECT_TRUE(m_nodeManager->deleteSubtree(UaNodeId("dev0", 2)).isGood());
+	EXPECT_TRUE(objectsFolder()->referencedTargets()->empty());
+}
+
+TEST_F(NodeManagerBaseTest, testDeleteSubtreeRefusedPartway)
+{
+	ASSERT_TRUE(m_nodeManager->addNodesAndReferences(devices(2)).isGood());
+	UaNode* dev0 = m_nodeManager->getNode(UaNodeId("dev0", 2));
+	UaNode* dev1 = m_nodeManager->getNode(UaNodeId("dev1", 2));
+	UaNode* dev1Value = m_nodeManager->getNode(UaNodeId("dev1.value", 2));
+	dev0->addReferencedTarget(dev1Value, OpcUaId_Organizes);
+	dev0->addReferencedTarget(m_nodeManager->getNode(UaNodeId("dev1.reset", 2)), OpcUaId_Organizes);
+	// the server doesn't delete a node which has instances: dev1.value, after dev1.reset (children go first, the last one first)
+	const UaNodeId instanceId ("dev0", 2);
+	UA_ExpandedNodeId instance;
+	std::memset(&instance, 0, sizeof instance);
+	instance.nodeId = *instanceId.pimpl();
+	ASSERT_EQ(UA_STATUSCODE_GOOD, UA_Server_addReference(m_server, UaNodeId("dev1.value", 2).impl(),
+			UaNodeId(UA_NS0ID_HASTYPEDEFINITION, 0).impl(), instance, /*isForward*/ false));
+
+	EXPECT_EQ(UA_STATUSCODE_BADINTERNALERROR, m_nodeManager->deleteSubtree(UaNodeId("dev1", 2)).statusCode());
+	EXPECT_TRUE(m_nodeManager->getNode(UaNodeId("dev1.reset", 2)) == 0) << "removed by the server before it refused";
+	EXPECT_FALSE(inServer("dev1.reset"));
+	EXPECT_EQ(dev1Value, m_nodeManager->getNode(UaNodeId("dev1.value", 2)));
+	EXPECT_EQ(dev1, m_nodeManager->getNode(UaNodeId("dev1", 2)));
+	ASSERT_EQ(1, dev1->referencedTargets()->size());
+	EXPECT_EQ(dev1Value, dev1->referencedTargets()->begin()->target);
+	ASSERT_EQ(1, dev0->referencedTargets(OpcUaId_Organizes).size()) << "only the reference to the removed node is gone";
+	EXPECT_EQ(dev1Value, dev0->referencedTargets(OpcUaId_Organizes).begin()->target);
+}
+
+TEST_F(NodeManagerBaseTest, testEmptyingFolder)
+{
+	// one by one from the front: each removal leaves a hole, squeezed out now and then
+	OpcUa::BaseObjectType* folder = new OpcUa::BaseObjectType(UaNodeId("folder", 2), "folder", 2, m_nodeManager.get());
+	ASSERT_TRUE(m_nodeManager->addNodeAndReference(objectsFolder(), folder, OpcUaId_Organizes).isGood());
+	const int numChildren = 1000;
+	for (int i=0; i<numChildren; ++i)
+	{
+		const std::string name = "child" + boost::lexical_cast<std::string>(i);
+		ASSERT_TRUE(m_nodeManager->addNodeAndReference(folder,
+				new OpcUa::BaseObjectType(UaNodeId(name.c_str(), 2), name.c_str(), 2, m_nodeManager.get()), OpcUaId_Organizes).isGood());
+	}
+	for (int i=0; i<numChildren; ++i)
+	{
+		const std::string name = "child" + boost::lexical_cast<std::string>(i);
+		ASSERT_TRUE(m_nodeManager->deleteNode(UaNodeId(name.c_str(), 2)).isGood());
+		ASSERT_EQ(numChildren - i - 1, folder->referencedTargets()->size());
+		if (i + 1 < numChildren)
+			ASSERT_TRUE(folder->referencedTargets()->begin()->target->nodeId() == UaNodeId(("child" + boost::lexical_cast<std::string>(i + 1)).c_str(), 2));
+	}
+}
+
+TEST_F(NodeManagerBaseTest, testDeletedMethodsHandleReused)
+{
+	ASSERT_TRUE(m_nodeManager->addNodesAndReferences(devices(2)).isGood());
+	void* handle = 0;
+	ASSERT_EQ(UA_STATUSCODE_GOOD, UA_Server_getNodeContext(m_server, UaNodeId("dev0.reset", 2).impl(), &handle));
+	EXPECT_TRUE(m_nodeManager->deleteNode(UaNodeId("dev0.reset", 2)).isGood());
+	EXPECT_TRUE(static_cast<MethodHandleUaNode*>(handle)->pUaMethod() == 0) << "released";
+
+	UaNode* device = m_nodeManager->getNode(UaNodeId("dev1", 2));
+	OpcUa::BaseMethod* method = new OpcUa::BaseMethod(UaNodeId("dev1.calibrate", 2), "calibrate", 2);
+	ASSERT_TRUE(m_nodeManager->addNodeAndReference(device, method, OpcUaId_HasComponent).isGood());
+	void* newHandle = 0;
+	ASSERT_EQ(UA_STATUSCODE_GOOD, UA_Server_getNodeContext(m_server, UaNodeId("dev1.calibrate", 2).impl(), &newHandle));
+	EXPECT_EQ(handle, newHandle);
+	EXPECT_TRUE(static_cast<MethodHandleUaNode*>(newHandle)->pUaMethod() == static_cast<UaMethod*>(method));
+	EXPECT_TRUE(static_cast<MethodHandleUaNode*>(newHandle)->pUaObject() == static_cast<UaObject*>(device));
+}
+
+TEST_F(NodeManagerBaseTest, testDeletedArenaNodesRecycled)
+{
+	m_nodeManager->useNodeArena();
+	OpcUa::BaseObjectType* device = m_nodeManager->createNode<OpcUa::BaseObjectType>(UaNodeId("dev", 2), "dev", 2, m_nodeManager.get());
+	ASSERT_TRUE(m_nodeManager->addNodeAndReference(objectsFolder(), device, OpcUaId_Organizes).isGood());
+	OpcUa::BaseDataVariableType* variable = m_nodeManager->createNode<OpcUa::BaseDataVariableType>(
+			UaNodeId("dev.a", 2), "a", 2, UaVariant(OpcUa_Double(1)), OpcUa_AccessLevels_CurrentRead, m_nodeManager.get());
+	ASSERT_TRUE(m_nodeManager->addNodeAndReference(device, variable, OpcUaId_HasComponent).isGood());
+
+	EXPECT_TRUE(m_nodeManager->deleteNode(UaNodeId("dev.a", 2)).isGood());
+	OpcUa::BaseDataVariableType* another = m_nodeManager->createNode<OpcUa::BaseDataVariableType>(
+			UaNodeId("dev.b", 2), "b", 2, UaVariant(OpcUa_Double(2)), OpcUa_AccessLevels_CurrentRead, m_nodeManager.get());
+	EXPECT_EQ(variable, another) << "memory of the deleted node reused";
+	ASSERT_TRUE(m_nodeManager->addNodeAndReference(device, another, OpcUaId_HasComponent).isGood());
+	EXPECT_EQ(another, m_nodeManager->getNode(UaNodeId("dev.b", 2)));
+	EXPECT_TRUE(m_nodeManager->deleteSubtree(UaNodeId("dev", 2)).isGood());
+}
+
+TEST_F(NodeManagerBaseTest, testClientReadGoesThroughValueOverride)
+{
+	ComputedVariable* variable = new ComputedVariable(UaNodeId("computed", 2), m_nodeManager.get());
+	ASSERT_TRUE(m_nodeManager->addNodeAndReference(objectsFolder(), variable, OpcUaId_Organizes).isGood());
+
+	UA_Variant read;
+	UA_Variant_init(&read);
+	ASSERT_EQ(UA_STATUSCODE_GOOD, UA_Server_readValue(m_server, UaNodeId("computed", 2).impl(), &read));
+	ASSERT_EQ(&UA_TYPES[UA_TYPES_DOUBLE], read.type);
+	EXPECT_EQ(42, *static_cast<OpcUa_Double*>(read.data)) << "not the value held by BaseDataVariableType";
+	UA_Variant_deleteMembers(&read);
+}
+
+TEST_F(NodeManagerBaseTest, testIndexRangeWrite)
+{
+	OpcUa::BaseDataVariableType* variable = addArrayVariable("array", 10);
+	std::vector<OpcUa_Int32> slice;
+	slice.push_back(20);
+	slice.push_back(30);
+	ASSERT_EQ(UA_STATUSCODE_GOOD, writeRange("array", "2:3", slice));
+
+	const UA_Variant& written = variable->valueImpl()->value;
+	ASSERT_EQ(10u, written.arrayLength);
+	const OpcUa_Int32* elements = static_cast<const OpcUa_Int32*>(written.data);
+	EXPECT_EQ(1, elements[1]);
+	EXPECT_EQ(20, elements[2]);
+	EXPECT_EQ(30, elements[3]);
+	EXPECT_EQ(4, elements[4]);
+	EXPECT_EQ(UA_STATUSCODE_BADINDEXRANGEINVALID, writeRange("array", "9:10", slice));
+}
+
+TEST_F(NodeManagerBaseTest, testConcurrentIndexRangeWritesAllKept)
+{
+	const int numThreads = 4;
+	OpcUa::BaseDataVariableType* variable = addArrayVariable("array", numThreads);
+	std::vector<std::thread> threads;
+	for (int t=0; t<numThreads; ++t)
+		threads.push_back(std::thread([this, t]() {
+			const std::string indexRange = boost::lexical_cast<std::string>(t);
+			for (int i=1; i<=200; ++i)
+				writeRange("array", indexRange.c_str(), std::vector<OpcUa_Int32>(1, 1000*t + i)); // each thread its own element
+		}));
+	for (size_t t=0; t<threads.size(); ++t)
+		threads[t].join();
+	const OpcUa_Int32* elements = static_cast<const OpcUa_Int32*>(variable->valueImpl()->value.data);
+	for (int t=0; t<numThreads; ++t)
+		EXPECT_EQ(1000*t + 200, elements[t]) << "no write undone by another one's read-modify-write";
+}
+
+TEST_F(NodeManagerBaseTest, testIndexRangeRead)
+{
+	addArrayVariable("array", 10);
+	const UaNodeId id ("array", 2);
+	UA_ReadValueId readValueId;
+	std::memset(&readValueId, 0, sizeof readValueId);
+	readValueId.nodeId = *id.pimpl();
+	readValueId.attributeId = UA_ATTRIBUTEID_VALUE;
+	readValueId.indexRange = UA_STRING(const_cast<char*>("5:7"));
+	UA_DataValue read = UA_Server_read(m_server, &readValueId, UA_TIMESTAMPSTORETURN_BOTH);
+	ASSERT_TRUE(read.hasValue);
+	ASSERT_EQ(3u, read.value.arrayLength) << "only the slice";
+	EXPECT_EQ(5, static_cast<OpcUa_Int32*>(read.value.data)[0]);
+	EXPECT_EQ(7, static_cast<OpcUa_Int32*>(read.value.data)[2]);
+	UA_DataValue_deleteMembers(&read);
+}
+
+TEST_F(NodeManagerBaseTest, testVariableStatisticsRetriedAfterFailure)
+{
+	ASSERT_TRUE(m_nodeManager->addNodesAndReferences(devices(2)).isGood());
+	const UaNodeId dev0Statistics (UaString(("VariableStatistics." + UaNodeId("dev0.value", 2).toString().toUtf8()).c_str()), 2);
+	const UaNodeId dev1Statistics (UaString(("VariableStatistics." + UaNodeId("dev1.value", 2).toString().toUtf8()).c_str()), 2);
+	// a node of that id which NodeManagerBase doesn't know about makes the server refuse dev1's statistics
+	UA_ObjectAttributes attributes;
+	UA_ObjectAttributes_init(&attributes);
+	ASSERT_EQ(UA_STATUSCODE_GOOD, UA_Server_addObjectNode(m_server, dev1Statistics.impl(), UaNodeId(OpcUaId_ObjectsFolder, 0).impl(),
+			OpcUaId_Organizes.impl(), UaQualifiedName(2, "squatter").impl(), UaNodeId(UA_NS0ID_BASEOBJECTTYPE, 0).impl(), attributes, 0, 0));
+
+	EXPECT_TRUE(m_nodeManager->enableVariableStatistics().isNotGood());
+	EXPECT_TRUE(m_nodeManager->getNode(dev0Statistics) == 0) << "what made it is rolled back";
+
+	ASSERT_EQ(UA_STATUSCODE_GOOD, UA_Server_deleteNode(m_server, dev1Statistics.impl(), true));
+	EXPECT_TRUE(m_nodeManager->enableVariableStatistics().isGood());
+	EXPECT_TRUE(m_nodeManager->getNode(dev0Statistics) != 0) << "not skipped for its statistics being on already";
+	EXPECT_TRUE(m_nodeManager->getNode(dev1Statistics) != 0);
+	EXPECT_TRUE(m_nodeManager->enableVariableStatistics().isGood()) << "nothing left to publish";
+}
+
+TEST_F(NodeManagerBaseTest, testClientWriteGoesThroughSetValueOverride)
+{
+	RecordingVariable* variable = new RecordingVariable(UaVariant(OpcUa_Double(0)), m_nodeManager.get());
+	ASSERT_TRUE(m_nodeManager->addNodeAndReference(objectsFolder(), variable, OpcUaId_Organizes).isGood());
+
+	UA_Variant written;
+	UA_Variant_init(&written);
+	OpcUa_Double value = 4.5;
+	UA_Variant_setScalar(&written, &value, &UA_TYPES[UA_TYPES_DOUBLE]);
+	EXPECT_EQ(UA_STATUSCODE_GOOD, UA_Server_writeValue(m_server, UaNodeId("recording", 2).impl(), written));
+	EXPECT_EQ(1, variable->m_calls);
+	EXPECT_EQ(4.5, *static_cast<OpcUa_Double*>(variable->valueImpl()->value.data));
+}
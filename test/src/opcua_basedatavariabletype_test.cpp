@@ -0,0 +1,160 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * opcua_basedatavariabletype_test.cpp
+ *
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "opcua_basedatavariabletype.h"
+#include "recordingvariable.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	class BaseDataVariableTypeTest: public ::testing::Test
+	{
+	protected:
+		BaseDataVariableTypeTest():
+			m_testee(UaNodeId(UaString("v"), 2), UaString("v"), 2, UaVariant(OpcUa_Double(0)), OpcUa_AccessLevels_CurrentReadOrWrite, 0)
+		{}
+
+		void update( OpcUa_Double v, OpcUa_StatusCode status = OpcUa_Good, Session* session = 0 )
+		{
+			m_testee.setValue(session, UaDataValue(UaVariant(v), status, UaDateTime::now(), UaDateTime::now()), OpcUa_False);
+		}
+
+		OpcUa_Double current() const { return *static_cast<OpcUa_Double*>(m_testee.valueImpl()->value.data); }
+
+		OpcUa::BaseDataVariableType m_testee;
+	};
+}
+
+TEST_F(BaseDataVariableTypeTest, testAbsoluteDeadband)
+{
+	m_testee.setAbsoluteDeadband(0.5);
+	update(0.3);
+	EXPECT_EQ(0, current()) << "within the deadband of the initial value";
+	update(0.6);
+	EXPECT_EQ(0.6, current());
+	update(1.0);
+	update(0.2);
+	EXPECT_EQ(0.6, current()) << "compared with the last value let through, not the last update";
+	EXPECT_EQ(3u, m_testee.suppressedUpdates());
+
+	update(0.6, OpcUa_Bad);
+	EXPECT_EQ(OpcUa_Bad, m_testee.valueImpl()->status) << "a change of status always goes through";
+
+	update(0.61, OpcUa_Bad, reinterpret_cast<Session*>(-1));
+	EXPECT_EQ(0.61, current()) << "writes of clients aren't filtered";
+
+	m_testee.clearDeadband();
+	update(0.62, OpcUa_Bad);
+	EXPECT_EQ(0.62, current());
+	EXPECT_EQ(3u, m_testee.suppressedUpdates());
+}
+
+TEST_F(BaseDataVariableTypeTest, testPercentDeadband)
+{
+	m_testee.setPercentDeadband(1, -100, 100); // i.e. 2.0
+	update(1.9);
+	update(2.1);
+	EXPECT_EQ(2.1, current());
+	EXPECT_EQ(1u, m_testee.suppressedUpdates());
+	EXPECT_THROW(m_testee.setPercentDeadband(101, 0, 1), std::invalid_argument);
+}
+
+TEST_F(BaseDataVariableTypeTest, testConcurrentUpdatesFilteredExactly)
+{
+	m_testee.setAbsoluteDeadband(0); // drops repeated values only
+	const int numThreads = 4;
+	const int updatesPerThread = 2000;
+	std::vector<std::thread> threads;
+	for (int t=0; t<numThreads; ++t)
+		threads.push_back(std::thread([this]() {
+			for (int i=0; i<updatesPerThread; ++i)
+				update(1.0);
+		}));
+	for (size_t t=0; t<threads.size(); ++t)
+		threads[t].join();
+	EXPECT_EQ(1.0, current());
+	EXPECT_EQ(numThreads * updatesPerThread - 1, m_testee.suppressedUpdates()) << "only the first one goes through";
+}
+
+TEST_F(BaseDataVariableTypeTest, testConcurrentUpdatesKeepLastValueLetThrough)
+{
+	m_testee.setAbsoluteDeadband(0.5);
+	const int numThreads = 4;
+	const int updatesPerThread = 200;
+	for (int round=0; round<200; ++round)
+	{
+		std::atomic<bool> start (false);
+		std::vector<std::thread> threads;
+		for (int t=0; t<numThreads; ++t)
+			threads.push_back(std::thread([this, t, &start]() {
+				while (!start);
+				for (int i=0; i<updatesPerThread; ++i)
+					update(t); // each thread its own value, all of them out of each other's deadband
+			}));
+		start = true;
+		for (size_t t=0; t<threads.size(); ++t)
+			threads[t].join();
+		const OpcUa_Double held = current();
+		const OpcUa_UInt64 suppressed = m_testee.suppressedUpdates();
+		update(held);
+		ASSERT_EQ(suppressed + 1, m_testee.suppressedUpdates()) << "the value held is the last one let through, in round " << round;
+	}
+}
+
+TEST(BaseDataVariableTypeSetValuesTest, testOneTimestampForAll)
+{
+	std::vector<OpcUa::BaseDataVariableType*> variables;
+	for (int i=0; i<10; ++i)
+		variables.push_back(new OpcUa::BaseDataVariableType(UaNodeId(i, 2), UaString("v"), 2, UaVariant(OpcUa_Int32(0)), OpcUa_AccessLevels_CurrentRead, 0));
+	variables[0]->setAbsoluteDeadband(5);
+
+	std::vector<UaVariant> values;
+	for (int i=0; i<10; ++i)
+		values.push_back(UaVariant(OpcUa_Int32(i+1)));
+	std::vector<OpcUa::BaseDataVariableType::Update> updates;
+	for (int i=0; i<10; ++i)
+	{
+		OpcUa::BaseDataVariableType::Update update = { variables[i], &values[i], OpcUa_Good };
+		updates.push_back(update);
+	}
+	EXPECT_TRUE(OpcUa::BaseDataVariableType::setValues(updates).isGood()) << "server-side updates ignore the access level";
+
+	EXPECT_EQ(0, *static_cast<OpcUa_Int32*>(variables[0]->valueImpl()->value.data)) << "dropped by the deadband";
+	EXPECT_EQ(1u, variables[0]->suppressedUpdates());
+	for (int i=1; i<10; ++i)
+	{
+		EXPECT_EQ(i+1, *static_cast<OpcUa_Int32*>(variables[i]->valueImpl()->value.data));
+		EXPECT_EQ(variables[1]->valueImpl()->sourceTimestamp, variables[i]->valueImpl()->sourceTimestamp);
+	}
+	for (int i=0; i<10; ++i)
+		delete variables[i];
+}
+
+TEST(BaseDataVariableTypeSetValuesTest, testSubclassesSetValueCalled)
+{
+	RecordingVariable variable (UaVariant(OpcUa_Double(0)));
+	const UaVariant value (OpcUa_Double(2.5));
+	OpcUa::BaseDataVariableType::Update update = { &variable, &value, OpcUa_Good };
+	EXPECT_TRUE(OpcUa::BaseDataVariableType::setValues(&update, 1).isGood());
+	EXPECT_EQ(1, variable.m_calls);
+	EXPECT_EQ(2.5, *static_cast<OpcUa_Double*>(variable.valueImpl()->value.data));
+}
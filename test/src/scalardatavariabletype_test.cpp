@@ -0,0 +1,107 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * scalardatavariabletype_test.cpp
+ *
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "scalardatavariabletype.h"
+
+#include <boost/scoped_ptr.hpp>
+#include <thread>
+
+namespace
+{
+	typedef OpcUa::ScalarDataVariableType<OpcUa_Double> DoubleVariable;
+
+	DoubleVariable* newVariable( OpcUa_Double initialValue )
+	{
+		return new DoubleVariable(UaNodeId(UaString("v"), 2), UaString("v"), 2, initialValue, OpcUa_AccessLevels_CurrentReadOrWrite, 0);
+	}
+}
+
+TEST(ScalarDataVariableTypeTest, testSetAndRead)
+{
+	boost::scoped_ptr<DoubleVariable> testee (newVariable(1.5));
+	EXPECT_EQ(1.5, testee->scalarValue());
+	EXPECT_EQ(UaNodeId(OpcUaType_Double, 0), testee->typeDefinitionId());
+
+	EXPECT_TRUE(testee->setScalarValue(2.5, OpcUa_Uncertain, UaDateTime(123)).isGood());
+	UA_DataValue read;
+	ASSERT_EQ(UA_STATUSCODE_GOOD, testee->copyValueTo(&read));
+	EXPECT_EQ(&UA_TYPES[UA_TYPES_DOUBLE], read.value.type);
+	EXPECT_EQ(2.5, *static_cast<OpcUa_Double*>(read.value.data));
+	EXPECT_EQ(OpcUa_Uncertain, read.status);
+	EXPECT_EQ(123, read.sourceTimestamp);
+	EXPECT_TRUE(read.hasServerTimestamp);
+	UA_DataValue_deleteMembers(&read);
+
+	UaDataValue value = testee->value(0);
+	EXPECT_EQ(2.5, *static_cast<OpcUa_Double*>(value.impl()->value.data));
+}
+
+TEST(ScalarDataVariableTypeTest, testNoValueAllocatedInBaseClass)
+{
+	boost::scoped_ptr<DoubleVariable> first (newVariable(1));
+	boost::scoped_ptr<DoubleVariable> second (newVariable(2));
+	EXPECT_FALSE(first->valueImpl()->hasValue);
+	EXPECT_EQ(first->valueImpl(), second->valueImpl()) << "both share the one empty value";
+}
+
+TEST(ScalarDataVariableTypeTest, testGenericSetValue)
+{
+	boost::scoped_ptr<DoubleVariable> testee (newVariable(0));
+	EXPECT_TRUE(testee->setValue(0, UaDataValue(UaVariant(OpcUa_Double(7)), OpcUa_Good, UaDateTime(1), UaDateTime(2)), OpcUa_False).isGood());
+	EXPECT_EQ(7, testee->scalarValue());
+	EXPECT_EQ(OpcUa_BadTypeMismatch,
+			testee->setValue(0, UaDataValue(UaVariant(OpcUa_Int32(8)), OpcUa_Good, UaDateTime(1), UaDateTime(2)), OpcUa_False).statusCode());
+	EXPECT_EQ(7, testee->scalarValue());
+}
+
+TEST(ScalarDataVariableTypeTest, testDeadbandAndStatistics)
+{
+	boost::scoped_ptr<DoubleVariable> testee (newVariable(10));
+	testee->setAbsoluteDeadband(1.0);
+	std::shared_ptr<VariableStatistics> statistics = testee->enableStatistics();
+	testee->setScalarValue(10.5);
+	EXPECT_EQ(10, testee->scalarValue());
+	EXPECT_EQ(1u, testee->suppressedUpdates());
+	testee->setScalarValue(12);
+	EXPECT_EQ(12, testee->scalarValue());
+	EXPECT_EQ(2u, statistics->count(VariableStatistics::Update));
+}
+
+TEST(ScalarDataVariableTypeTest, testConcurrentReadersSeeWholeValues)
+{
+	boost::scoped_ptr<OpcUa::ScalarDataVariableType<OpcUa_Int64> > testee (new OpcUa::ScalarDataVariableType<OpcUa_Int64>(
+			UaNodeId(UaString("v"), 2), UaString("v"), 2, 0, OpcUa_AccessLevels_CurrentRead, 0));
+	std::thread writer ([&testee]() {
+		for (OpcUa_Int64 i=1; i<=100000; ++i)
+			testee->setScalarValue(i, OpcUa_Good, UaDateTime(i));
+	});
+	for (int i=0; i<10000; ++i)
+	{
+		UA_DataValue read;
+		ASSERT_EQ(UA_STATUSCODE_GOOD, testee->copyValueTo(&read));
+		const OpcUa_Int64 value = *static_cast<OpcUa_Int64*>(read.value.data);
+		if (value)
+		{
+			EXPECT_EQ(value, read.sourceTimestamp) << "value and timestamp of the same update";
+		}
+		UA_DataValue_deleteMembers(&read);
+	}
+	writer.join();
+	EXPECT_EQ(100000, testee->scalarValue());
+}
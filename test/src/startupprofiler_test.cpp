@@ -0,0 +1,82 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * startupprofiler_test.cpp
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "startupprofiler.h"
+
+#include <thread>
+#include <vector>
+
+TEST(StartupProfilerTest, testScopesAccumulatePerPhaseAndKind)
+{
+	StartupProfiler testee;
+	for (int i=0; i<10; ++i)
+	{
+		StartupProfiler::Scope scope(&testee, StartupProfiler::ServerInsertion, StartupProfiler::Variable);
+		std::vector<int> allocation(100);
+	}
+	{
+		StartupProfiler::Scope scope(&testee, StartupProfiler::Preparation);
+		scope.setKind(StartupProfiler::Method);
+		scope.finish();
+		scope.finish(); // recorded once only
+	}
+	{
+		StartupProfiler::Scope disabled(0, StartupProfiler::Preparation); // profiling off
+	}
+
+	const StartupProfiler::Counters insertion = testee.counters(StartupProfiler::ServerInsertion, StartupProfiler::Variable);
+	EXPECT_EQ(10, insertion.calls);
+	EXPECT_GT(insertion.nanoseconds, 0);
+	if (StartupProfiler::countsAllocations())
+		EXPECT_GE(insertion.allocations, 10);
+	else
+		EXPECT_EQ(0, insertion.allocations);
+
+	EXPECT_EQ(1, testee.counters(StartupProfiler::Preparation, StartupProfiler::Method).calls);
+	EXPECT_EQ(0, testee.counters(StartupProfiler::Preparation, StartupProfiler::Unknown).calls);
+}
+
+TEST(StartupProfilerTest, testConcurrentRecording)
+{
+	StartupProfiler testee;
+	std::vector<std::thread> threads;
+	for (int t=0; t<4; ++t)
+		threads.push_back(std::thread([&testee]() {
+			for (int i=0; i<1000; ++i)
+				testee.record(StartupProfiler::Preparation, StartupProfiler::Object, 2, 1);
+		}));
+	for (size_t t=0; t<threads.size(); ++t)
+		threads[t].join();
+	const StartupProfiler::Counters c = testee.counters(StartupProfiler::Preparation, StartupProfiler::Object);
+	EXPECT_EQ(4000, c.calls);
+	EXPECT_EQ(8000, c.nanoseconds);
+	EXPECT_EQ(4000, c.allocations);
+}
+
+TEST(StartupProfilerTest, testReports)
+{
+	StartupProfiler testee;
+	testee.record(StartupProfiler::Registration, StartupProfiler::Object, 1500, 3);
+	const std::string json = testee.toJson();
+	EXPECT_NE(std::string::npos, json.find("{\"phase\":\"registration\",\"nodeKind\":\"object\",\"calls\":1,\"nanoseconds\":1500,\"allocations\":3}"));
+	EXPECT_EQ(std::string::npos, json.find("preparation")) << "phases never seen are left out";
+
+	const std::string table = testee.summaryTable();
+	EXPECT_NE(std::string::npos, table.find("registration"));
+	EXPECT_NE(std::string::npos, table.find("(all)"));
+}
@@ -0,0 +1,236 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * typedmethod_test.cpp
+ *
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "typedmethod.h"
+#include "methodexecutor.h"
+#include "opcua_baseobjecttype.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	class TypedMethodTest: public ::testing::Test
+	{
+	protected:
+		TypedMethodTest():
+			m_method(UaNodeId(UaString("m"), 2), UaString("m"), 2)
+		{
+			UA_Variant_init(&m_input[0]);
+			UA_Variant_init(&m_input[1]);
+			UA_Variant_init(&m_output[0]);
+			UA_Variant_init(&m_output[1]);
+			const OpcUa_Int32 count = 3;
+			UA_Variant_setScalarCopy(&m_input[0], &count, &UA_TYPES[UA_TYPES_INT32]);
+			UA_String label = UA_String_fromChars("abc");
+			UA_Variant_setScalarCopy(&m_input[1], &label, &UA_TYPES[UA_TYPES_STRING]);
+			UA_String_deleteMembers(&label);
+		}
+		~TypedMethodTest()
+		{
+			for (int i=0; i<2; ++i)
+			{
+				UA_Variant_deleteMembers(&m_input[i]);
+				UA_Variant_deleteMembers(&m_output[i]);
+			}
+		}
+
+		UA_StatusCode call( size_t inputSize, size_t outputSize )
+		{
+			return m_method.typedBinding()->call(inputSize, m_input, outputSize, m_output);
+		}
+
+		OpcUa::BaseMethod m_method;
+		UA_Variant m_input[2];
+		UA_Variant m_output[2];
+	};
+
+	UaStatus twice( OpcUa_Int32 n, OpcUa_Int32& result )
+	{
+		result = 2*n;
+		return OpcUa_Good;
+	}
+
+	//! The object the typed method belongs to; its own beginCall() is never used
+	class Receiver: public MethodManager
+	{
+	public:
+		virtual UaStatus beginCall(
+				MethodManagerCallback *callback,
+				const ServiceContext  &context,
+				OpcUa_UInt32          callbackHandle,
+				MethodHandle          *methodHandle,
+				const UaVariantArray  &inputArguments)
+		{
+			return OpcUa_BadInvalidState;
+		}
+	};
+}
+
+TEST_F(TypedMethodTest, testInputsAndOutputs)
+{
+	EXPECT_FALSE(m_method.typedBinding());
+	bindTypedMethod(&m_method, std::function<UaStatus(OpcUa_Int32, const UaString&, OpcUa_Double&, UaString&)>(
+			[](OpcUa_Int32 count, const UaString& label, OpcUa_Double& scaled, UaString& repeated) {
+				scaled = 1.5*count;
+				std::string s;
+				for (int i=0; i<count; ++i)
+					s += label.toUtf8();
+				repeated = UaString(s.c_str());
+				return UaStatus(OpcUa_Good);
+			}));
+	ASSERT_EQ(UA_STATUSCODE_GOOD, call(2, 2));
+	ASSERT_EQ(&UA_TYPES[UA_TYPES_DOUBLE], m_output[0].type);
+	EXPECT_EQ(4.5, *static_cast<OpcUa_Double*>(m_output[0].data));
+	ASSERT_EQ(&UA_TYPES[UA_TYPES_STRING], m_output[1].type);
+	EXPECT_EQ("abcabcabc", UaString(static_cast<UA_String*>(m_output[1].data)).toUtf8());
+}
+
+TEST_F(TypedMethodTest, testArgumentsAreChecked)
+{
+	bindTypedMethod(&m_method, twice);
+	EXPECT_EQ(UA_STATUSCODE_BADARGUMENTSMISSING, call(0, 1));
+	EXPECT_EQ(UA_STATUSCODE_BADTOOMANYARGUMENTS, call(2, 1));
+	ASSERT_EQ(UA_STATUSCODE_GOOD, call(1, 1));
+	EXPECT_EQ(6, *static_cast<OpcUa_Int32*>(m_output[0].data));
+
+	bindTypedMethod(&m_method, std::function<UaStatus(const UA_String&)>(
+			[](const UA_String& label) { return UaStatus(label.length == 3 ? OpcUa_Good : OpcUa_BadInvalidArgument); }));
+	EXPECT_EQ(UA_STATUSCODE_BADTYPEMISMATCH, call(1, 0)) << "an Int32 where a String is expected";
+}
+
+TEST_F(TypedMethodTest, testBadStatusIsReturned)
+{
+	bindTypedMethod(&m_method, std::function<UaStatus(OpcUa_Int32)>(
+			[](OpcUa_Int32) { return UaStatus(OpcUa_BadOutOfRange); }));
+	EXPECT_EQ(OpcUa_BadOutOfRange, call(1, 0));
+}
+
+TEST_F(TypedMethodTest, testWorkerPool)
+{
+	std::thread::id thread;
+	bindTypedMethod(&m_method, std::function<UaStatus(OpcUa_Int32, const UaString&, OpcUa_Double&, UaString&)>(
+			[&thread](OpcUa_Int32 count, const UaString& label, OpcUa_Double& scaled, UaString& repeated) {
+				thread = std::this_thread::get_id();
+				scaled = 1.5*count;
+				repeated = label;
+				return UaStatus(OpcUa_Good);
+			}));
+	MethodExecutor::startWorkerPool(2, boost::posix_time::seconds(10));
+	Receiver receiver;
+	MethodHandleUaNode handle;
+	ASSERT_EQ(UA_STATUSCODE_GOOD, MethodExecutor::call(&receiver, &handle, m_method.typedBinding(), 2, m_input, 2, m_output).statusCode());
+	MethodExecutor::stopWorkerPool();
+	EXPECT_NE(std::this_thread::get_id(), thread);
+	ASSERT_EQ(&UA_TYPES[UA_TYPES_DOUBLE], m_output[0].type);
+	EXPECT_EQ(4.5, *static_cast<OpcUa_Double*>(m_output[0].data));
+	ASSERT_EQ(&UA_TYPES[UA_TYPES_STRING], m_output[1].type);
+	EXPECT_EQ("abc", UaString(static_cast<UA_String*>(m_output[1].data)).toUtf8());
+}
+
+TEST_F(TypedMethodTest, testWorkerPoolTimeout)
+{
+	std::atomic<bool> begun (false);
+	bindTypedMethod(&m_method, std::function<UaStatus(OpcUa_Int32, OpcUa_Int32&)>(
+			[&begun](OpcUa_Int32 n, OpcUa_Int32& result) {
+				begun = true;
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+				result = n;
+				return UaStatus(OpcUa_Good);
+			}));
+	MethodExecutor::startWorkerPool(1, boost::posix_time::milliseconds(20));
+	Receiver receiver;
+	MethodHandleUaNode handle;
+	while (!begun) // a call the worker didn't get to within the timeout isn't run at all
+	{
+		EXPECT_EQ(UA_STATUSCODE_BADTIMEOUT, MethodExecutor::call(&receiver, &handle, m_method.typedBinding(), 1, m_input, 1, m_output).statusCode());
+		EXPECT_EQ(0, m_output[0].type) << "the server's outputs aren't touched by the late call";
+		EXPECT_TRUE(MethodExecutor::waitForCalls(&handle));
+	}
+	MethodExecutor::stopWorkerPool();
+	EXPECT_EQ(0, m_output[0].type);
+}
+
+TEST_F(TypedMethodTest, testRebindWhileRunningOnPool)
+{
+	std::atomic<bool> begun (false);
+	std::atomic<bool> released (false);
+	const std::string label ("the first binding's own");
+	bindTypedMethod(&m_method, std::function<UaStatus(OpcUa_Int32, UaString&)>(
+			[&begun, &released, label](OpcUa_Int32, UaString& result) {
+				begun = true;
+				while (!released)
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				result = UaString(label.c_str()); // its captures live as long as the call
+				return UaStatus(OpcUa_Good);
+			}));
+	MethodExecutor::startWorkerPool(1, boost::posix_time::seconds(10));
+	Receiver receiver;
+	MethodHandleUaNode handle;
+	UaStatus status;
+	std::thread caller ([this, &receiver, &handle, &status]() {
+		status = MethodExecutor::call(&receiver, &handle, m_method.typedBinding(), 1, m_input, 1, m_output);
+	});
+	while (!begun)
+		std::this_thread::yield();
+	bindTypedMethod(&m_method, twice);
+	released = true;
+	caller.join();
+	MethodExecutor::stopWorkerPool();
+	ASSERT_TRUE(status.isGood());
+	ASSERT_EQ(&UA_TYPES[UA_TYPES_STRING], m_output[0].type);
+	EXPECT_EQ(label, UaString(static_cast<UA_String*>(m_output[0].data)).toUtf8());
+}
+
+TEST_F(TypedMethodTest, testWorkerPoolQueuesWithObject)
+{
+	std::atomic<int> running (0);
+	std::atomic<int> maxRunning (0);
+	bindTypedMethod(&m_method, std::function<UaStatus(OpcUa_Int32, OpcUa_Int32&)>(
+			[&running, &maxRunning](OpcUa_Int32 n, OpcUa_Int32& result) {
+				const int now = ++running;
+				int max = maxRunning;
+				while (now > max && !maxRunning.compare_exchange_weak(max, now));
+				std::this_thread::sleep_for(std::chrono::milliseconds(5));
+				--running;
+				result = 2*n;
+				return UaStatus(OpcUa_Good);
+			}));
+	MethodExecutor::startWorkerPool(4, boost::posix_time::seconds(10), 1, 16);
+	Receiver receiver;
+	MethodHandleUaNode handle;
+	std::atomic<int> good (0);
+	std::vector<std::thread> callers;
+	for (int i=0; i<4; ++i)
+		callers.push_back(std::thread([this, &receiver, &handle, &good]() {
+			UA_Variant output;
+			UA_Variant_init(&output);
+			if (MethodExecutor::call(&receiver, &handle, m_method.typedBinding(), 1, m_input, 1, &output).isGood() &&
+					*static_cast<OpcUa_Int32*>(output.data) == 6)
+				++good;
+			UA_Variant_deleteMembers(&output);
+		}));
+	std::for_each(callers.begin(), callers.end(), [](std::thread& t) { t.join(); });
+	MethodExecutor::stopWorkerPool();
+	EXPECT_EQ(4, good);
+	EXPECT_EQ(1, maxRunning) << "typed calls take their turn with the object's other calls";
+}
@@ -0,0 +1,183 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * uadatavalue_test.cpp
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "uadatavalue.h"
+#include "arrays.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+TEST(UaDataValueTest, testCopyToIsDeep)
+{
+	UaDataValue testee(UaVariant(OpcUa_Double(3.5)), OpcUa_Good, UaDateTime::now(), UaDateTime::now());
+
+	UA_DataValue target;
+	UA_DataValue_init(&target);
+	ASSERT_EQ(UA_STATUSCODE_GOOD, testee.copyTo(&target));
+	EXPECT_TRUE(target.hasValue);
+	EXPECT_EQ(OpcUa_Good, target.status);
+	ASSERT_TRUE(target.value.data != 0);
+	EXPECT_NE(testee.impl()->value.data, target.value.data) << "the target owns its own copy";
+	EXPECT_EQ(3.5, *static_cast<OpcUa_Double*>(target.value.data));
+
+	testee = UaDataValue(UaVariant(OpcUa_Double(7.0)), OpcUa_Good, UaDateTime::now(), UaDateTime::now());
+	EXPECT_EQ(3.5, *static_cast<OpcUa_Double*>(target.value.data)) << "later updates don't touch the copy";
+	UA_DataValue_deleteMembers(&target);
+}
+
+TEST(UaDataValueTest, testReadersNeverSeeTornScalars)
+{
+	// even values are always written with Good, odd ones with Bad: a reader mixing two writes would see a mismatch
+	UaDataValue testee(UaVariant(OpcUa_Int64(0)), OpcUa_Good, UaDateTime::now(), UaDateTime::now());
+	std::atomic<bool> done (false);
+	std::atomic<int> mismatches (0);
+
+	std::vector<std::thread> readers;
+	for (int i=0; i<3; ++i)
+		readers.push_back(std::thread([&]()
+		{
+			while (!done)
+			{
+				UA_DataValue target;
+				UA_DataValue_init(&target);
+				if (testee.copyTo(&target) != UA_STATUSCODE_GOOD || !target.value.data)
+					++mismatches;
+				else if ((*static_cast<OpcUa_Int64*>(target.value.data) % 2 == 0) != (target.status == OpcUa_Good))
+					++mismatches;
+				UA_DataValue_deleteMembers(&target);
+			}
+		}));
+
+	for (OpcUa_Int64 v=1; v<2000; ++v)
+		testee = UaDataValue(UaVariant(v), v % 2 ? OpcUa_Bad : OpcUa_Good, UaDateTime::now(), UaDateTime::now());
+	done = true;
+	for (std::thread& reader: readers)
+		reader.join();
+	EXPECT_EQ(0, mismatches);
+}
+
+TEST(UaDataValueTest, testCopiesShareTheValue)
+{
+	UaDataValue testee(UaVariant(UaString(std::string(100000, 'x').c_str())), OpcUa_Good, UaDateTime::now(), UaDateTime::now());
+	UaDataValue copy (testee);
+	EXPECT_EQ(testee.impl(), copy.impl()) << "no deep copy made";
+	UaDataValue clone = testee.clone();
+	EXPECT_EQ(testee.impl(), clone.impl());
+
+	testee = UaDataValue(UaVariant(OpcUa_Double(1.0)), OpcUa_Good, UaDateTime::now(), UaDateTime::now());
+	EXPECT_NE(testee.impl(), copy.impl());
+	EXPECT_EQ(100000u, copy.impl()->value.data ? static_cast<UA_String*>(copy.impl()->value.data)->length : 0) << "copies keep the old value";
+}
+
+TEST(UaDataValueTest, testReadersOfStringsDuringWrites)
+{
+	// strings aren't published through the seqlock: readers copy from a snapshot the writer may be replacing
+	UaDataValue testee(UaVariant(UaString("")), OpcUa_Good, UaDateTime::now(), UaDateTime::now());
+	std::atomic<bool> done (false);
+	std::atomic<int> mismatches (0);
+
+	std::thread reader([&]()
+	{
+		while (!done)
+		{
+			UA_DataValue target;
+			UA_DataValue_init(&target);
+			testee.copyTo(&target);
+			const size_t length = static_cast<UA_String*>(target.value.data)->length;
+			if ((length % 2 == 0) != (target.status == OpcUa_Good))
+				++mismatches;
+			UA_DataValue_deleteMembers(&target);
+		}
+	});
+
+	for (int length=1; length<500; ++length)
+		testee = UaDataValue(UaVariant(UaString(std::string(length, 'x').c_str())), length % 2 ? OpcUa_Bad : OpcUa_Good, UaDateTime::now(), UaDateTime::now());
+	done = true;
+	reader.join();
+	EXPECT_EQ(0, mismatches);
+}
+
+TEST(UaDataValueTest, testAdoptAndMove)
+{
+	UA_DataValue built;
+	UA_DataValue_init(&built);
+	OpcUa_Double v = 2.5;
+	UA_Variant_setScalarCopy(&built.value, &v, &UA_TYPES[UA_TYPES_DOUBLE]);
+	built.hasValue = true;
+	const void* data = built.value.data;
+
+	UaDataValue adopted (std::move(built));
+	EXPECT_EQ(data, adopted.impl()->value.data) << "taken over, not copied";
+	EXPECT_TRUE(built.value.data == 0);
+
+	UaDataValue target(UaVariant(OpcUa_Double(0)), OpcUa_Good, UaDateTime::now(), UaDateTime::now());
+	target = std::move(adopted);
+	EXPECT_EQ(data, target.impl()->value.data);
+	EXPECT_FALSE(adopted.impl()->hasValue) << "moved-from values are empty";
+
+	UA_DataValue read;
+	UA_DataValue_init(&read);
+	ASSERT_EQ(UA_STATUSCODE_GOOD, target.copyTo(&read));
+	EXPECT_EQ(2.5, *static_cast<OpcUa_Double*>(read.value.data));
+	UA_DataValue_deleteMembers(&read);
+}
+
+TEST(UaDataValueTest, testTimestamps)
+{
+	UaDateTime source = UaDateTime::now();
+	source.addSecs(-10);
+	const UaDateTime server = UaDateTime::now();
+	UaDataValue testee(UaVariant(OpcUa_Double(1.0)), OpcUa_Good, source, server);
+
+	UA_DataValue target;
+	UA_DataValue_init(&target);
+	ASSERT_EQ(UA_STATUSCODE_GOOD, testee.copyTo(&target));
+	EXPECT_TRUE(target.hasSourceTimestamp);
+	EXPECT_TRUE(target.hasServerTimestamp);
+	EXPECT_EQ(source.impl(), target.sourceTimestamp);
+	EXPECT_EQ(server.impl(), target.serverTimestamp);
+	UA_DataValue_deleteMembers(&target);
+}
+
+TEST(UaDataValueTest, testCopyToOfIndexRange)
+{
+	UaInt32Array array;
+	array.create(1000);
+	for (int i=0; i<1000; ++i)
+		array[i] = i;
+	UaVariant variant;
+	variant.setInt32Array(array);
+	UaDataValue testee(variant, OpcUa_Good, UaDateTime::now(), UaDateTime::now());
+
+	UA_NumericRangeDimension dimension = { 500, 509 };
+	UA_NumericRange range = { 1, &dimension };
+	UA_DataValue target;
+	UA_DataValue_init(&target);
+	ASSERT_EQ(UA_STATUSCODE_GOOD, testee.copyTo(&target, range));
+	ASSERT_EQ(10u, target.value.arrayLength) << "only the slice is copied";
+	EXPECT_EQ(500, static_cast<OpcUa_Int32*>(target.value.data)[0]);
+	EXPECT_EQ(509, static_cast<OpcUa_Int32*>(target.value.data)[9]);
+	EXPECT_EQ(testee.impl()->sourceTimestamp, target.sourceTimestamp);
+	UA_DataValue_deleteMembers(&target);
+
+	dimension.min = 2000;
+	dimension.max = 2001;
+	EXPECT_EQ(OpcUa_BadIndexRangeNoData, testee.copyTo(&target, range));
+	UA_DataValue_deleteMembers(&target);
+}
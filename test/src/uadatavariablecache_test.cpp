@@ -0,0 +1,39 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * uadatavariablecache_test.cpp
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "uadatavariablecache.h"
+
+TEST(UaPropertyMethodArgumentTest, testArgumentsContiguousAndNamesShared)
+{
+	UaPropertyMethodArgument first(UaNodeId(UaString("obj1.setVoltage.args"), 2), 0, 2, UaPropertyMethodArgument::INARGUMENTS);
+	UaPropertyMethodArgument second(UaNodeId(UaString("obj2.setVoltage.args"), 2), 0, 2, UaPropertyMethodArgument::INARGUMENTS);
+	UaUInt32Array noDimensions;
+	UaLocalizedText noDescription("en_US", "");
+	for (UaPropertyMethodArgument* property : {&first, &second})
+	{
+		EXPECT_EQ(OpcUa_Good, property->setArgument(0, "channel", UaNodeId(UA_NS0ID_UINT32, 0), -1, noDimensions, noDescription));
+		EXPECT_EQ(OpcUa_Good, property->setArgument(1, "voltage", UaNodeId(UA_NS0ID_DOUBLE, 0), -1, noDimensions, noDescription));
+	}
+	EXPECT_EQ(OpcUa_BadInvalidArgument, first.setArgument(2, "extra", UaNodeId(UA_NS0ID_DOUBLE, 0), -1, noDimensions, noDescription));
+
+	ASSERT_EQ(2, first.numArguments());
+	EXPECT_EQ(&first.implArgument(0) + 1, &first.implArgument(1)) << "arguments are contiguous";
+	EXPECT_EQ(first.implArguments(), &first.implArgument(0));
+	EXPECT_EQ(UA_NS0ID_DOUBLE, first.implArgument(1).dataType.identifier.numeric);
+	EXPECT_EQ(first.implArgument(1).name.data, second.implArgument(1).name.data) << "same names are stored once";
+}
@@ -0,0 +1,225 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * uanode_test.cpp
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "uanode.h"
+
+#include <thread>
+#include <algorithm>
+#include <boost/foreach.hpp>
+#include <vector>
+
+namespace
+{
+	class TestNode: public UaNode
+	{
+	public:
+		TestNode(int id): m_id(id) {}
+		virtual UaNodeId nodeId() const { return UaNodeId(m_id, 2); }
+		virtual UaQualifiedName browseName() const { return UaQualifiedName(2, "test"); }
+		virtual UaNodeId typeDefinitionId() const { return UaNodeId(UA_NS0ID_BASEOBJECTTYPE, 0); }
+		virtual OpcUa_NodeClass nodeClass() const { return OpcUa_NodeClass_Object; }
+	private:
+		int m_id;
+	};
+
+	std::vector<UaNode*> targetsOf(const UaNode::ReferencedTargetRange& range)
+	{
+		std::vector<UaNode*> targets;
+		for (UaNode::ReferencedTargetRange::const_iterator it = range.begin(); it != range.end(); ++it)
+			targets.push_back(it->target);
+		return targets;
+	}
+}
+
+TEST(UaNodeTest, testReferencesGroupedByType)
+{
+	TestNode parent(0);
+	TestNode a(1), b(2), c(3), d(4), e(5);
+
+	parent.addReferencedTarget(&a, OpcUaId_HasProperty);
+	parent.addReferencedTarget(&b, OpcUaId_HasComponent);
+	parent.addReferencedTarget(&c, OpcUaId_Organizes);
+	parent.addReferencedTarget(&d, OpcUaId_HasComponent);
+	parent.addReferencedTarget(&e, OpcUaId_HasProperty);
+
+	EXPECT_EQ(5, parent.referencedTargets()->size());
+
+	UaNode::ReferencedTargetRange components = parent.referencedTargets(OpcUaId_HasComponent);
+	ASSERT_EQ(2, components.size());
+	ASSERT_EQ(2, targetsOf(components).size());
+	EXPECT_EQ(&b, targetsOf(components)[0]) << "order of addition kept within a group";
+	EXPECT_EQ(&d, targetsOf(components)[1]);
+	EXPECT_TRUE(components.begin()->referenceTypeId == OpcUaId_HasComponent);
+
+	UaNode::ReferencedTargetRange properties = parent.referencedTargets(OpcUaId_HasProperty);
+	ASSERT_EQ(2, properties.size());
+	EXPECT_EQ(&a, properties.begin()->target);
+
+	EXPECT_EQ(1, parent.referencedTargets(OpcUaId_Organizes).size());
+	EXPECT_TRUE(parent.referencedTargets(UaNodeId(UA_NS0ID_HASPROPERTY, 1)).empty()) << "same numeric id in another namespace is another reference type";
+}
+
+TEST(UaNodeTest, testIteratedLikeAList)
+{
+	TestNode parent(0);
+	TestNode a(1), b(2), c(3);
+	EXPECT_TRUE(parent.referencedTargets()->begin() == parent.referencedTargets()->end());
+
+	parent.addReferencedTarget(&a, OpcUaId_Organizes);
+	parent.addReferencedTarget(&b, OpcUaId_HasComponent);
+	parent.addReferencedTarget(&c, OpcUaId_Organizes);
+
+	std::vector<UaNode*> forward;
+	BOOST_FOREACH (const UaNode::ReferencedTarget& reference, *parent.referencedTargets())
+		forward.push_back(reference.target);
+	ASSERT_EQ(3, forward.size());
+	EXPECT_EQ(&b, forward[0]) << "grouped by reference type";
+	EXPECT_EQ(&a, forward[1]);
+	EXPECT_EQ(&c, forward[2]);
+
+	std::vector<UaNode*> backward;
+	for (UaNode::ReferencedTargets::const_reverse_iterator it = parent.referencedTargets()->rbegin(); it != parent.referencedTargets()->rend(); ++it)
+		backward.push_back(it->target);
+	EXPECT_TRUE(std::equal(forward.rbegin(), forward.rend(), backward.begin()));
+}
+
+TEST(UaNodeTest, testLookupDoesntRegister)
+{
+	TestNode parent(0), a(1);
+	const UaNodeId unknown(UaString("NeverUsedReferenceType"), 2);
+	EXPECT_TRUE(parent.referencedTargets(unknown).empty());
+	EXPECT_FALSE(parent.removeReferencedTarget(&a, unknown));
+	ReferenceTypeRegistry::Index index;
+	EXPECT_FALSE(ReferenceTypeRegistry::find(unknown, index)) << "looking up references of a type doesn't register it";
+
+	parent.addReferencedTarget(&a, unknown);
+	EXPECT_TRUE(ReferenceTypeRegistry::find(unknown, index));
+	EXPECT_EQ(ReferenceTypeRegistry::indexOf(unknown), index);
+	EXPECT_EQ(1, parent.referencedTargets(unknown).size());
+}
+
+TEST(UaNodeTest, testCustomReferenceTypeRegistered)
+{
+	const UaNodeId custom(UaString("MyReferenceType"), 2);
+	const ReferenceTypeRegistry::Index index = ReferenceTypeRegistry::indexOf(custom);
+	EXPECT_EQ(index, ReferenceTypeRegistry::indexOf(UaNodeId(UaString("MyReferenceType"), 2)));
+	EXPECT_TRUE(ReferenceTypeRegistry::nodeId(index) == custom);
+}
+
+TEST(UaNodeTest, testConcurrentRegistrationAndLookup)
+{
+	// more reference types than a chunk of the registry, registered and looked up from several threads at once
+	const int numTypes = 200;
+	const int numThreads = 4;
+	std::vector<ReferenceTypeRegistry::Index> indices (numTypes * numThreads);
+	std::vector<std::thread> threads;
+	for (int t=0; t<numThreads; ++t)
+		threads.push_back(std::thread([t, &indices]() {
+			for (int i=0; i<numTypes; ++i)
+			{
+				const int type = (i + t * 50) % numTypes;
+				const ReferenceTypeRegistry::Index index = ReferenceTypeRegistry::indexOf(UaNodeId(type, 7));
+				indices[t * numTypes + type] = index;
+				EXPECT_TRUE(ReferenceTypeRegistry::nodeId(index) == UaNodeId(type, 7));
+			}
+		}));
+	for (size_t t=0; t<threads.size(); ++t)
+		threads[t].join();
+
+	for (int type=0; type<numTypes; ++type)
+		for (int t=1; t<numThreads; ++t)
+			EXPECT_EQ(indices[type], indices[t * numTypes + type]) << "registered once";
+}
+
+TEST(UaNodeTest, testReferenceTypeIdUsableAsNodeId)
+{
+	TestNode parent(0), a(1);
+	parent.addReferencedTarget(&a, OpcUaId_Organizes);
+	const UaNode::ReferencedTarget& reference = *parent.referencedTargets()->begin();
+	EXPECT_TRUE(reference.referenceTypeId == OpcUaId_Organizes);
+	const UaNodeId copy = reference.referenceTypeId;
+	EXPECT_TRUE(copy == OpcUaId_Organizes);
+	EXPECT_EQ(UA_NS0ID_ORGANIZES, reference.referenceTypeId.identifierNumeric());
+	EXPECT_EQ(sizeof(ReferenceTypeRegistry::Index), sizeof reference.referenceTypeId);
+}
+
+TEST(UaNodeTest, testRemoveReferencedTarget)
+{
+	TestNode parent(0);
+	TestNode a(1), b(2), c(3);
+
+	parent.addReferencedTarget(&a, OpcUaId_HasComponent);
+	parent.addReferencedTarget(&b, OpcUaId_HasComponent);
+	parent.addReferencedTarget(&c, OpcUaId_HasComponent);
+	parent.addReferencedTarget(&b, OpcUaId_Organizes);
+
+	EXPECT_FALSE(parent.removeReferencedTarget(&a, OpcUaId_Organizes)) << "only the reference of given type is looked for";
+	EXPECT_TRUE(parent.removeReferencedTarget(&b, OpcUaId_HasComponent));
+	EXPECT_FALSE(parent.removeReferencedTarget(&b, OpcUaId_HasComponent));
+
+	UaNode::ReferencedTargetRange components = parent.referencedTargets(OpcUaId_HasComponent);
+	ASSERT_EQ(2, components.size());
+	ASSERT_EQ(2, targetsOf(components).size());
+	EXPECT_EQ(&a, targetsOf(components)[0]);
+	EXPECT_EQ(&c, targetsOf(components)[1]);
+	EXPECT_EQ(1, parent.referencedTargets(OpcUaId_Organizes).size());
+	EXPECT_EQ(3, parent.referencedTargets()->size());
+}
+
+TEST(UaNodeTest, testRemovalsKeepOrder)
+{
+	TestNode parent(0), other(1);
+	std::vector<TestNode*> children;
+	for (int i=0; i<20; ++i)
+	{
+		children.push_back(new TestNode(i + 10));
+		parent.addReferencedTarget(children.back(), OpcUaId_HasComponent);
+	}
+	parent.addReferencedTarget(&other, OpcUaId_Organizes);
+
+	// every other one from the front, then some from the back: holes, and squeezing them out, in between
+	std::vector<UaNode*> expected (children.begin(), children.end());
+	for (int i=0; i<20; i+=2)
+		ASSERT_TRUE(parent.removeReferencedTarget(children[i], OpcUaId_HasComponent));
+	for (int i=19; i>=15; i-=2)
+		ASSERT_TRUE(parent.removeReferencedTarget(children[i], OpcUaId_HasComponent));
+	expected.clear();
+	for (int i=1; i<15; i+=2)
+		expected.push_back(children[i]);
+	EXPECT_EQ(expected, targetsOf(parent.referencedTargets(OpcUaId_HasComponent)));
+	EXPECT_EQ(expected.size(), parent.referencedTargets(OpcUaId_HasComponent).size());
+
+	std::vector<UaNode*> all;
+	BOOST_FOREACH (const UaNode::ReferencedTarget& reference, *parent.referencedTargets())
+		all.push_back(reference.target);
+	expected.push_back(&other);
+	EXPECT_EQ(expected, all);
+	std::vector<UaNode*> backward;
+	for (UaNode::ReferencedTargets::const_reverse_iterator it = parent.referencedTargets()->rbegin(); it != parent.referencedTargets()->rend(); ++it)
+		backward.push_back(it->target);
+	EXPECT_TRUE(std::equal(expected.rbegin(), expected.rend(), backward.begin()));
+	EXPECT_EQ(expected.size(), parent.referencedTargets()->size());
+
+	for (int i=1; i<15; i+=2)
+		ASSERT_TRUE(parent.removeReferencedTarget(children[i], OpcUaId_HasComponent));
+	EXPECT_TRUE(parent.referencedTargets(OpcUaId_HasComponent).empty());
+	ASSERT_EQ(1, parent.referencedTargets()->size());
+	EXPECT_EQ(&other, parent.referencedTargets()->begin()->target);
+	for (size_t i=0; i<children.size(); ++i)
+		delete children[i];
+}
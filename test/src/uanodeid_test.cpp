@@ -0,0 +1,47 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * uanodeid_test.cpp
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "uanodeid.h"
+
+#include <unordered_map>
+
+TEST(UaNodeIdTest, testEqualIdsHashEqual)
+{
+	EXPECT_EQ(UaNodeId(1234, 2).hash(), UaNodeId(1234, 2).hash());
+	EXPECT_EQ(UaNodeId(UaString("dev.temperature"), 2).hash(), UaNodeId(UaString("dev.temperature"), 2).hash());
+
+	UaNodeId original(UaString("dev.voltage"), 2);
+	UaNodeId copy(original);
+	EXPECT_EQ(original.hash(), copy.hash()) << "a copy must land in the same bucket";
+}
+
+TEST(UaNodeIdTest, testUnorderedMapLookup)
+{
+	std::unordered_map<UaNodeId, int, UaNodeIdHash> index;
+	for (int i=0; i<1000; ++i)
+	{
+		index.insert(std::make_pair(UaNodeId(i, 2), i));
+		index.insert(std::make_pair(UaNodeId(UaString(("obj"+std::to_string(i)).c_str()), 2), -i));
+	}
+	EXPECT_EQ(2000, index.size());
+
+	EXPECT_EQ(500, index.at(UaNodeId(500, 2)));
+	EXPECT_EQ(-500, index.at(UaNodeId(UaString("obj500"), 2)));
+	EXPECT_TRUE(index.find(UaNodeId(500, 3)) == index.end()) << "namespace index is part of the key";
+	EXPECT_TRUE(index.find(UaNodeId(UaString("obj1000"), 2)) == index.end());
+}
@@ -0,0 +1,110 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * updatequeue_test.cpp
+ *
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "updatequeue.h"
+#include "recordingvariable.h"
+
+#include <thread>
+
+namespace
+{
+	class UpdateQueueTest: public ::testing::Test
+	{
+	protected:
+		UpdateQueueTest():
+			m_variable(UaNodeId(UaString("v"), 2), UaString("v"), 2, UaVariant(OpcUa_Int32(-1)), OpcUa_AccessLevels_CurrentRead, 0)
+		{}
+
+		OpcUa_Int32 current() const { return *static_cast<OpcUa_Int32*>(m_variable.valueImpl()->value.data); }
+
+		OpcUa::BaseDataVariableType m_variable;
+	};
+}
+
+TEST_F(UpdateQueueTest, testOverflowIsCounted)
+{
+	UpdateQueue testee(5);
+	EXPECT_EQ(8u, testee.capacity());
+	for (OpcUa_Int32 i=0; i<10; ++i)
+		testee.push(&m_variable, UaVariant(i));
+	EXPECT_EQ(8u, testee.pushed());
+	EXPECT_EQ(2u, testee.dropped());
+	EXPECT_EQ(-1, current()) << "nothing applied before the consumer runs";
+
+	EXPECT_EQ(8u, testee.drain());
+	EXPECT_EQ(7, current()) << "applied in order";
+	EXPECT_EQ(8u, testee.applied());
+	EXPECT_TRUE(testee.push(&m_variable, UaVariant(OpcUa_Int32(100))));
+	EXPECT_EQ(1u, testee.drain());
+}
+
+TEST_F(UpdateQueueTest, testSuppressedCountedApart)
+{
+	m_variable.setAbsoluteDeadband(5);
+	UpdateQueue testee(4);
+	testee.push(&m_variable, UaVariant(OpcUa_Int32(1))); // within the deadband of -1
+	testee.push(&m_variable, UaVariant(OpcUa_Int32(10)));
+	EXPECT_EQ(2u, testee.drain());
+	EXPECT_EQ(1u, testee.applied());
+	EXPECT_EQ(1u, testee.suppressed());
+	EXPECT_EQ(10, current());
+}
+
+TEST_F(UpdateQueueTest, testSubclassesSetValueCalled)
+{
+	RecordingVariable variable (UaVariant(OpcUa_Int32(-1)));
+	UpdateQueue testee(4);
+	testee.push(&variable, UaVariant(OpcUa_Int32(5)));
+	testee.push(&variable, UaVariant(OpcUa_Int32(6)));
+	EXPECT_EQ(2u, testee.drain());
+	EXPECT_EQ(2, variable.m_calls) << "drain() must go through the const& override";
+	EXPECT_EQ(6, *static_cast<OpcUa_Int32*>(variable.valueImpl()->value.data));
+}
+
+TEST_F(UpdateQueueTest, testManyProducers)
+{
+	UpdateQueue testee(1 << 16);
+	std::vector<std::thread> producers;
+	for (int p=0; p<4; ++p)
+		producers.push_back(std::thread([&]()
+		{
+			for (OpcUa_Int32 i=0; i<5000; ++i)
+				testee.push(&m_variable, UaVariant(i));
+		}));
+	size_t drained = 0;
+	while (drained < 20000)
+		drained += testee.drain();
+	for (std::thread& producer: producers)
+		producer.join();
+	EXPECT_EQ(20000u, testee.applied());
+	EXPECT_EQ(0u, testee.dropped());
+}
+
+TEST_F(UpdateQueueTest, testConsumerThread)
+{
+	UpdateQueue testee(16);
+	testee.start(boost::posix_time::milliseconds(1));
+	testee.push(&m_variable, UaVariant(OpcUa_Int32(42)));
+	for (int i=0; i<1000 && testee.applied() == 0; ++i)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	EXPECT_EQ(42, current());
+	testee.push(&m_variable, UaVariant(OpcUa_Int32(43)));
+	testee.stop();
+	EXPECT_EQ(43, current()) << "stop() drains what is left";
+}
@@ -0,0 +1,66 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * valueclock_test.cpp
+ *
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "valueclock.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+namespace
+{
+	class ValueClockTest: public ::testing::Test
+	{
+	protected:
+		~ValueClockTest() { ValueClock::setSource(ValueClock::Precise); }
+	};
+}
+
+TEST_F(ValueClockTest, testCoarseIsCloseToPrecise)
+{
+	ValueClock::setSource(ValueClock::Coarse);
+	const UA_DateTime precise = UaDateTime::now().impl();
+	const UA_DateTime coarse = ValueClock::now().impl();
+	EXPECT_LT(std::abs(coarse - precise), 50 * UA_DATETIME_MSEC);
+}
+
+TEST_F(ValueClockTest, testBatchSharesOneTimestamp)
+{
+	ValueClock::setSource(ValueClock::Batched);
+	UA_DateTime first, second;
+	{
+		ValueClock::Batch batch;
+		first = ValueClock::now().impl();
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		{
+			ValueClock::Batch nested;
+			second = ValueClock::now().impl();
+		}
+	}
+	EXPECT_EQ(first, second);
+	EXPECT_GT(ValueClock::now().impl(), second) << "outside of the batch the clock moves on";
+}
+
+TEST_F(ValueClockTest, testBatchIgnoredWithOtherSources)
+{
+	ValueClock::Batch batch;
+	const UA_DateTime first = ValueClock::now().impl();
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	EXPECT_GT(ValueClock::now().impl(), first);
+}
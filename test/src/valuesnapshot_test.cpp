@@ -0,0 +1,171 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * valuesnapshot_test.cpp
+ *
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "valuesnapshot.h"
+
+#include <atomic>
+#include <thread>
+
+namespace
+{
+	ValueSnapshot* makeSnapshot( UA_Double v )
+	{
+		UA_DataValue value;
+		UA_DataValue_init(&value);
+		UA_Variant_setScalarCopy(&value.value, &v, &UA_TYPES[UA_TYPES_DOUBLE]);
+		value.hasValue = true;
+		return ValueSnapshot::adopt(value);
+	}
+
+	ValueSnapshot* makeSnapshotOfSize( size_t numBytes )
+	{
+		UA_DataValue value;
+		UA_DataValue_init(&value);
+		UA_ByteString bytes;
+		bytes.length = numBytes;
+		bytes.data = static_cast<UA_Byte*>(UA_malloc(numBytes));
+		UA_Variant_setScalarCopy(&value.value, &bytes, &UA_TYPES[UA_TYPES_BYTESTRING]);
+		UA_free(bytes.data);
+		value.hasValue = true;
+		return ValueSnapshot::adopt(value);
+	}
+
+	//! Opens a read section from a destructor of a thread_local which runs after the reclaimer's record of the thread is gone
+	struct ReaderAtThreadExit
+	{
+		ReaderAtThreadExit(): snapshot(0), referencesInReadSection(0) {}
+		~ReaderAtThreadExit()
+		{
+			EpochReclaimer::ReadSection readSection;
+			EpochReclaimer::instance().retire(snapshot);
+			EpochReclaimer::instance().reclaim();
+			*referencesInReadSection = snapshot->references();
+		}
+		ValueSnapshot* snapshot;
+		std::atomic<unsigned int>* referencesInReadSection;
+	};
+}
+
+TEST(ValueSnapshotTest, testRetiredSnapshotOutlivesReadSection)
+{
+	EpochReclaimer& reclaimer = EpochReclaimer::instance();
+	reclaimer.reclaim();
+	const size_t before = reclaimer.numRetired();
+
+	ValueSnapshot* snapshot = makeSnapshot(1.5);
+	snapshot->acquire(); // keep one for the test, to see when the retired one gets dropped
+	{
+		EpochReclaimer::ReadSection readSection;
+		reclaimer.retire(snapshot);
+		EXPECT_EQ(before + 1, reclaimer.numRetired()) << "a read section which started before the retire is open";
+		EXPECT_EQ(2u, snapshot->references());
+	}
+	reclaimer.reclaim();
+	EXPECT_EQ(before, reclaimer.numRetired());
+	EXPECT_EQ(1u, snapshot->references());
+	EXPECT_EQ(1.5, *static_cast<UA_Double*>(snapshot->value().value.data));
+	snapshot->release();
+}
+
+TEST(ValueSnapshotTest, testReadSectionOfAnotherThreadDelaysReclaim)
+{
+	EpochReclaimer& reclaimer = EpochReclaimer::instance();
+	ValueSnapshot* snapshot = makeSnapshot(2.5);
+	snapshot->acquire();
+
+	std::atomic<int> stage (0);
+	std::thread reader([&]()
+	{
+		EpochReclaimer::ReadSection readSection;
+		stage = 1;
+		while (stage != 2);
+	});
+	while (stage != 1);
+	reclaimer.retire(snapshot);
+	reclaimer.reclaim();
+	EXPECT_EQ(2u, snapshot->references());
+	stage = 2;
+	reader.join();
+
+	reclaimer.reclaim();
+	EXPECT_EQ(1u, snapshot->references());
+	snapshot->release();
+}
+
+TEST(ValueSnapshotTest, testRetiredSnapshotsReleasedWithoutReclaim)
+{
+	EpochReclaimer& reclaimer = EpochReclaimer::instance();
+	ValueSnapshot* snapshot = makeSnapshot(3.5);
+	snapshot->acquire();
+	reclaimer.retire(snapshot);
+	EXPECT_EQ(2u, snapshot->references()) << "a single retire() doesn't look for what to release";
+	for (size_t i=0; i<EpochReclaimer::RetireThreshold; ++i)
+		reclaimer.retire(makeSnapshot(i));
+	EXPECT_EQ(1u, snapshot->references()) << "released once enough were retired";
+	snapshot->release();
+}
+
+TEST(ValueSnapshotTest, testSnapshotsOfExitedThreadReclaimed)
+{
+	EpochReclaimer& reclaimer = EpochReclaimer::instance();
+	ValueSnapshot* snapshot = makeSnapshot(4.5);
+	snapshot->acquire();
+	std::thread writer([&]() { reclaimer.retire(snapshot); });
+	writer.join();
+	EXPECT_EQ(2u, snapshot->references());
+	reclaimer.reclaim();
+	EXPECT_EQ(1u, snapshot->references());
+	snapshot->release();
+}
+
+TEST(ValueSnapshotTest, testLargeSnapshotsReleasedBeforeThreshold)
+{
+	ValueSnapshot* snapshot = makeSnapshotOfSize(EpochReclaimer::RetireBytes / 2);
+	EXPECT_LT(EpochReclaimer::RetireBytes / 2, snapshot->size());
+	snapshot->acquire();
+	std::thread writer([&]()
+	{
+		EpochReclaimer& reclaimer = EpochReclaimer::instance();
+		reclaimer.retire(snapshot);
+		EXPECT_EQ(2u, snapshot->references());
+		reclaimer.retire(makeSnapshotOfSize(EpochReclaimer::RetireBytes / 2));
+		EXPECT_EQ(1u, snapshot->references()) << "released after two retire()s, as they add up to RetireBytes";
+	});
+	writer.join();
+	snapshot->release();
+}
+
+TEST(ValueSnapshotTest, testReadSectionAfterThreadRecordGone)
+{
+	ValueSnapshot* snapshot = makeSnapshot(5.5);
+	snapshot->acquire();
+	std::atomic<unsigned int> referencesInReadSection (0);
+	std::thread reader([&]()
+	{
+		static thread_local ReaderAtThreadExit readerAtExit; // constructed first, so destroyed last
+		readerAtExit.snapshot = snapshot;
+		readerAtExit.referencesInReadSection = &referencesInReadSection;
+		EpochReclaimer::ReadSection readSection; // gives the thread its record
+	});
+	reader.join();
+	EXPECT_EQ(2u, referencesInReadSection.load()) << "not released while that read section was open";
+	EpochReclaimer::instance().reclaim();
+	EXPECT_EQ(1u, snapshot->references());
+	snapshot->release();
+}
@@ -0,0 +1,80 @@
+/* © Copyright CERN, 2018.  All rights not expressly granted are reserved.
+ * variablestatistics_test.cpp
+ *
+ *
+ *  This file is part of Quasar.
+ *
+ *  Quasar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public Licence as published by
+ *  the Free Software Foundation, either version 3 of the Licence.
+ *
+ *  Quasar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with Quasar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "variablestatistics.h"
+#include "opcua_basedatavariabletype.h"
+#include "valueclock.h"
+
+TEST(VariableStatisticsTest, testLatencyBuckets)
+{
+	EXPECT_EQ(0u, VariableStatistics::latencyBucket(0));
+	EXPECT_EQ(0u, VariableStatistics::latencyBucket(999));
+	EXPECT_EQ(1u, VariableStatistics::latencyBucket(1000));
+	EXPECT_EQ(2u, VariableStatistics::latencyBucket(2000));
+	EXPECT_EQ(2u, VariableStatistics::latencyBucket(3999));
+	EXPECT_EQ(3u, VariableStatistics::latencyBucket(4000));
+	EXPECT_EQ(unsigned(VariableStatistics::NumLatencyBuckets-1), VariableStatistics::latencyBucket(~0ull));
+}
+
+TEST(VariableStatisticsTest, testRecord)
+{
+	VariableStatistics testee;
+	testee.record(VariableStatistics::Read, 500);
+	testee.record(VariableStatistics::Read, 1500);
+	testee.record(VariableStatistics::Write, 3000);
+	{
+		VariableStatistics::Scope timing(&testee, VariableStatistics::Update);
+	}
+	{
+		VariableStatistics::Scope timing(0, VariableStatistics::Update);
+	}
+	EXPECT_EQ(2u, testee.count(VariableStatistics::Read));
+	EXPECT_EQ(1u, testee.count(VariableStatistics::Write));
+	EXPECT_EQ(1u, testee.count(VariableStatistics::Update));
+
+	std::uint64_t histogram[VariableStatistics::NumLatencyBuckets];
+	testee.latencyHistogram(VariableStatistics::Read, histogram);
+	EXPECT_EQ(1u, histogram[0]);
+	EXPECT_EQ(1u, histogram[1]);
+	testee.latencyHistogram(VariableStatistics::Write, histogram);
+	EXPECT_EQ(1u, histogram[2]);
+}
+
+TEST(VariableStatisticsTest, testVariableCountsServerSideUpdatesOnly)
+{
+	OpcUa::BaseDataVariableType variable(UaNodeId(UaString("v"), 2), UaString("v"), 2, UaVariant(OpcUa_Int32(0)),
+			OpcUa_AccessLevels_CurrentReadOrWrite, 0);
+	EXPECT_EQ(0, variable.statistics());
+	variable.setValue(0, UaDataValue(UaVariant(OpcUa_Int32(1)), OpcUa_Good, ValueClock::now(), ValueClock::now()), OpcUa_False);
+
+	std::shared_ptr<VariableStatistics> statistics = variable.enableStatistics();
+	EXPECT_EQ(statistics.get(), variable.statistics());
+	EXPECT_EQ(statistics, variable.enableStatistics());
+	EXPECT_EQ(0u, statistics->count(VariableStatistics::Update)) << "nothing counted while off";
+
+	variable.setValue(0, UaDataValue(UaVariant(OpcUa_Int32(2)), OpcUa_Good, ValueClock::now(), ValueClock::now()), OpcUa_False);
+	variable.setValue(0, UaDataValue(UaVariant(OpcUa_Int32(3)), OpcUa_Good, ValueClock::now(), ValueClock::now()), OpcUa_False);
+	variable.setValue((Session*)-1, UaDataValue(UaVariant(OpcUa_Int32(4)), OpcUa_Good, ValueClock::now(), ValueClock::now()), OpcUa_True);
+	EXPECT_EQ(2u, statistics->count(VariableStatistics::Update)) << "clients' writes are counted by the data source, not here";
+
+	const UaVariant value(OpcUa_Int32(5));
+	const OpcUa::BaseDataVariableType::Update update = { &variable, &value, OpcUa_Good };
+	OpcUa::BaseDataVariableType::setValues(&update, 1);
+	EXPECT_EQ(3u, statistics->count(VariableStatistics::Update));
+}